@@ -0,0 +1,158 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the batch transform.
+
+#include <sys/time.h>
+
+#include "batch.h"
+
+namespace {
+
+// Number of counters of each engine.
+const unsigned COUNTERS = 6;
+
+} // namespace
+
+// imaging::binary::morphology::BatchTransform
+
+imaging::binary::morphology::BatchTransform::~BatchTransform() {
+  unsigned engine = 0;
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  for (engine = 0; engine < engines_.size(); ++engine) {
+    delete engines_.at(engine);
+  }
+}
+
+bool imaging::binary::morphology::BatchTransform::Calculate(
+    const std::vector<imaging::binary::Image*> &images,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    std::vector<imaging::grayscale::Image*> *outputs,
+    double *start,
+    double *end) {
+  if (outputs == NULL || start == NULL || end == NULL) return false;
+  if (!outputs->empty() || factory_ == NULL) return false;
+  std::shared_ptr<const imaging::binary::morphology::TransformPlan>
+      cached_plan;
+  unsigned engine = 0;
+  imaging::ImagePositionIndex image = 0;
+  const imaging::ImagePositionIndex number_of_images = images.size();
+  bool ok_so_far = true;
+  struct timeval timer;
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  // Preprocess SEs once for the whole batch.
+  ok_so_far = imaging::binary::morphology::TransformPlanCache::Instance().Find(
+      se, &cached_plan);
+  if (!ok_so_far) return ok_so_far;
+  // One engine per thread, as no more images run at once.
+  while (engines_.size() < threads()) {
+    engines_.push_back(factory_());
+    if (engines_.back() == NULL) return false;
+    counters_.resize(engines_.size()*COUNTERS);
+  }
+  idle_.clear();
+  for (engine = 0; ok_so_far && engine < engines_.size(); ++engine) {
+    ok_so_far = engines_.at(engine)->set_seed(seed_, stream_);
+    idle_.push_back(engine);
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Outputs are allocated beforehand, as reading the size of an image is
+  // not thread safe.
+  for (image = 0; ok_so_far && image < number_of_images; ++image) {
+    if (images.at(image) == NULL) ok_so_far = false;
+    if (!ok_so_far) continue;
+    outputs->push_back(
+        new imaging::grayscale::Image(images.at(image)->size(), -1));
+  }
+  if (!ok_so_far) return ok_so_far;
+  images_ = &images;
+  outputs_ = outputs;
+  plan_ = cached_plan.get();
+  if (pool_ == NULL) {
+    for (image = 0; ok_so_far && image < number_of_images; ++image) {
+      ok_so_far = RunImage(image);
+    }
+  } else {
+    for (image = 0; image < number_of_images; ++image) {
+      if (!pool_->Submit([this, image]() {
+            return RunImage(image);
+          })) ok_so_far = false;
+    }
+    if (!pool_->Wait()) ok_so_far = false;
+  }
+  images_ = NULL;
+  outputs_ = NULL;
+  plan_ = NULL;
+  if (!ok_so_far) return ok_so_far;
+  // Finally!
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BatchTransform::set_seed(
+    const uint64_t seed, const uint64_t stream) {
+  seed_ = seed;
+  stream_ = stream;
+  return true;
+}
+
+bool imaging::binary::morphology::BatchTransform::set_threads(
+    const unsigned threads) {
+  if (threads == 0) return false;
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  if (threads == 1) return true;
+  pool_ = new imaging::WorkStealingPool(threads);
+  return pool_ != NULL;
+}
+
+unsigned imaging::binary::morphology::BatchTransform::threads() const {
+  if (pool_ == NULL) return 1;
+  return pool_->threads();
+}
+
+bool imaging::binary::morphology::BatchTransform::RunImage(
+    const imaging::ImagePositionIndex image) {
+  double algorithm_end = 0.;
+  double algorithm_start = 0.;
+  unsigned engine = 0;
+  unsigned i = 0;
+  bool ok_so_far = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.empty()) return false;
+    engine = idle_.back();
+    idle_.pop_back();
+  }
+  std::vector<imaging::ImagePositionIndex> *counters =
+      &counters_.at(engine*COUNTERS);
+  for (i = 0; i < COUNTERS; ++i) counters[i].clear();
+  ok_so_far = engines_.at(engine)->Execute(*plan_, *images_->at(image),
+      outputs_->at(image), &counters[0], &counters[1], &counters[2],
+      &counters[3], &counters[4], &counters[5], &algorithm_start,
+      &algorithm_end);
+  std::lock_guard<std::mutex> lock(mutex_);
+  idle_.push_back(engine);
+  return ok_so_far;
+}
@@ -0,0 +1,94 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the batch transform, which runs one
+// SE family over many images at once.
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <mutex>
+#include <vector>
+
+#include "img.h"
+#include "pool.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+// Runs one SE family over a batch of images. The family is preprocessed
+// once for the whole batch and each image is a job of the work-stealing
+// pool, run by an idle engine. Engines, along with their temporary images,
+// candidate arrays and counters, are kept between batches, so images of the
+// same size reuse them.
+class BatchTransform {
+ public:
+  explicit BatchTransform(TransformFactory factory)
+      : factory_(factory), images_(NULL), outputs_(NULL), plan_(NULL),
+        pool_(NULL), seed_(0), stream_(0) {}
+  ~BatchTransform();
+  // Sets 'outputs', which must be empty, as the output of each image of
+  // 'images', as given by Transform::Calculate. The caller owns the outputs.
+  // 'images' must not hold the same image twice.
+  bool Calculate(const std::vector<imaging::binary::Image*> &images,
+      const std::vector<imaging::binary::StructuringElement*> &se,
+      std::vector<imaging::grayscale::Image*> *outputs,
+      double *start, double *end);
+  // Same as Transform::set_seed, for every engine, so each image gives the
+  // output of its own Calculate with the same seed and stream.
+  bool set_seed(const uint64_t seed, const uint64_t stream);
+  // Number of threads of the work-stealing pool running the images. Defaults
+  // to 1, which runs them on the calling thread.
+  bool set_threads(const unsigned threads);
+  unsigned threads() const;
+ private:
+  BatchTransform()
+      : factory_(NULL), images_(NULL), outputs_(NULL), plan_(NULL),
+        pool_(NULL), seed_(0), stream_(0) {}
+  bool RunImage(const imaging::ImagePositionIndex image);
+
+  // Counters of each engine, in the order taken by Transform::Execute.
+  std::vector< std::vector<imaging::ImagePositionIndex> > counters_;
+  std::vector<imaging::binary::morphology::Transform*> engines_;
+  TransformFactory factory_;
+  std::vector<unsigned> idle_; // engines not running an image
+  const std::vector<imaging::binary::Image*> *images_;
+  std::mutex mutex_; // guards idle_
+  std::vector<imaging::grayscale::Image*> *outputs_;
+  const TransformPlan *plan_;
+  imaging::WorkStealingPool* pool_;
+  uint64_t seed_;
+  uint64_t stream_;
+
+  DISALLOW_COPY_AND_ASSIGN(BatchTransform);
+}; // imaging:::binary::morphology::BatchTransform
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // BATCH_H_
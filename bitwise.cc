@@ -0,0 +1,298 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of bitwise erosion and
+// dilation transforms.
+
+#include <cstdio>
+
+#include "bitwise.h"
+#include "img-inl.h"
+
+// imaging::binary::morphology::BitwiseDilation
+
+imaging::binary::morphology::BitwiseDilation::~BitwiseDilation() {
+  BitwiseDilation::clear();
+  if (border_image_ != NULL) {
+    delete border_image_;
+    border_image_ = NULL;
+  }
+  if (region_mask_ != NULL) {
+    delete region_mask_;
+    region_mask_ = NULL;
+  }
+  if (step_ != NULL) {
+    delete step_;
+    step_ = NULL;
+  }
+}
+
+bool imaging::binary::morphology::BitwiseDilation::clear() {
+  candidates_ = 0;
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::BitwiseDilation::CustomInitialize() {
+  if (Y_ == NULL) return false;
+  bool ok_so_far = true;
+  ok_so_far = ReserveBuffer(Y_->size(), true, &border_image_);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ReserveBuffer(Y_->size(), true, &step_);
+  if (!ok_so_far) return ok_so_far;
+  if (!guard_band()) return ok_so_far;
+  // The guard band must never be reached by the dilation.
+  ok_so_far = ReserveBuffer(Y_->size(), true, &region_mask_);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = region_mask_->Fill(false);
+  if (!ok_so_far) return ok_so_far;
+  imaging::PositionIterator iterator(candidate_region_);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    ok_so_far = region_mask_->set_value(iterator.value(), true);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << candidates_ << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  imaging::Position offset;
+  bool ok_so_far = true;
+  // The external morphological gradient is calculated a row at a time: a
+  // background pixel p is at the border if some p-u is at the foreground.
+  *step_ = *Y_;
+  for (i = 0; ok_so_far && i < current_cardinality; ++i) {
+    const imaging::ImagePositionIndex current_element_index =
+        current_se_indexes.at(i);
+    const imaging::ImagePositionIndex element_index =
+        current_se_vector.at(current_element_index);
+    algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
+    ok_so_far = offset.CopyOppositeOf(u_elements_.at(element_index));
+    if (!ok_so_far) continue;
+    ok_so_far = step_->OrShifted(*Y_, offset);
+  }
+  if (!ok_so_far) return ok_so_far;
+  if (guard_band()) {
+    ok_so_far = step_->And(*region_mask_);
+    if (!ok_so_far) return ok_so_far;
+  }
+  *border_image_ = *step_;
+  ok_so_far = border_image_->AndNot(*Y_);
+  if (!ok_so_far) return ok_so_far;
+  border_counter_ = border_image_->Count();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::HasCandidates() const {
+  return candidates_ > 0;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::
+    InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool ok_so_far = true;
+  // Candidates are kept as the bits of Y_, so only the header is needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  // Every background pixel of the input image region is a candidate.
+  candidates_ = candidate_region_.capacity()-image.Count();
+  if (debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::BitwiseDilation::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  bool found = false;
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  ok_so_far = border_image_->NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    ok_so_far = (*output_image)->set_value(index, se_iteration_);
+    if (!ok_so_far) continue;
+    ok_so_far = border_image_->NextSetBit(index+1, &found, &index);
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  candidates_ -= border_counter_;
+  return Y_->Or(*border_image_);
+}
+
+// imaging::binary::morphology::BitwiseErosion
+
+imaging::binary::morphology::BitwiseErosion::~BitwiseErosion() {
+  BitwiseErosion::clear();
+  if (border_image_ != NULL) {
+    delete border_image_;
+    border_image_ = NULL;
+  }
+  if (step_ != NULL) {
+    delete step_;
+    step_ = NULL;
+  }
+}
+
+bool imaging::binary::morphology::BitwiseErosion::clear() {
+  candidates_ = 0;
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::BitwiseErosion::CustomInitialize() {
+  if (Y_ == NULL) return false;
+  bool ok_so_far = true;
+  ok_so_far = ReserveBuffer(Y_->size(), true, &border_image_);
+  if (!ok_so_far) return ok_so_far;
+  return ReserveBuffer(Y_->size(), true, &step_);
+}
+
+bool imaging::binary::morphology::BitwiseErosion::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << candidates_ << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  bool ok_so_far = true;
+  // The internal morphological gradient is calculated a row at a time: a
+  // foreground pixel p is kept if every p+u is at the foreground.
+  *step_ = *Y_;
+  for (i = 0; ok_so_far && i < current_cardinality; ++i) {
+    const imaging::ImagePositionIndex current_element_index =
+        current_se_indexes.at(i);
+    const imaging::ImagePositionIndex element_index =
+        current_se_vector.at(current_element_index);
+    algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
+    ok_so_far = step_->AndShifted(*Y_, u_elements_.at(element_index));
+  }
+  if (!ok_so_far) return ok_so_far;
+  *border_image_ = *Y_;
+  ok_so_far = border_image_->AndNot(*step_);
+  if (!ok_so_far) return ok_so_far;
+  border_counter_ = border_image_->Count();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::HasCandidates() const {
+  return candidates_ > 0;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool ok_so_far = true;
+  // Candidates are kept as the bits of Y_, so only the header is needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  // Every foreground pixel is a candidate.
+  candidates_ = image.Count();
+  if (debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::BitwiseErosion::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  bool found = false;
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  ok_so_far = border_image_->NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    ok_so_far = (*output_image)->set_value(index, se_iteration_);
+    if (!ok_so_far) continue;
+    ok_so_far = border_image_->NextSetBit(index+1, &found, &index);
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  candidates_ -= border_counter_;
+  return Y_->AndNot(*border_image_);
+}
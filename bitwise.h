@@ -0,0 +1,116 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of bitwise erosion and dilation
+// transforms, which process each SE step over whole words of Y_.
+
+#ifndef BITWISE_H_
+#define BITWISE_H_
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+class BitwiseDilation : public DilationTransform {
+ public:
+  BitwiseDilation(const bool debug, std::ostream &debug_output)
+      : DilationTransform(false, false, debug, debug_output),
+        border_image_(NULL), candidates_(0), region_mask_(NULL),
+        step_(NULL) {}
+  virtual ~BitwiseDilation();
+ protected:
+  virtual bool clear();
+  virtual bool CustomInitialize();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  BitwiseDilation()
+      : DilationTransform(false, false, false, std::cout), border_image_(NULL),
+        candidates_(0), region_mask_(NULL), step_(NULL) {}
+
+  imaging::binary::Image* border_image_;
+  imaging::ImagePositionIndex candidates_; // background pixels left
+  imaging::binary::Image* region_mask_; // candidate region, if guard band
+  imaging::binary::Image* step_;
+
+  DISALLOW_COPY_AND_ASSIGN(BitwiseDilation);
+}; // imaging:::binary::morphology::BitwiseDilation
+
+
+class BitwiseErosion : public ErosionTransform {
+ public:
+  BitwiseErosion(const bool debug, std::ostream &debug_output)
+      : ErosionTransform(false, false, debug, debug_output),
+        border_image_(NULL), candidates_(0), step_(NULL) {}
+  virtual ~BitwiseErosion();
+ protected:
+  virtual bool clear();
+  virtual bool CustomInitialize();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  BitwiseErosion()
+      : ErosionTransform(false, false, false, std::cout), border_image_(NULL),
+        candidates_(0), step_(NULL) {}
+
+  imaging::binary::Image* border_image_;
+  imaging::ImagePositionIndex candidates_; // foreground pixels left
+  imaging::binary::Image* step_;
+
+  DISALLOW_COPY_AND_ASSIGN(BitwiseErosion);
+}; // imaging:::binary::morphology::BitwiseErosion
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // BITWISE_H_
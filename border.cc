@@ -18,6 +18,7 @@
 // which uses image's border.
 
 #include "border.h"
+#include "img-inl.h"
 
 // imaging::binary::morphology::BorderDilation
 
@@ -34,11 +35,11 @@ bool imaging::binary::morphology::BorderDilation::DetectBorder(
   imaging::ImagePositionIndex next = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   current = candidate_next_.at(imaging::HEADER);
   while (ok_so_far && current != imaging::HEADER) {
     keep_pixel = true;
-    const imaging::Position &current_p = candidate_position_.at(current);
     next = candidate_next_.at(current);
     for (i = 0; ok_so_far && keep_pixel && i < current_cardinality; ++i) {
       // For this iteration, calculate border, which is
@@ -48,17 +49,17 @@ bool imaging::binary::morphology::BorderDilation::DetectBorder(
           current_se_indexes.at(i);
       const imaging::ImagePositionIndex element_index =
           current_se_vector.at(current_element_index);
-      const imaging::Position &delta = u_elements_.at(element_index);
       algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
-      ok_so_far = current_p.Subtract(delta, &target);
+      ok_so_far = NeighborIndex(current, element_index, false, &valid, &target);
       if (!ok_so_far) continue;
-      if (Y_->IsPositionValid(target)) {
+      if (valid) {
         ok_so_far = Y_->value(target, &position_value);
         if (!ok_so_far) continue;
         if (!position_value) continue;
       } else {
         continue;
       }
+      element_failures_.at(element_index) += 1;
       keep_pixel = false;
     }
     if (!keep_pixel) {
@@ -71,21 +72,20 @@ bool imaging::binary::morphology::BorderDilation::DetectBorder(
 }
 
 bool imaging::binary::morphology::BorderDilation::InitialCandidatePositionFound(
-    const imaging::binary::Image &image,
+    const imaging::binary::Image &/*image*/,
     const imaging::ImagePositionIndex &image_position,
-    const imaging::Position &value) {
+    const imaging::Position &/*value*/) {
   bool candidate_found = false;
-  std::vector<imaging::Position>::const_iterator delta;
-  imaging::Position neighbor;
+  imaging::SEIndex i = 0;
+  imaging::ImagePositionIndex neighbor = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  for (delta = u_elements_.begin();
-      ok_so_far && !candidate_found && delta != u_elements_.end();
-      ++delta) {
+  bool valid = false;
+  for (i = 0; ok_so_far && !candidate_found && i < u_cardinality(); ++i) {
     algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_) += 1;
-    ok_so_far = value.Subtract(*delta, &neighbor);
+    ok_so_far = NeighborIndex(image_position, i, false, &valid, &neighbor);
     if (!ok_so_far) continue;
-    if (image.IsPositionValid(neighbor)) {
+    if (valid) {
       ok_so_far = Y_->value(neighbor, &position_value);
       if (!ok_so_far) continue;
       if (!position_value) continue;
@@ -108,16 +108,16 @@ bool imaging::binary::morphology::BorderDilation::InsertNewCandidateFromBorder(
   int one_less_than_the_minimum_value = -1;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   for (i = 0; ok_so_far && i < border_counter_; ++i) {
-    const imaging::Position &p = candidate_position_.at(border_.at(i));
+    const imaging::ImagePositionIndex &p = border_.at(i);
     for (j = 0; ok_so_far && j < u_cardinality(); ++j) {
-      const imaging::Position &delta = u_elements_.at(j);
       algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_)
           += 1;
-      ok_so_far = p.Sum(delta, &target);
+      ok_so_far = NeighborIndex(p, j, true, &valid, &target);
       if (!ok_so_far) continue;
-      if (!Y_->IsPositionValid(target)) continue;
+      if (!valid) continue;
       position_value = true;
       ok_so_far = Y_->value(target, &position_value);
       if (!ok_so_far) continue;
@@ -126,7 +126,7 @@ bool imaging::binary::morphology::BorderDilation::InsertNewCandidateFromBorder(
       ok_so_far = (*output_image)->value(target, &marked_value);
       if (!ok_so_far) continue;
       if (marked_value > one_less_than_the_minimum_value) continue;
-      ok_so_far = position(target, &node);
+      ok_so_far = linear_position(target, &node);
       if (!ok_so_far) continue;
       ok_so_far = EnqueueCandidateNode(node);
       if (!ok_so_far) continue;
@@ -151,11 +151,11 @@ bool imaging::binary::morphology::BorderErosion::DetectBorder(
   imaging::ImagePositionIndex next = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   current = candidate_next_.at(imaging::HEADER);
   while (ok_so_far && current != imaging::HEADER) {
     keep_pixel = true;
-    const imaging::Position &current_p = candidate_position_.at(current);
     next = candidate_next_.at(current);
     for (i = 0; ok_so_far && keep_pixel && i < current_cardinality; ++i) {
       // For this iteration, calculate border, which is
@@ -165,15 +165,15 @@ bool imaging::binary::morphology::BorderErosion::DetectBorder(
           current_se_indexes.at(i);
       const imaging::ImagePositionIndex element_index =
           current_se_vector.at(current_element_index);
-      const imaging::Position &delta = u_elements_.at(element_index);
       algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
-      ok_so_far = current_p.Sum(delta, &target);
+      ok_so_far = NeighborIndex(current, element_index, true, &valid, &target);
       if (!ok_so_far) continue;
-      if (Y_->IsPositionValid(target)) {
+      if (valid) {
         ok_so_far = Y_->value(target, &position_value);
         if (!ok_so_far) continue;
         if (position_value) continue;
       }
+      element_failures_.at(element_index) += 1;
       keep_pixel = false;
     }
     if (!keep_pixel) {
@@ -186,21 +186,20 @@ bool imaging::binary::morphology::BorderErosion::DetectBorder(
 }
 
 bool imaging::binary::morphology::BorderErosion::InitialCandidatePositionFound(
-    const imaging::binary::Image &image,
+    const imaging::binary::Image &/*image*/,
     const imaging::ImagePositionIndex &image_position,
-    const imaging::Position &value) {
+    const imaging::Position &/*value*/) {
   bool candidate_found = false;
-  std::vector<imaging::Position>::const_iterator delta;
-  imaging::Position neighbor;
+  imaging::SEIndex i = 0;
+  imaging::ImagePositionIndex neighbor = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  for (delta = u_elements_.begin();
-      ok_so_far && !candidate_found && delta != u_elements_.end();
-      ++delta) {
+  bool valid = false;
+  for (i = 0; ok_so_far && !candidate_found && i < u_cardinality(); ++i) {
     algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_) += 1;
-    ok_so_far = value.Sum(*delta, &neighbor);
+    ok_so_far = NeighborIndex(image_position, i, true, &valid, &neighbor);
     if (!ok_so_far) continue;
-    if (image.IsPositionValid(neighbor)) {
+    if (valid) {
       ok_so_far = Y_->value(neighbor, &position_value);
       if (!ok_so_far) continue;
       if (position_value) continue;
@@ -221,16 +220,16 @@ bool imaging::binary::morphology::BorderErosion::InsertNewCandidateFromBorder(
   int one_less_than_the_minimum_value = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   for (i = 0; ok_so_far && i < border_counter_; ++i) {
-    const imaging::Position &p = candidate_position_.at(border_.at(i));
+    const imaging::ImagePositionIndex &p = border_.at(i);
     for (j = 0; ok_so_far && j < u_cardinality(); ++j) {
-      const imaging::Position &delta = u_elements_.at(j);
       algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_)
           += 1;
-      ok_so_far = p.Subtract(delta, &target);
+      ok_so_far = NeighborIndex(p, j, false, &valid, &target);
       if (!ok_so_far) continue;
-      if (!Y_->IsPositionValid(target)) continue;
+      if (!valid) continue;
       position_value = false;
       ok_so_far = Y_->value(target, &position_value);
       if (!ok_so_far) continue;
@@ -239,7 +238,7 @@ bool imaging::binary::morphology::BorderErosion::InsertNewCandidateFromBorder(
       ok_so_far = (*output_image)->value(target, &marked_value);
       if (!ok_so_far) continue;
       if (marked_value > one_less_than_the_minimum_value) continue;
-      ok_so_far = position(target, &node);
+      ok_so_far = linear_position(target, &node);
       if (!ok_so_far) continue;
       ok_so_far = EnqueueCandidateNode(node);
       if (!ok_so_far) continue;
@@ -0,0 +1,233 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the SE decomposition optimizer.
+
+#include "decompose.h"
+
+// imaging::binary::morphology::DecompositionOptimizer
+
+imaging::binary::morphology::DecompositionOptimizer::~DecompositionOptimizer() {
+  imaging::SEIndex i = 0;
+  ClearFamily();
+  for (i = 0; i < factors_.size(); ++i) delete factors_.at(i);
+  factors_.clear();
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::ClearFamily() {
+  imaging::SEIndex i = 0;
+  for (i = 0; i < family_.size(); ++i) delete family_.at(i);
+  family_.clear();
+  cost_ = 0;
+  return true;
+}
+
+imaging::ImagePositionIndex
+    imaging::binary::morphology::DecompositionOptimizer::cost() const {
+  return cost_;
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::Dilate(
+    const imaging::binary::StructuringElement &quotient,
+    const imaging::binary::StructuringElement &factor,
+    imaging::binary::StructuringElement *result) const {
+  if (result == NULL) return false;
+  imaging::PositionIterator iterator(factor.bounding_box());
+  imaging::Position offset;
+  bool ok_so_far = true;
+  bool position_value = false;
+  ok_so_far = result->CopyFrom(quotient);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    if (iterator.value().IsOrigin()) continue;
+    ok_so_far = factor.value(iterator.value(), &position_value);
+    if (!ok_so_far || !position_value) continue;
+    ok_so_far = offset.CopyOppositeOf(iterator.value());
+    if (!ok_so_far) continue;
+    ok_so_far = result->OrShifted(quotient, offset);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::Erode(
+    const imaging::binary::StructuringElement &residue,
+    const imaging::binary::StructuringElement &factor,
+    imaging::binary::StructuringElement *quotient) const {
+  if (quotient == NULL) return false;
+  imaging::PositionIterator iterator(factor.bounding_box());
+  bool ok_so_far = true;
+  bool position_value = false;
+  ok_so_far = quotient->CopyFrom(residue);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    if (iterator.value().IsOrigin()) continue;
+    ok_so_far = factor.value(iterator.value(), &position_value);
+    if (!ok_so_far || !position_value) continue;
+    ok_so_far = quotient->AndShifted(residue, iterator.value());
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::Factorize(
+    const imaging::binary::StructuringElement &residue,
+    const imaging::binary::StructuringElement &factor, bool *exact,
+    imaging::binary::StructuringElement *quotient) const {
+  if (exact == NULL || quotient == NULL) return false;
+  bool empty = true;
+  bool ok_so_far = true;
+  imaging::binary::StructuringElement common(factor);
+  imaging::binary::StructuringElement missing(residue);
+  imaging::binary::StructuringElement sum(residue);
+  *exact = false;
+  // As both hold the origin, the factor must fit in the residue.
+  ok_so_far = factor.Intersection(residue, &empty, &common);
+  if (!ok_so_far) return ok_so_far;
+  if (empty || common.Count() != factor.Count()) return true;
+  ok_so_far = Erode(residue, factor, quotient);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = Dilate(*quotient, factor, &sum);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = residue.SetMinus(sum, &missing);
+  if (!ok_so_far) return ok_so_far;
+  *exact = (missing.Count() == 0);
+  return ok_so_far;
+}
+
+const std::vector<imaging::binary::StructuringElement*>&
+    imaging::binary::morphology::DecompositionOptimizer::family() const {
+  return family_;
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::InitializeFactors() {
+  imaging::ImagePositionIndex axes = 0;
+  long coordinate = 0;
+  imaging::binary::StructuringElement *cross = NULL;
+  imaging::binary::StructuringElement *cube = NULL;
+  imaging::Position cube_lower;
+  imaging::Position cube_upper;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  const imaging::Position origin;
+  imaging::Position segment_lower;
+  imaging::Position segment_upper;
+  std::vector<imaging::binary::StructuringElement*> segments;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = cube_lower.set_value(i, -1);
+    if (!ok_so_far) continue;
+    ok_so_far = cube_upper.set_value(i, 1);
+  }
+  if (!ok_so_far) return ok_so_far;
+  const imaging::BoundingBox cube_bb(cube_lower, cube_upper);
+  const imaging::BoundingBox origin_bb(origin, origin);
+  cross = new imaging::binary::StructuringElement(origin_bb, true);
+  cube = new imaging::binary::StructuringElement(origin_bb, true);
+  factors_.push_back(cube);
+  factors_.push_back(cross);
+  ok_so_far = cross->set_value(origin, true);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = cube->set_value(origin, true);
+  if (!ok_so_far) return ok_so_far;
+  // Each segment from the origin to a neighbor, which the cross and the cube
+  // are the unions of.
+  imaging::PositionIterator iterator(cube_bb);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &neighbor = iterator.value();
+    if (neighbor.IsOrigin()) continue;
+    axes = 0;
+    for (i = 0; ok_so_far && i < n; ++i) {
+      coordinate = neighbor.coordinate(i);
+      if (coordinate != 0) ++axes;
+      ok_so_far = segment_lower.set_value(i, coordinate < 0 ? coordinate : 0);
+      if (!ok_so_far) continue;
+      ok_so_far = segment_upper.set_value(i, coordinate > 0 ? coordinate : 0);
+    }
+    if (!ok_so_far) continue;
+    imaging::binary::StructuringElement *segment =
+        new imaging::binary::StructuringElement(
+            imaging::BoundingBox(segment_lower, segment_upper), true);
+    factors_.push_back(segment);
+    ok_so_far = segment->set_value(origin, true);
+    if (!ok_so_far) continue;
+    ok_so_far = segment->set_value(neighbor, true);
+    if (!ok_so_far) continue;
+    ok_so_far = cube->Union(*segment, cube);
+    if (!ok_so_far || axes != 1) continue;
+    ok_so_far = cross->Union(*segment, cross);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::DecompositionOptimizer::Optimize(
+    const imaging::binary::StructuringElement &target) {
+  imaging::SEIndex best_factor = 0;
+  imaging::ImagePositionIndex best_cost = 0;
+  imaging::binary::StructuringElement best_quotient(target);
+  imaging::ImagePositionIndex candidate_cost = 0;
+  bool exact = false;
+  imaging::SEIndex i = 0;
+  bool improved = true;
+  bool ok_so_far = true;
+  const imaging::Position origin;
+  bool origin_value = false;
+  imaging::binary::StructuringElement quotient(target);
+  imaging::binary::StructuringElement residue(target);
+  ok_so_far = ClearFamily();
+  if (!ok_so_far) return ok_so_far;
+  if (factors_.empty()) {
+    ok_so_far = InitializeFactors();
+    if (!ok_so_far) return ok_so_far;
+  }
+  if (!target.IsPositionValid(origin)) return false;
+  ok_so_far = target.value(origin, &origin_value);
+  if (!ok_so_far) return ok_so_far;
+  if (!origin_value) return false;
+  while (ok_so_far && improved) {
+    improved = false;
+    best_cost = residue.Count();
+    for (i = 0; ok_so_far && i < factors_.size(); ++i) {
+      const imaging::binary::StructuringElement &factor = *(factors_.at(i));
+      ok_so_far = Factorize(residue, factor, &exact, &quotient);
+      if (!ok_so_far || !exact) continue;
+      candidate_cost = quotient.Count();
+      if (candidate_cost == 1) candidate_cost = 0;
+      candidate_cost += factor.Count();
+      if (candidate_cost >= best_cost) continue;
+      best_cost = candidate_cost;
+      best_factor = i;
+      improved = true;
+      ok_so_far = best_quotient.CopyFrom(quotient);
+    }
+    if (!ok_so_far || !improved) continue;
+    family_.push_back(
+        new imaging::binary::StructuringElement(*(factors_.at(best_factor))));
+    ok_so_far = residue.CopyFrom(best_quotient);
+  }
+  if (!ok_so_far) return ok_so_far;
+  if (residue.Count() > 1 || family_.empty())
+    family_.push_back(new imaging::binary::StructuringElement(residue));
+  for (i = 0; i < family_.size(); ++i) cost_ += family_.at(i)->Count();
+  return ok_so_far;
+}
@@ -0,0 +1,100 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the SE decomposition optimizer,
+// which rewrites a large SE as a cheaper family of small SEs.
+
+#ifndef DECOMPOSE_H_
+#define DECOMPOSE_H_
+
+#include <vector>
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+// Searches for a family of small SEs whose Minkowski sum is a target SE, so
+// each iteration of a transform given the family erodes or dilates by the
+// target while visiting the sum of their cardinalities instead of the
+// cardinality of the target. The target must contain the origin.
+//
+// The search is greedy: at each step, every factor of the 3x3...x3 cube
+// (each segment from the origin to a neighbor, the cross and the cube
+// itself) that fits in the residue R is tried, R eroded by the factor is
+// taken as the quotient and the factor is accepted if the quotient dilated
+// by it gives back R. The factor lowering the cost the most is kept and the
+// quotient becomes the new residue, until no factor lowers the cost. The
+// cost of a family is the sum of cardinalities; a residue holding the origin
+// only is dropped.
+//
+// The family is the same for erosions and dilations; erosions give the same
+// output as the target, while dilations may differ where the image clips an
+// intermediate step, as for any family of SEs.
+//
+//   DecompositionOptimizer optimizer;
+//   ok_so_far = optimizer.Optimize(*target);
+//   ok_so_far = transform->Calculate(image, optimizer.family(), ...);
+class DecompositionOptimizer {
+ public:
+  DecompositionOptimizer() : cost_(0) {}
+  ~DecompositionOptimizer();
+  // Sum of the cardinalities of the last family found.
+  imaging::ImagePositionIndex cost() const;
+  // Last family found, owned by the optimizer until the next Optimize.
+  const std::vector<imaging::binary::StructuringElement*>& family() const;
+  bool Optimize(const imaging::binary::StructuringElement &target);
+ private:
+  bool ClearFamily();
+  // Sets 'result' as 'quotient' dilated by 'factor', within the bounding
+  // box of 'quotient'.
+  bool Dilate(const imaging::binary::StructuringElement &quotient,
+      const imaging::binary::StructuringElement &factor,
+      imaging::binary::StructuringElement *result) const;
+  // Sets 'quotient' as 'residue' eroded by 'factor'.
+  bool Erode(const imaging::binary::StructuringElement &residue,
+      const imaging::binary::StructuringElement &factor,
+      imaging::binary::StructuringElement *quotient) const;
+  // Sets 'exact' if 'residue' is the Minkowski sum of 'quotient' and
+  // 'factor'.
+  bool Factorize(const imaging::binary::StructuringElement &residue,
+      const imaging::binary::StructuringElement &factor, bool *exact,
+      imaging::binary::StructuringElement *quotient) const;
+  bool InitializeFactors();
+
+  imaging::ImagePositionIndex cost_;
+  std::vector<imaging::binary::StructuringElement*> factors_;
+  std::vector<imaging::binary::StructuringElement*> family_;
+
+  DISALLOW_COPY_AND_ASSIGN(DecompositionOptimizer);
+}; // imaging:::binary::morphology::DecompositionOptimizer
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // DECOMPOSE_H_
@@ -0,0 +1,165 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the fused transform.
+
+#include <sys/time.h>
+
+#include "fuse.h"
+#include "img-inl.h"
+
+namespace {
+
+// Number of counters of each engine.
+const unsigned COUNTERS = 6;
+
+} // namespace
+
+// imaging::binary::morphology::FusedTransform
+
+imaging::binary::morphology::FusedTransform::~FusedTransform() {
+  if (dilation_ != NULL) {
+    delete dilation_;
+    dilation_ = NULL;
+  }
+  if (erosion_ != NULL) {
+    delete erosion_;
+    erosion_ = NULL;
+  }
+}
+
+bool imaging::binary::morphology::FusedTransform::Calculate(
+    const imaging::binary::Image &image,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    imaging::grayscale::Image **erosion_output,
+    imaging::grayscale::Image **dilation_output,
+    double *start,
+    double *end) {
+  if (erosion_output == NULL || dilation_output == NULL) return false;
+  if (*erosion_output != NULL || *dilation_output != NULL) return false;
+  if (start == NULL || end == NULL) return false;
+  if (erosion_factory_ == NULL || dilation_factory_ == NULL) return false;
+  imaging::grayscale::Image **algorithm_output = NULL;
+  std::shared_ptr<const imaging::binary::morphology::TransformPlan>
+      cached_plan;
+  double engine_start = 0.;
+  unsigned i = 0;
+  unsigned k = 0;
+  bool ok_so_far = true;
+  imaging::grayscale::Image *outputs[2] = { NULL, NULL };
+  struct timeval timer;
+  if (erosion_ == NULL) erosion_ = erosion_factory_();
+  if (dilation_ == NULL) dilation_ = dilation_factory_();
+  if (erosion_ == NULL || dilation_ == NULL) return false;
+  if (!erosion_->true_for_erosion_ || dilation_->true_for_erosion_)
+    return false;
+  imaging::binary::morphology::Transform *engines[2] = { erosion_, dilation_ };
+  counters_.resize(2*COUNTERS);
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  // Preprocess SEs once for both engines.
+  ok_so_far = imaging::binary::morphology::TransformPlanCache::Instance().Find(
+      se, &cached_plan);
+  if (!ok_so_far) return ok_so_far;
+  *erosion_output = new imaging::grayscale::Image(image.size(), -1);
+  *dilation_output = new imaging::grayscale::Image(image.size(), -1);
+  outputs[0] = *erosion_output;
+  outputs[1] = *dilation_output;
+  for (i = 0; ok_so_far && i < 2; ++i) {
+    std::vector< std::vector<imaging::ImagePositionIndex> >::iterator
+        counters = counters_.begin()+i*COUNTERS;
+    for (k = 0; k < COUNTERS; ++k) counters[k].clear();
+    ok_so_far = engines[i]->Prepare(*cached_plan, image, outputs[i],
+        &counters[0], &counters[1], &counters[2], &counters[3],
+        &counters[4], &counters[5], &engine_start);
+  }
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = PrepareCandidates();
+  if (!ok_so_far) return ok_so_far;
+  // Actual algorithms!
+  for (i = 0; ok_so_far && i < 2; ++i) {
+    algorithm_output = &(outputs[i]);
+    if (engines[i]->guard_band_)
+      algorithm_output = &(engines[i]->guard_band_output_);
+    ok_so_far = engines[i]->ActualAlgorithm(algorithm_output);
+    if (!ok_so_far) continue;
+    ok_so_far = engines[i]->Finish(outputs[i]);
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Finally!
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::FusedTransform::PrepareCandidates() {
+  imaging::binary::morphology::Transform &dilation = *dilation_;
+  imaging::binary::morphology::Transform &erosion = *erosion_;
+  unsigned i = 0;
+  bool ok_so_far = true;
+  bool position_value = true;
+  imaging::binary::morphology::Transform *engines[2] = { erosion_, dilation_ };
+  // Both Y_ hold the same image, padded alike when the regions match.
+  if (!erosion.ListsCandidates() || !dilation.ListsCandidates()
+      || !erosion.candidate_region_.Equals(dilation.candidate_region_)) {
+    ok_so_far = erosion.PrepareCandidates();
+    if (!ok_so_far) return ok_so_far;
+    return dilation.PrepareCandidates();
+  }
+  for (i = 0; ok_so_far && i < 2; ++i) {
+    ok_so_far = engines[i]->ReserveCandidates();
+    if (!ok_so_far) continue;
+    ok_so_far = engines[i]->InitializeCandidateHeader();
+  }
+  if (!ok_so_far) return ok_so_far;
+  imaging::PositionIterator iterator(erosion.candidate_region_);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    // Counted for each engine, as their separate scans would.
+    for (i = 0; i < 2; ++i) {
+      imaging::binary::morphology::Transform &engine = *engines[i];
+      engine.algorithm_insert_new_candidate_comparison_counter_->at(
+          engine.se_iteration_) += 1;
+      engine.algorithm_insert_new_candidate_memory_access_counter_->at(
+          engine.se_iteration_) += 5;
+    }
+    ok_so_far = erosion.Y_->value(current, &position_value);
+    if (!ok_so_far) continue;
+    if (position_value) {
+      ok_so_far = erosion.InsertInitialCandidate(*erosion.Y_, current);
+    } else {
+      ok_so_far = dilation.InsertInitialCandidate(*dilation.Y_, current);
+    }
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  for (i = 0; ok_so_far && i < 2; ++i) {
+    imaging::binary::morphology::Transform &engine = *engines[i];
+    if (engine.debug_) {
+      engine.debug_output_ << "\tAfter initialize candidate data:\n";
+      ok_so_far = engine.Debug();
+      engine.debug_output_ << "\n";
+    }
+    if (engine.use_candidate_matrix_) {
+      ok_so_far = engine.candidate_matrix_->BuildRank();
+      if (!ok_so_far) continue;
+    }
+    engine.border_.resize(engine.candidate_index_.size(), imaging::HEADER);
+  }
+  return ok_so_far;
+}
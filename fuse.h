@@ -0,0 +1,83 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the fused transform, which computes
+// the erosion and the dilation of an image together.
+
+#ifndef FUSE_H_
+#define FUSE_H_
+
+#include <vector>
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+// Computes both the erosion and the dilation of an image by the same family
+// of SEs, as needed by morphological gradients. The family is preprocessed
+// once for both engines and, when both list their candidates over the same
+// region, a single scan of the image fills both candidate lists: foreground
+// pixels go to the erosion and background pixels to the dilation.
+class FusedTransform {
+ public:
+  FusedTransform(TransformFactory erosion_factory,
+      TransformFactory dilation_factory)
+      : dilation_(NULL), dilation_factory_(dilation_factory), erosion_(NULL),
+        erosion_factory_(erosion_factory) {}
+  ~FusedTransform();
+  // Sets 'erosion_output' and 'dilation_output', which must be NULL, as
+  // given by Transform::Calculate for each engine, without per iteration
+  // counters. The caller owns the outputs.
+  bool Calculate(const imaging::binary::Image &image,
+      const std::vector<imaging::binary::StructuringElement*> &se,
+      imaging::grayscale::Image **erosion_output,
+      imaging::grayscale::Image **dilation_output,
+      double *start, double *end);
+ private:
+  FusedTransform()
+      : dilation_(NULL), dilation_factory_(NULL), erosion_(NULL),
+        erosion_factory_(NULL) {}
+  // Fills the candidate lists of both engines, prepared up to their scan.
+  bool PrepareCandidates();
+
+  // Counters of the erosion and then of the dilation engine, in the order
+  // taken by Transform::Execute.
+  std::vector< std::vector<imaging::ImagePositionIndex> > counters_;
+  imaging::binary::morphology::Transform* dilation_;
+  TransformFactory dilation_factory_;
+  imaging::binary::morphology::Transform* erosion_;
+  TransformFactory erosion_factory_;
+
+  DISALLOW_COPY_AND_ASSIGN(FusedTransform);
+}; // imaging:::binary::morphology::FusedTransform
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // FUSE_H_
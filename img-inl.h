@@ -0,0 +1,147 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of inline functions of basic imaging
+// classes, which are used by the inner loops of the transforms. Linear indexes
+// are the ones calculated by the respective LinearIndex methods and are not
+// checked but on debug builds.
+
+#ifndef IMG_INL_H_
+#define IMG_INL_H_
+
+#include <cassert>
+
+#include "img.h"
+
+// imaging::grayscale::_internal::NumericalMatrix
+
+template< class T >
+inline bool imaging::grayscale::_internal::NumericalMatrix<T>::set_value(
+    const imaging::ImagePositionIndex index, const T value) {
+  assert(index < array_.size());
+  array_[index] = value;
+  return true;
+}
+
+template< class T >
+inline bool imaging::grayscale::_internal::NumericalMatrix<T>::value(
+    const imaging::ImagePositionIndex index, T *value) const {
+  if (value == NULL) return false;
+  assert(index < array_.size());
+  *value = array_[index];
+  return true;
+}
+
+// imaging::grayscale::Image
+
+inline bool imaging::grayscale::Image::set_value(
+    const imaging::ImagePositionIndex index, const int value) {
+  return data_.set_value(index, value);
+}
+
+inline bool imaging::grayscale::Image::value(
+    const imaging::ImagePositionIndex index, int *value) const {
+  return data_.value(index, value);
+}
+
+// imaging::binary::_internal::BitMatrix
+
+inline bool imaging::binary::_internal::BitMatrix::set_value(
+    const imaging::ImagePositionIndex index, const bool value) {
+  const imaging::ImagePositionIndex &bits =
+      imaging::binary::_internal::BLOCK_BITS;
+  const imaging::ImagePositionIndex block_index = index/bits;
+  const imaging::binary::_internal::BLOCK bit_value =
+      static_cast<imaging::binary::_internal::BLOCK>(1)<<(index%bits);
+  assert(block_index < array_.size());
+  if (value) {
+    array_[block_index] |= bit_value;
+  } else {
+    array_[block_index] &= ~bit_value;
+  }
+  return true;
+}
+
+inline bool imaging::binary::_internal::BitMatrix::value(
+    const imaging::ImagePositionIndex index, bool *value) const {
+  if (value == NULL) return false;
+  const imaging::ImagePositionIndex &bits =
+      imaging::binary::_internal::BLOCK_BITS;
+  const imaging::ImagePositionIndex block_index = index/bits;
+  const imaging::binary::_internal::BLOCK bit_value =
+      static_cast<imaging::binary::_internal::BLOCK>(1)<<(index%bits);
+  assert(block_index < array_.size());
+  *value = (array_[block_index] & bit_value) == bit_value;
+  return true;
+}
+
+// imaging::binary::StructuringElement
+
+inline bool imaging::binary::StructuringElement::set_value(
+    const imaging::ImagePositionIndex index, const bool value) {
+  return data_.set_value(index, value);
+}
+
+inline bool imaging::binary::StructuringElement::value(
+    const imaging::ImagePositionIndex index, bool *value) const {
+  return data_.value(index, value);
+}
+
+// imaging::binary::morphology::Transform
+
+inline bool imaging::binary::morphology::Transform::NeighborIndex(
+    const imaging::ImagePositionIndex &image_position,
+    const imaging::ImagePositionIndex &element_index, const bool sum,
+    bool *valid, imaging::ImagePositionIndex *neighbor) const {
+  if (valid == NULL || neighbor == NULL) return false;
+  if (candidate_interior_[image_position]) {
+    // Every neighbor is inside the image: one add is enough.
+    const long offset = u_offsets_[element_index];
+    *neighbor = candidate_index_[image_position] + (sum ? offset : -offset);
+    *valid = true;
+    return true;
+  }
+  bool ok_so_far = true;
+  imaging::Position p;
+  imaging::Position target;
+  const imaging::Position &delta = u_elements_[element_index];
+  ok_so_far = position(image_position, &p);
+  if (!ok_so_far) return ok_so_far;
+  if (sum) {
+    ok_so_far = p.Sum(delta, &target);
+  } else {
+    ok_so_far = p.Subtract(delta, &target);
+  }
+  if (!ok_so_far) return ok_so_far;
+  *valid = Y_->IsPositionValid(target);
+  if (!*valid) return true;
+  return Y_->LinearIndex(target, neighbor);
+}
+
+template< class T, class V >
+inline bool imaging::binary::morphology::Transform::ReserveBuffer(
+    const imaging::Size &size, const V default_value, T **buffer) {
+  if (buffer == NULL) return false;
+  if (*buffer != NULL) {
+    if ((*buffer)->size().Equals(size)) return true;
+    delete *buffer;
+    *buffer = NULL;
+  }
+  *buffer = new T(size, default_value);
+  return (*buffer != NULL);
+}
+
+#endif // IMG_INL_H_
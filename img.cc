@@ -16,52 +16,274 @@
 
 // This file contains the implementation of basic imaging classes.
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 
 #include <sys/time.h>
 
 #include "img.h"
+#include "img-inl.h"
+#include "pool.h"
 #include "shuffle-inl.h"
 
 namespace {
 
-// Useful static data.
+// Sets 'result' as 'region' grown by 'factor' times 'reach', clipped to
+// 'bounds'.
+bool GrowRegion(const imaging::BoundingBox &region,
+    const imaging::Position &reach, const long factor,
+    const imaging::BoundingBox &bounds, imaging::BoundingBox *result) {
+  if (result == NULL) return false;
+  char i = 0;
+  imaging::Position lower;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::Position upper;
+  long value = 0;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    value = region.lower().coordinate(i)-factor*reach.coordinate(i);
+    if (value < bounds.lower().coordinate(i))
+      value = bounds.lower().coordinate(i);
+    ok_so_far = lower.set_value(i, value);
+    if (!ok_so_far) continue;
+    value = region.upper().coordinate(i)+factor*reach.coordinate(i);
+    if (value > bounds.upper().coordinate(i))
+      value = bounds.upper().coordinate(i);
+    ok_so_far = upper.set_value(i, value);
+  }
+  if (!ok_so_far) return ok_so_far;
+  *result = imaging::BoundingBox(lower, upper);
+  return ok_so_far;
+}
+
+// Sets 'levels' as the highest output value of the pixels whose dependence
+// cone, 'reach' times that value, reaches 'dirty'. Pixels left as at the
+// input by the transform are skipped, as well as unreached pixels within
+// 'dirty'; any other unreached pixel sets 'levels' as 'limit'.
+//
+// A pixel of value v whose cone reaches 'dirty' depends on it through a
+// chain of v steps of at most 'reach' each, and the pixel j steps away from
+// 'dirty' along it has a value of at least j, so its cone reaches 'dirty'
+// too. Only 'dirty' grown by 'reach' times levels+1 is then scanned, its
+// shells added as 'levels' grows, doubling their number to bound the scans.
+bool AffectedLevels(const imaging::grayscale::Image &output,
+    const imaging::BoundingBox &dirty, const imaging::Position &reach,
+    const bool true_for_erosion, const long limit, long *levels) {
+  if (levels == NULL) return false;
+  bool covered = false;
+  long distance = 0;
+  long factor = 0;
+  char i = 0;
+  bool inside = false;
+  const int kept_value = true_for_erosion ? -1 : 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::BoundingBox region;
+  imaging::BoundingBox scanned;
+  const int unreached_value = true_for_erosion ? 0 : -1;
+  int value = 0;
+  *levels = 0;
+  while (ok_so_far && !covered && factor <= *levels) {
+    factor = (2*factor > *levels+1) ? 2*factor : *levels+1;
+    ok_so_far = ::GrowRegion(dirty, reach, factor, output.size(), &region);
+    if (!ok_so_far) continue;
+    imaging::PositionIterator iterator(region);
+    ok_so_far = iterator.begin();
+    if (!ok_so_far) continue;
+    do {
+      const imaging::Position &current = iterator.value();
+      // Shells already scanned are skipped.
+      if (factor > 1 && scanned.IsValid(current)) continue;
+      ok_so_far = output.value(current, &value);
+      if (!ok_so_far) continue;
+      if (value == kept_value) continue;
+      if (value == unreached_value) {
+        if (dirty.IsValid(current)) continue;
+        *levels = limit;
+        return true;
+      }
+      if (value <= *levels) continue;
+      inside = true;
+      for (i = 0; inside && i < n; ++i) {
+        distance = dirty.lower().coordinate(i)-current.coordinate(i);
+        if (distance < current.coordinate(i)-dirty.upper().coordinate(i))
+          distance = current.coordinate(i)-dirty.upper().coordinate(i);
+        inside = (distance <= value*reach.coordinate(i));
+      }
+      if (inside) *levels = (value < limit) ? value : limit;
+    } while (ok_so_far && iterator.iterate());
+    if (!iterator.IsFinished()) ok_so_far = false;
+    covered = region.Equals(output.size());
+    scanned = region;
+  }
+  return ok_so_far;
+}
+
+long AlignedRowLength(const long length) {
+  const long alignment = imaging::ROW_ALIGNMENT;
+  return ((length+alignment-1)/alignment)*alignment;
+}
+
+bool CalculateReach(
+    const std::vector< std::vector<imaging::Position> > &vectorized_se,
+    imaging::Position *reach) {
+  if (reach == NULL) return false;
+  long coordinate_value = 0;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  std::vector< std::vector<imaging::Position> >::const_iterator current_se;
+  std::vector<imaging::Position>::const_iterator current;
+  ok_so_far = reach->SetAsOrigin();
+  for (current_se = vectorized_se.begin();
+      ok_so_far && current_se != vectorized_se.end(); ++current_se) {
+    for (current = current_se->begin();
+        ok_so_far && current != current_se->end(); ++current) {
+      for (i = 0; ok_so_far && i < n; ++i) {
+        coordinate_value = current->coordinate(i);
+        if (coordinate_value < 0) coordinate_value = -coordinate_value;
+        if (coordinate_value <= reach->coordinate(i)) continue;
+        ok_so_far = reach->set_value(i, coordinate_value);
+      }
+    }
+  }
+  return ok_so_far;
+}
 
-static imaging::ImagePositionIndex NBITS = 0;
-static struct timeval timer;
+// Sets 'reach' as the maximum absolute coordinate, by dimension, of the
+// Minkowski sum of the SEs of 'plan', which is the reach of one iteration.
+bool CalculateIterationReach(
+    const imaging::binary::morphology::TransformPlan &plan,
+    imaging::Position *reach) {
+  if (reach == NULL) return false;
+  long coordinate_value = 0;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::Position se_reach;
+  imaging::Position sum;
+  std::vector< std::vector<imaging::ImagePositionIndex> >::const_iterator
+      current_se;
+  std::vector<imaging::ImagePositionIndex>::const_iterator current;
+  ok_so_far = reach->SetAsOrigin();
+  for (current_se = plan.se_elements().begin();
+      ok_so_far && current_se != plan.se_elements().end(); ++current_se) {
+    ok_so_far = se_reach.SetAsOrigin();
+    for (current = current_se->begin();
+        ok_so_far && current != current_se->end(); ++current) {
+      const imaging::Position &element = plan.u_elements().at(*current);
+      for (i = 0; ok_so_far && i < n; ++i) {
+        coordinate_value = element.coordinate(i);
+        if (coordinate_value < 0) coordinate_value = -coordinate_value;
+        if (coordinate_value <= se_reach.coordinate(i)) continue;
+        ok_so_far = se_reach.set_value(i, coordinate_value);
+      }
+    }
+    if (!ok_so_far) continue;
+    ok_so_far = reach->Sum(se_reach, &sum);
+    if (!ok_so_far) continue;
+    ok_so_far = reach->CopyFrom(sum);
+  }
+  return ok_so_far;
+}
 
-imaging::ImagePositionIndex calculate_number_of_bits(
-    imaging::binary::_internal::BLOCK value) {
-  return value == 0 ? 0 : 1 + calculate_number_of_bits(value/2);
+// The output image must have the lengths of 'region'.
+bool CropImage(const imaging::grayscale::Image &image,
+    const imaging::BoundingBox &region, imaging::grayscale::Image *output) {
+  if (output == NULL) return false;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  int position_value = 0;
+  imaging::Position target;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    if (output->Length(i) != region.Length(i)) ok_so_far = false;
+  }
+  if (!ok_so_far) return ok_so_far;
+  imaging::PositionIterator iterator(output->size());
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    ok_so_far = current.Sum(region.lower(), &target);
+    if (!ok_so_far) continue;
+    ok_so_far = image.value(target, &position_value);
+    if (!ok_so_far) continue;
+    ok_so_far = output->set_value(current, position_value);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
 }
 
-imaging::ImagePositionIndex number_of_bits() {
-  if (NBITS != 0) return NBITS;
-  NBITS = calculate_number_of_bits(imaging::binary::_internal::BLOCK_MAX);
-  return NBITS;
+// The output image must have the lengths of 'region'.
+bool CropImage(const imaging::binary::Image &image,
+    const imaging::BoundingBox &region, imaging::binary::Image *output) {
+  if (output == NULL) return false;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  bool position_value = false;
+  imaging::Position target;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    if (output->Length(i) != region.Length(i)) ok_so_far = false;
+  }
+  if (!ok_so_far) return ok_so_far;
+  imaging::PositionIterator iterator(output->size());
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    ok_so_far = current.Sum(region.lower(), &target);
+    if (!ok_so_far) continue;
+    ok_so_far = image.value(target, &position_value);
+    if (!ok_so_far) continue;
+    ok_so_far = output->set_value(current, position_value);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
 }
 
+// Orders indexes by decreasing weight, then by increasing index.
+class GreaterWeight {
+ public:
+  explicit GreaterWeight(const std::vector<double> &weight)
+      : weight_(weight) {}
+  bool operator()(const size_t a, const size_t b) const {
+    if (weight_.at(a) != weight_.at(b)) return weight_.at(a) > weight_.at(b);
+    return a < b;
+  }
+ private:
+  const std::vector<double> &weight_;
+};
+
+// Pixels outside 'region' are set to 'outside_value' at the output image,
+// which must have the size of 'image'.
 bool InitializeAlgorithmsOutputImage(
     const imaging::binary::Image &image,
-    imaging::grayscale::Image **output) {
+    const imaging::BoundingBox &region,
+    const int outside_value,
+    imaging::grayscale::Image *output) {
   if (output == NULL) return false;
-  if (*output != NULL) return false;
+  if (!output->size().Equals(image.size())) return false;
   bool ok_so_far = true;
   bool position_value = false;
   // Initialize transitional output image.
-  *output = new imaging::grayscale::Image(image.size(), -1);
-  if (*output == NULL) ok_so_far = false;
+  ok_so_far = output->Fill(-1);
   if (!ok_so_far) return ok_so_far;
   imaging::PositionIterator iterator(image.size());
   ok_so_far = iterator.begin();
   if (!ok_so_far) return ok_so_far;
   do {
     const imaging::Position &current = iterator.value();
+    if (!region.IsValid(current)) {
+      ok_so_far = output->set_value(current, outside_value);
+      continue;
+    }
     ok_so_far = image.value(current, &position_value);
     if (!ok_so_far) continue;
     if (position_value) {
-      ok_so_far = (*output)->set_value(current, 0);
+      ok_so_far = output->set_value(current, 0);
       if (!ok_so_far) continue;
     }
   } while (ok_so_far && iterator.iterate());
@@ -69,6 +291,76 @@ bool InitializeAlgorithmsOutputImage(
   return ok_so_far;
 }
 
+// The output image must have the lengths of 'image' plus twice 'pad'.
+bool PadImage(const imaging::binary::Image &image,
+    const imaging::Position &pad, imaging::binary::Image *output) {
+  if (output == NULL) return false;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  bool position_value = false;
+  imaging::Position target;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    if (output->Length(i) != image.Length(i)+2*pad.coordinate(i)) {
+      ok_so_far = false;
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = output->Fill(false);
+  if (!ok_so_far) return ok_so_far;
+  imaging::PositionIterator iterator(image.size());
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    ok_so_far = image.value(current, &position_value);
+    if (!ok_so_far) continue;
+    if (!position_value) continue;
+    ok_so_far = current.Sum(pad, &target);
+    if (!ok_so_far) continue;
+    ok_so_far = output->set_value(target, true);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+// Number of set bits of 'block'. Without a population count instruction the
+// builtin becomes a library call, so bits are added in parallel instead.
+inline imaging::ImagePositionIndex PopulationCount(
+    imaging::binary::_internal::BLOCK block) {
+#ifdef __POPCNT__
+  return __builtin_popcountll(block);
+#else
+  const imaging::binary::_internal::BLOCK m1 = 0x5555555555555555ULL;
+  const imaging::binary::_internal::BLOCK m2 = 0x3333333333333333ULL;
+  const imaging::binary::_internal::BLOCK m4 = 0x0f0f0f0f0f0f0f0fULL;
+  const imaging::binary::_internal::BLOCK h01 = 0x0101010101010101ULL;
+  block -= (block >> 1) & m1;
+  block = (block & m2)+((block >> 2) & m2);
+  block = (block+(block >> 4)) & m4;
+  return static_cast<imaging::ImagePositionIndex>((block*h01) >> 56);
+#endif
+}
+
+// Blocks of each group of the rank counts of a RankBitMatrix, and bits of
+// each count packed within a group, which must hold up to 7 blocks of bits.
+const size_t RANK_GROUP_BLOCKS = 8;
+const int RANK_PACKED_BITS = 9;
+
+// Block 'index' of 'blocks' blocks shifted right by 'r' bits, along with the
+// first bits of the next block. Blocks outside of the array are zero.
+inline imaging::binary::_internal::BLOCK ShiftedBlock(
+    const imaging::binary::_internal::BLOCK *array, const long blocks,
+    const long index, const long r) {
+  const long bits = static_cast<long>(imaging::binary::_internal::BLOCK_BITS);
+  imaging::binary::_internal::BLOCK block = 0;
+  if (index >= 0 && index < blocks) block = array[index] >> r;
+  if (r != 0 && index+1 >= 0 && index+1 < blocks) {
+    block |= array[index+1] << (bits-r);
+  }
+  return block;
+}
+
 bool VectorizeSEs(
     const std::vector<imaging::binary::StructuringElement*> &se,
     std::vector< std::vector<imaging::Position> > *vectorized_se) {
@@ -110,6 +402,47 @@ bool VectorizeSEs(
   return ok_so_far;
 }
 
+// Folds the bytes of 'value' into the 64 bit FNV-1a 'hash'.
+void HashValue(const uint64_t value, uint64_t *hash) {
+  const uint64_t prime = 1099511628211ULL;
+  int i = 0;
+  for (i = 0; i < 64; i += 8) {
+    *hash ^= (value >> i) & 0xff;
+    *hash *= prime;
+  }
+}
+
+// Hashes the dimension, the bounding boxes and the set elements of 'se'.
+bool HashSEFamily(
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    uint64_t *key) {
+  if (key == NULL) return false;
+  bool found = false;
+  char i = 0;
+  imaging::ImagePositionIndex index = 0;
+  imaging::SEIndex i_se = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  *key = 14695981039346656037ULL;
+  ::HashValue(n, key);
+  ::HashValue(se.size(), key);
+  for (i_se = 0; ok_so_far && i_se < se.size(); ++i_se) {
+    const imaging::binary::StructuringElement* current_se = se.at(i_se);
+    if (current_se == NULL) return false;
+    const imaging::BoundingBox &bb = current_se->bounding_box();
+    for (i = 0; i < n; ++i) {
+      ::HashValue(bb.lower().coordinate(i), key);
+      ::HashValue(bb.upper().coordinate(i), key);
+    }
+    ok_so_far = current_se->NextSetBit(0, &found, &index);
+    while (ok_so_far && found) {
+      ::HashValue(index, key);
+      ok_so_far = current_se->NextSetBit(index+1, &found, &index);
+    }
+  }
+  return ok_so_far;
+}
+
 } // namespace
 
 // imaging::Dimension
@@ -122,7 +455,7 @@ char imaging::Dimension::number() {
 }
 
 char imaging::Dimension::Set(const char number) {
-  if (number < 1) return 0;
+  if (number < 1 || number > IMAGING_MAXIMUM_DIMENSION) return 0;
   imaging::Dimension::n_ = number;
   return number;
 }
@@ -140,7 +473,6 @@ imaging::Position::Position() {
 
 imaging::Position::Position(const imaging::Position &other) {
   assert(imaging::Dimension::number() > 0);
-  SetAsOrigin();
   CopyFrom(other);
 }
 
@@ -156,49 +488,47 @@ imaging::Position& imaging::Position::operator= (
 
 bool imaging::Position::CopyFrom(const imaging::Position &other) {
   if (this == &other) return true;
-  values_ = other.values_;
+  int i = 0;
+  for (i = 0; i < IMAGING_MAXIMUM_DIMENSION; ++i) values_[i] = other.values_[i];
   return true;
 }
 
 bool imaging::Position::CopyOppositeOf(const imaging::Position &other) {
   if (this == &other) return true;
-  long i = 0;
-  for (i = 0; i < imaging::Dimension::number(); ++i)
-    values_.at(i) = -1 * other.values_.at(i);
+  int i = 0;
+  const int n = imaging::Dimension::number();
+  for (i = 0; i < n; ++i) values_[i] = -1 * other.values_[i];
   return true;
 }
 
 bool imaging::Position::Equals(const imaging::Position &other) const {
   if (this == &other) return true;
-  long i = 0;
-  for (i = 0; i < imaging::Dimension::number(); ++i)
-    if (values_.at(i) != other.values_.at(i)) return false;
+  int i = 0;
+  const int n = imaging::Dimension::number();
+  for (i = 0; i < n; ++i)
+    if (values_[i] != other.values_[i]) return false;
   return true;
 }
 
 bool imaging::Position::IsOrigin() const{
-  long i = 0;
-  for (i = 0; i < imaging::Dimension::number(); ++i)
-    if (values_.at(i) != 0) return false;
+  int i = 0;
+  const int n = imaging::Dimension::number();
+  for (i = 0; i < n; ++i)
+    if (values_[i] != 0) return false;
   return true;
 }
 
 bool imaging::Position::SetAsOrigin() {
   int i = 0;
-  const int N = imaging::Dimension::number();
-  if (static_cast<int>(values_.size()) != N) {
-    values_.clear();
-    for (i = 0; i < N; ++i) values_.push_back(0);
-  }
-  for (i = 0; i < N; ++i) values_.at(i) = 0;
+  // Coordinates beyond the current dimension are kept at zero, so positions
+  // can be copied as a whole regardless of the dimension.
+  for (i = 0; i < IMAGING_MAXIMUM_DIMENSION; ++i) values_[i] = 0;
   return true;
 }
 
 bool imaging::Position::set_value(const char index, const long value) {
-  const int Index = index;
-  const int N = imaging::Dimension::number();
-  if (Index < 0 || Index >= N) return false;
-  values_.at(Index) = value;
+  if (index < 0 || index >= imaging::Dimension::number()) return false;
+  values_[static_cast<int>(index)] = value;
   return true;
 }
 
@@ -213,10 +543,8 @@ bool imaging::Position::Sum(const imaging::Position &other,
 }
 
 bool imaging::Position::value(char index, long *value) const {
-  const int Index = index;
-  const int N = imaging::Dimension::number();
-  if (Index < 0 || Index >= N) return false;
-  *value = values_.at(Index);
+  if (index < 0 || index >= imaging::Dimension::number()) return false;
+  *value = values_[static_cast<int>(index)];
   return true;
 }
 
@@ -224,10 +552,10 @@ bool imaging::Position::PlusFactor(const imaging::Position &other, int factor,
     imaging::Position *result) const {
   if (result == NULL) return false;
   if (this == &other) return result->SetAsOrigin();
-  long i = 0;
-  for (i = 0; i < imaging::Dimension::number(); ++i) {
-    (result->values_).at(i) = values_.at(i) + factor*(other.values_).at(i);
-  }
+  int i = 0;
+  const int n = imaging::Dimension::number();
+  for (i = 0; i < n; ++i)
+    result->values_[i] = values_[i] + factor*other.values_[i];
   return true;
 }
 
@@ -439,32 +767,21 @@ bool imaging::BoundingBox::Intersection(
 
 bool imaging::BoundingBox::IsValid(const imaging::Position &position) const {
   char i = 0;
-  long maximum = 0;
-  long minimum = 0;
-  const char n = imaging::Dimension::number();
-  bool ok_so_far = true;
   long value = 0;
+  const char n = imaging::Dimension::number();
   if (n < 1) return false;
-  for (i = 0; ok_so_far && i < n; ++i) {
-    ok_so_far = lower_.value(i, &minimum);
-    if (!ok_so_far) continue;
-    ok_so_far = upper_.value(i, &maximum);
-    if (!ok_so_far) continue;
-    ok_so_far = position.value(i, &value);
-    if (!ok_so_far) continue;
-    if (value < minimum || value > maximum) return false;
+  for (i = 0; i < n; ++i) {
+    value = position.coordinate(i);
+    if (value < lower_.coordinate(i) || value > upper_.coordinate(i))
+      return false;
   }
-  return ok_so_far;
+  return true;
 }
 
 long imaging::BoundingBox::Length(const char index) const {
-  long maximum = 0;
-  long minimum = 0;
-  bool ok_so_far = false;
-  ok_so_far = lower_.value(index, &minimum);
-  if (!ok_so_far) return -1;
-  ok_so_far = upper_.value(index, &maximum);
-  if (!ok_so_far) return -1;
+  if (index < 0 || index >= imaging::Dimension::number()) return -1;
+  const long maximum = upper_.coordinate(index);
+  const long minimum = lower_.coordinate(index);
   if (maximum < minimum) return -1;
   return maximum-minimum+1;
 }
@@ -515,7 +832,7 @@ bool imaging::BoundingBox::Union(const imaging::BoundingBox &other,
   long minimum = 0;
   long minimum_here = 0;
   long minimum_there = 0;
-  char n = 0;
+  const char n = imaging::Dimension::number();
   bool ok_so_far = true;
   Position union_lower;
   Position union_upper;
@@ -610,7 +927,7 @@ bool imaging::BoundingBox::set_padding(const long value) {
     if (!ok_so_far) continue;
     ok_so_far = lower_.value(i, &minimum);
     if (!ok_so_far) continue;
-    if (maximum-minimum <= 2*value) ok_so_far = false;
+    if (maximum-minimum < 2*value) ok_so_far = false;
   }
   if (!ok_so_far) return ok_so_far;
   modified_ = true;
@@ -744,6 +1061,7 @@ imaging::Size& imaging::Size::operator= (const imaging::Size &other) {
 
 bool imaging::Size::CopyFrom(const imaging::BoundingBox &other) {
   if (this == &other) return true;
+  if (Equals(other)) return true;
   char i = 0;
   imaging::Position lower_position;
   long maximum_there = 0;
@@ -908,30 +1226,20 @@ bool imaging::PositionIterator::iterate() {
   long coordinate_value = 0;
   char i = 0;
   const imaging::Position &lower = target_.lower();
-  long maximum = 0;
-  long minimum = 0;
-  bool next_calculated = false;
-  bool ok_so_far = true;
+  const char n = imaging::Dimension::number();
   const imaging::Position &upper = target_.upper();
-  // Calculate next position
-  if (current_.Equals(upper)) return false;
-  while (ok_so_far && !next_calculated) {
-    ok_so_far = current_.value(i, &(coordinate_value));
-    if (!ok_so_far) continue;
-    ok_so_far = upper.value(i, &maximum);
-    if (!ok_so_far) continue;
-    ++coordinate_value;
-    if (coordinate_value > maximum) {
-      ok_so_far = lower.value(i, &minimum);
-      if (!ok_so_far) continue;
-      ok_so_far = current_.set_value(i, minimum);
-      ++i;
-    } else {
-      ok_so_far = current_.set_value(i, coordinate_value);
-      next_calculated = true;
+  // Calculate next position: increment the first coordinate which has not
+  // reached its maximum, resetting the previous ones to their minimum.
+  for (i = 0; i < n; ++i) {
+    coordinate_value = current_.coordinate(i)+1;
+    if (coordinate_value <= upper.coordinate(i)) {
+      return current_.set_value(i, coordinate_value);
     }
+    current_.set_value(i, lower.coordinate(i));
   }
-  return ok_so_far;
+  // Already at the last position: restore it.
+  current_.CopyFrom(upper);
+  return false;
 }
 
 const imaging::Position& imaging::PositionIterator::value() const {
@@ -986,10 +1294,58 @@ long imaging::NDimensionalMatrixInterface::Length(const char index) const {
   return size_.Length(index);
 }
 
+bool imaging::NDimensionalMatrixInterface::LinearIndex(
+    const imaging::Position &position,
+    imaging::ImagePositionIndex *index) const {
+  if (index == NULL) return false;
+  imaging::ImagePositionIndex absolute_index = 0;
+  imaging::ImagePositionIndex accumulated_delta = 1;
+  long coordinate_value = 0;
+  char i = 0;
+  long length = 0;
+  const char n = imaging::Dimension::number();
+  const imaging::Position &lower = size_.lower();
+  const imaging::Position &upper = size_.upper();
+  if (n < 1) return false;
+  for (i = 0; i < n; ++i) {
+    coordinate_value = position.coordinate(i);
+    if (coordinate_value < lower.coordinate(i)
+        || coordinate_value > upper.coordinate(i)) return false;
+    length = upper.coordinate(i)-lower.coordinate(i)+1;
+    if (coordinate_value < 0 || coordinate_value >= length) return false;
+    absolute_index += coordinate_value*accumulated_delta;
+    if (i == 0) length = ::AlignedRowLength(length);
+    accumulated_delta = accumulated_delta*length;
+  }
+  *index = absolute_index;
+  return true;
+}
+
 const imaging::Size& imaging::NDimensionalMatrixInterface::size() const {
   return size_;
 }
 
+imaging::ImagePositionIndex
+    imaging::NDimensionalMatrixInterface::storage_capacity() const {
+  const char n = imaging::Dimension::number();
+  if (n < 1) return 0;
+  return Stride(n-1)*size_.Length(n-1);
+}
+
+long imaging::NDimensionalMatrixInterface::Stride(const char index) const {
+  char i = 0;
+  long stride = 1;
+  if (index < 0 || index >= imaging::Dimension::number()) return 0;
+  for (i = 0; i < index; ++i) {
+    if (i == 0) {
+      stride = ::AlignedRowLength(size_.Length(i));
+    } else {
+      stride = stride*size_.Length(i);
+    }
+  }
+  return stride;
+}
+
 imaging::NDimensionalMatrixInterface::NDimensionalMatrixInterface() {
   ; // empty
 }
@@ -1000,33 +1356,11 @@ bool imaging::NDimensionalMatrixInterface::CalculateIndexes(
     imaging::ImagePositionIndex *bit_index) const {
   if (block_index == NULL) return false;
   if (bit_matrix_ && bit_index == NULL) return false;
-  if (!size_.IsValid(position)) return false;
   imaging::ImagePositionIndex absolute_index = 0;
-  imaging::ImagePositionIndex accumulated_delta = 1;
-  long coordinate_value = 0;
-  char i = 0;
-  long length = 0;
-  const char n = imaging::Dimension::number();
-  bool ok_so_far = true;
-  if (n < 1) return false;
-  for (i = 0; ok_so_far && i < n; ++i) {
-    ok_so_far = position.value(i, &coordinate_value);
-    if (coordinate_value < 0) ok_so_far = false;
-    if (!ok_so_far) continue;
-    length = size_.Length(i);
-    if (length < 1) ok_so_far = false;
-    if (coordinate_value >= length) ok_so_far = false;
-    if (!ok_so_far) continue;
-    if (i == 0) {
-      absolute_index = coordinate_value;
-    } else {
-      absolute_index += coordinate_value*accumulated_delta;
-    }
-    accumulated_delta = accumulated_delta*length;
-  }
+  if (!LinearIndex(position, &absolute_index)) return false;
   if (bit_matrix_) {
-    *block_index = absolute_index/(::number_of_bits());
-    *bit_index = absolute_index%(::number_of_bits());
+    *block_index = absolute_index/imaging::binary::_internal::BLOCK_BITS;
+    *bit_index = absolute_index%imaging::binary::_internal::BLOCK_BITS;
   } else {
     *block_index = absolute_index;
   }
@@ -1040,7 +1374,7 @@ imaging::grayscale::_internal::NumericalMatrix<T>::NumericalMatrix(
     const imaging::Size &size,
     const T default_value)
     : imaging::NDimensionalMatrixInterface(size, false) {
-  array_.resize(size.capacity(), default_value);
+  array_.resize(storage_capacity(), default_value);
 }
 
 template< class T >
@@ -1086,7 +1420,22 @@ bool imaging::grayscale::_internal::NumericalMatrix<T>::Equals(
     const imaging::grayscale::_internal::NumericalMatrix<T> &other) const {
   if (this == &other) return true;
   if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
-  return (array_ == other.array_);
+  // Compare row by row, skipping the elements which align the rows.
+  if (imaging::Dimension::number() < 2) return (array_ == other.array_);
+  const long length = Length(0);
+  typename std::vector<T>::const_iterator other_row = other.array_.begin();
+  typename std::vector<T>::const_iterator row = array_.begin();
+  const long stride = Stride(1);
+  for (; row != array_.end(); row += stride, other_row += stride) {
+    if (!std::equal(row, row+length, other_row)) return false;
+  }
+  return true;
+}
+
+template< class T >
+bool imaging::grayscale::_internal::NumericalMatrix<T>::Fill(const T value) {
+  std::fill(array_.begin(), array_.end(), value);
+  return true;
 }
 
 template< class T >
@@ -1153,6 +1502,10 @@ bool imaging::grayscale::Image::Equals(const imaging::grayscale::Image &other)
   return data_.Equals(other.data_);
 }
 
+bool imaging::grayscale::Image::Fill(const int value) {
+  return data_.Fill(value);
+}
+
 bool imaging::grayscale::Image::Maximum(
     const Image &other,
     bool *empty,
@@ -1230,6 +1583,12 @@ long imaging::grayscale::Image::Length(const char index) const {
   return data_.size().Length(index);
 }
 
+bool imaging::grayscale::Image::LinearIndex(
+    const imaging::Position &position,
+    imaging::ImagePositionIndex *index) const {
+  return data_.LinearIndex(position, index);
+}
+
 bool imaging::grayscale::Image::Print(std::ostream &out) const {
   bool after_last = false;
   std::vector<long> c;
@@ -1308,6 +1667,10 @@ const imaging::Size& imaging::grayscale::Image::size() const {
   return data_.size();
 }
 
+long imaging::grayscale::Image::Stride(const char index) const {
+  return data_.Stride(index);
+}
+
 bool imaging::grayscale::Image::UnpaddedImage(
     imaging::grayscale::Image *result) const {
   if (result == NULL) return false;
@@ -1361,14 +1724,16 @@ imaging::grayscale::Image::Image() : data_(imaging::Size(), -1) {
 imaging::binary::_internal::BitMatrix::BitMatrix(
     const imaging::Size &size,
     const bool empty)
-    : imaging::NDimensionalMatrixInterface(size, true), blocks_(0) {
+    : imaging::NDimensionalMatrixInterface(size, true), blocks_(0),
+      last_block_mask_(0), words_per_row_(0) {
   SetSize(size, empty);
 }
 
 imaging::binary::_internal::BitMatrix::BitMatrix(
     const imaging::binary::_internal::BitMatrix &other)
     : imaging::NDimensionalMatrixInterface(other), array_(other.array_),
-      blocks_(other.blocks_) {
+      blocks_(other.blocks_), last_block_mask_(other.last_block_mask_),
+      words_per_row_(other.words_per_row_) {
   ; // empty
 }
 
@@ -1384,10 +1749,36 @@ imaging::binary::_internal::BitMatrix&
     array_.clear();
     array_ = other.array_;
     blocks_ = other.blocks_;
+    last_block_mask_ = other.last_block_mask_;
+    words_per_row_ = other.words_per_row_;
   }
   return *this;
 }
 
+bool imaging::binary::_internal::BitMatrix::And(
+    const imaging::binary::_internal::BitMatrix &other) {
+  if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
+  if (blocks_ != other.blocks_) return false;
+  long i = 0;
+  for (i = 0; i < blocks_; ++i) array_[i] &= other.array_[i];
+  return true;
+}
+
+bool imaging::binary::_internal::BitMatrix::AndNot(
+    const imaging::binary::_internal::BitMatrix &other) {
+  if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
+  if (blocks_ != other.blocks_) return false;
+  long i = 0;
+  for (i = 0; i < blocks_; ++i) array_[i] &= ~(other.array_[i]);
+  return true;
+}
+
+bool imaging::binary::_internal::BitMatrix::AndShifted(
+    const imaging::binary::_internal::BitMatrix &source,
+    const imaging::Position &offset) {
+  return ShiftedOperation(source, offset, true);
+}
+
 bool imaging::binary::_internal::BitMatrix::CopyFrom(
     const imaging::binary::_internal::BitMatrix &other) {
   if (this == &other) return true;
@@ -1395,27 +1786,79 @@ bool imaging::binary::_internal::BitMatrix::CopyFrom(
   array_.clear();
   array_ = other.array_;
   blocks_ = other.blocks_;
+  last_block_mask_ = other.last_block_mask_;
+  words_per_row_ = other.words_per_row_;
   return true;
 }
 
+imaging::ImagePositionIndex imaging::binary::_internal::BitMatrix::Count()
+    const {
+  imaging::ImagePositionIndex count = 0;
+  long i = 0;
+  for (i = 0; i < blocks_; ++i) count += ::PopulationCount(array_[i]);
+  return count;
+}
+
 bool imaging::binary::_internal::BitMatrix::Equals(
     const imaging::binary::_internal::BitMatrix &other) const {
   if (this == &other) return true;
   if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
-  long i = 0;
   if (blocks_ != other.blocks_) return false;
-  for (i = 0; i < blocks_; ++i) {
-    if (array_.at(i) != (other.array_).at(i)) return false;
+  // Alignment bits are always zero.
+  return (array_ == other.array_);
+}
+
+bool imaging::binary::_internal::BitMatrix::Fill(const bool value) {
+  imaging::binary::_internal::BLOCK block_value = 0;
+  if (value) block_value = ~(block_value);
+  std::fill(array_.begin(), array_.end(), block_value);
+  return ClearAlignmentBits();
+}
+
+bool imaging::binary::_internal::BitMatrix::InvertValues() {
+  long i = 0;
+  for (i = 0; i < blocks_; ++i) array_[i] = ~(array_[i]);
+  return ClearAlignmentBits();
+}
+
+bool imaging::binary::_internal::BitMatrix::NextSetBit(
+    const imaging::ImagePositionIndex from, bool *found,
+    imaging::ImagePositionIndex *index) const {
+  if (found == NULL || index == NULL) return false;
+  const imaging::ImagePositionIndex &bits =
+      imaging::binary::_internal::BLOCK_BITS;
+  imaging::binary::_internal::BLOCK block = 0;
+  long block_index = from/bits;
+  *found = false;
+  if (block_index >= blocks_) return true;
+  // Ignore the bits before 'from' at its block.
+  block = array_[block_index] & (imaging::binary::_internal::BLOCK_MAX <<
+      (from%bits));
+  while (block == 0) {
+    ++block_index;
+    if (block_index >= blocks_) return true;
+    block = array_[block_index];
   }
+  *index = block_index*bits+__builtin_ctzll(block);
+  *found = true;
   return true;
 }
 
-bool imaging::binary::_internal::BitMatrix::InvertValues() {
+bool imaging::binary::_internal::BitMatrix::Or(
+    const imaging::binary::_internal::BitMatrix &other) {
+  if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
+  if (blocks_ != other.blocks_) return false;
   long i = 0;
-  for (i = 0; i < blocks_; ++i) array_.at(i) = ~(array_.at(i));
+  for (i = 0; i < blocks_; ++i) array_[i] |= other.array_[i];
   return true;
 }
 
+bool imaging::binary::_internal::BitMatrix::OrShifted(
+    const imaging::binary::_internal::BitMatrix &source,
+    const imaging::Position &offset) {
+  return ShiftedOperation(source, offset, false);
+}
+
 bool imaging::binary::_internal::BitMatrix::set_value(
     const imaging::Position &position, const bool value) {
   imaging::ImagePositionIndex bit_index = 0;
@@ -1426,7 +1869,7 @@ bool imaging::binary::_internal::BitMatrix::set_value(
   ok_so_far = CalculateIndexes(position, &block_index, &bit_index);
   if (!ok_so_far) return ok_so_far;
   block = array_.at(block_index);
-  bit_value = 1<<(bit_index);
+  bit_value = static_cast<imaging::binary::_internal::BLOCK>(1)<<(bit_index);
   if (value) {
     block |= bit_value;
   } else {
@@ -1447,28 +1890,203 @@ bool imaging::binary::_internal::BitMatrix::value(
   ok_so_far = CalculateIndexes(position, &block_index, &bit_index);
   if (!ok_so_far) return ok_so_far;
   block = array_.at(block_index);
-  bit_value = 1<<(bit_index);
+  bit_value = static_cast<imaging::binary::_internal::BLOCK>(1)<<(bit_index);
   *value = (block & bit_value) == bit_value;
   return ok_so_far;
 }
 
+long imaging::binary::_internal::BitMatrix::words_per_row() const {
+  return words_per_row_;
+}
+
+bool imaging::binary::_internal::BitMatrix::Xor(
+    const imaging::binary::_internal::BitMatrix &other) {
+  if (!imaging::NDimensionalMatrixInterface::Equals(other)) return false;
+  if (blocks_ != other.blocks_) return false;
+  long i = 0;
+  for (i = 0; i < blocks_; ++i) array_[i] ^= other.array_[i];
+  return true;
+}
+
 imaging::binary::_internal::BitMatrix::BitMatrix() {
   blocks_ = 0;
+  last_block_mask_ = 0;
+  words_per_row_ = 0;
+}
+
+bool imaging::binary::_internal::BitMatrix::ClearAlignmentBits() {
+  long i = 0;
+  if (words_per_row_ < 1) return true;
+  for (i = words_per_row_-1; i < blocks_; i += words_per_row_) {
+    array_[i] &= last_block_mask_;
+  }
+  return true;
 }
 
 bool imaging::binary::_internal::BitMatrix::SetSize(
     const imaging::Size &size,
     const bool empty) {
   imaging::binary::_internal::BLOCK block_value = 0;
-  long blocks = 0;
-  long i = 0;
-  const long items = size.capacity();
-  blocks = items/(::number_of_bits());
-  if (items%(::number_of_bits()) != 0) blocks++;
+  const imaging::ImagePositionIndex &bits =
+      imaging::binary::_internal::BLOCK_BITS;
+  const long length = size.Length(0);
+  if (length < 1) return false;
+  blocks_ = storage_capacity()/bits;
+  words_per_row_ = ::AlignedRowLength(length)/bits;
+  last_block_mask_ = imaging::binary::_internal::BLOCK_MAX;
+  if (length%bits != 0) {
+    last_block_mask_ =
+        (static_cast<imaging::binary::_internal::BLOCK>(1)<<(length%bits))-1;
+  }
   if (!empty) block_value = ~(block_value);
   array_.clear();
-  for (i = 0; i < blocks; ++i) array_.push_back(block_value);
-  blocks_ = blocks;
+  array_.resize(blocks_, block_value);
+  return ClearAlignmentBits();
+}
+
+bool imaging::binary::_internal::BitMatrix::ShiftedOperation(
+    const imaging::binary::_internal::BitMatrix &source,
+    const imaging::Position &offset, const bool conjunction) {
+  if (this == &source) return false;
+  if (!imaging::NDimensionalMatrixInterface::Equals(source)) return false;
+  if (blocks_ != source.blocks_ || words_per_row_ < 1) return false;
+  const long bits = static_cast<long>(imaging::binary::_internal::BLOCK_BITS);
+  imaging::binary::_internal::BLOCK block = 0;
+  std::vector<imaging::binary::_internal::BLOCK> column_mask(words_per_row_,
+      0);
+  long coordinate_value = 0;
+  long coordinates[IMAGING_MAXIMUM_DIMENSION] = {0};
+  const long dx = offset.coordinate(0);
+  long first = 0;
+  char i = 0;
+  long k = 0;
+  long last = 0;
+  const long length = Length(0);
+  long lengths[IMAGING_MAXIMUM_DIMENSION] = {0};
+  const char n = imaging::Dimension::number();
+  const imaging::binary::_internal::BLOCK *origin = &(source.array_[0]);
+  // Offset by whole blocks and remaining bits, rounded towards -infinity.
+  const long q = (dx >= 0) ? dx/bits : -((bits-1-dx)/bits);
+  const long r = dx-q*bits;
+  long row = 0;
+  long row_offset = 0;
+  long row_stride = 1;
+  const long rows = blocks_/words_per_row_;
+  long start = 0;
+  bool valid = true;
+  const long &w = words_per_row_;
+  // Columns x whose source column x+dx lies in the row. Source blocks read
+  // out of the row belong to its neighbors and are dropped by this mask.
+  first = std::max(0L, -dx);
+  last = std::min(length, length-dx);
+  for (k = first; k < last; ++k) {
+    column_mask[k/bits] |= static_cast<imaging::binary::_internal::BLOCK>(1)
+        << (k%bits);
+  }
+  for (i = 1; i < n; ++i) {
+    lengths[static_cast<int>(i)] = Length(i);
+    row_offset += offset.coordinate(i)*row_stride;
+    row_stride *= lengths[static_cast<int>(i)];
+  }
+  for (row = 0; row < rows; ++row) {
+    imaging::binary::_internal::BLOCK *target = &(array_[row*w]);
+    valid = true;
+    for (i = 1; valid && i < n; ++i) {
+      coordinate_value =
+          coordinates[static_cast<int>(i)]+offset.coordinate(i);
+      if (coordinate_value < 0
+          || coordinate_value >= lengths[static_cast<int>(i)]) valid = false;
+    }
+    start = (row+row_offset)*w+q;
+    if (!valid) {
+      if (conjunction) {
+        for (k = 0; k < w; ++k) target[k] = 0;
+      }
+    } else if (start >= 0 && start+w < blocks_) {
+      // Every source block is inside the matrix: no bound checks. The
+      // second shift in two steps is defined for 'r' equal to zero.
+      const imaging::binary::_internal::BLOCK *source_row = origin+start;
+      if (conjunction) {
+        for (k = 0; k < w; ++k) {
+          target[k] &= ((source_row[k] >> r)
+              | ((source_row[k+1] << (bits-1-r)) << 1)) & column_mask[k];
+        }
+      } else {
+        for (k = 0; k < w; ++k) {
+          target[k] |= ((source_row[k] >> r)
+              | ((source_row[k+1] << (bits-1-r)) << 1)) & column_mask[k];
+        }
+      }
+    } else {
+      for (k = 0; k < w; ++k) {
+        block = ::ShiftedBlock(origin, blocks_, start+k, r) & column_mask[k];
+        if (conjunction) {
+          target[k] &= block;
+        } else {
+          target[k] |= block;
+        }
+      }
+    }
+    // Next row, as an odometer over the remaining dimensions.
+    for (i = 1; i < n; ++i) {
+      if (++(coordinates[static_cast<int>(i)]) < lengths[static_cast<int>(i)])
+        break;
+      coordinates[static_cast<int>(i)] = 0;
+    }
+  }
+  return true;
+}
+
+// imaging::binary::_internal::RankBitMatrix
+
+bool imaging::binary::_internal::RankBitMatrix::BuildRank() {
+  const std::vector<imaging::binary::_internal::BLOCK> &blocks = array();
+  imaging::binary::_internal::BLOCK count = 0;
+  const size_t &group = ::RANK_GROUP_BLOCKS;
+  size_t i = 0;
+  size_t j = 0;
+  imaging::binary::_internal::BLOCK packed = 0;
+  imaging::binary::_internal::BLOCK within = 0;
+  counts_.assign(2*((blocks.size()+group-1)/group), 0);
+  for (i = 0; i < blocks.size(); i += group) {
+    packed = 0;
+    within = 0;
+    for (j = 0; j < group && i+j < blocks.size(); ++j) {
+      if (j > 0) packed |= within << (::RANK_PACKED_BITS*(j-1));
+      within += ::PopulationCount(blocks[i+j]);
+    }
+    counts_[2*(i/group)] = count;
+    counts_[2*(i/group)+1] = packed;
+    count += within;
+  }
+  return true;
+}
+
+bool imaging::binary::_internal::RankBitMatrix::Rank(
+    const imaging::ImagePositionIndex index,
+    imaging::ImagePositionIndex *rank) const {
+  if (rank == NULL) return false;
+  const imaging::ImagePositionIndex &bits =
+      imaging::binary::_internal::BLOCK_BITS;
+  const size_t block_index = index/bits;
+  const std::vector<imaging::binary::_internal::BLOCK> &blocks = array();
+  imaging::binary::_internal::BLOCK count = 0;
+  const size_t &group_blocks = ::RANK_GROUP_BLOCKS;
+  const size_t group = block_index/group_blocks;
+  const size_t j = block_index%group_blocks;
+  const imaging::binary::_internal::BLOCK packed_mask =
+      (static_cast<imaging::binary::_internal::BLOCK>(1)
+      << ::RANK_PACKED_BITS)-1;
+  if (block_index >= blocks.size() || 2*group+1 >= counts_.size())
+    return false;
+  count = counts_[2*group];
+  if (j > 0) {
+    count += (counts_[2*group+1] >> (::RANK_PACKED_BITS*(j-1))) & packed_mask;
+  }
+  count += ::PopulationCount(blocks[block_index]
+      & ((static_cast<imaging::binary::_internal::BLOCK>(1) << (index%bits))
+      -1));
+  *rank = static_cast<imaging::ImagePositionIndex>(count);
   return true;
 }
 
@@ -1496,6 +2114,25 @@ imaging::binary::StructuringElement&
   return *this;
 }
 
+bool imaging::binary::StructuringElement::And(
+    const imaging::binary::StructuringElement &other) {
+  if (!bounding_box_.Equals(other.bounding_box_)) return false;
+  return data_.And(other.data_);
+}
+
+bool imaging::binary::StructuringElement::AndNot(
+    const imaging::binary::StructuringElement &other) {
+  if (!bounding_box_.Equals(other.bounding_box_)) return false;
+  return data_.AndNot(other.data_);
+}
+
+bool imaging::binary::StructuringElement::AndShifted(
+    const imaging::binary::StructuringElement &source,
+    const imaging::Position &offset) {
+  if (!bounding_box_.Equals(source.bounding_box_)) return false;
+  return data_.AndShifted(source.data_, offset);
+}
+
 const imaging::BoundingBox& imaging::binary::StructuringElement::bounding_box()
     const {
   return bounding_box_;
@@ -1511,6 +2148,11 @@ bool imaging::binary::StructuringElement::CopyFrom(
   return ok_so_far;
 }
 
+imaging::ImagePositionIndex imaging::binary::StructuringElement::Count()
+    const {
+  return data_.Count();
+}
+
 bool imaging::binary::StructuringElement::DelimitedComplement(
     imaging::binary::StructuringElement *result) const {
   if (result == NULL) return false;
@@ -1529,6 +2171,10 @@ bool imaging::binary::StructuringElement::Equals(
   return data_.Equals(other.data_);
 }
 
+bool imaging::binary::StructuringElement::Fill(const bool value) {
+  return data_.Fill(value);
+}
+
 bool imaging::binary::StructuringElement::Intersection(
     const StructuringElement &other,
     bool *empty,
@@ -1537,6 +2183,14 @@ bool imaging::binary::StructuringElement::Intersection(
   imaging::BoundingBox intersection_bb;
   bool ok_so_far = true;
   bool position_value = true;
+  if (bounding_box_.Equals(other.bounding_box_)) {
+    // Same layout: intersect word by word.
+    imaging::binary::StructuringElement output(*this);
+    ok_so_far = output.And(other);
+    if (!ok_so_far) return ok_so_far;
+    *empty = false;
+    return result->CopyFrom(output);
+  }
   ok_so_far = bounding_box_.Intersection(other.bounding_box_, empty,
                                          &intersection_bb);
   if (!ok_so_far) return ok_so_far;
@@ -1573,6 +2227,35 @@ long imaging::binary::StructuringElement::Length(const char index) const {
   return bounding_box_.Length(index);
 }
 
+bool imaging::binary::StructuringElement::LinearIndex(
+    const imaging::Position &position,
+    imaging::ImagePositionIndex *index) const {
+  bool ok_so_far = true;
+  imaging::Position bit_matrix_position;
+  ok_so_far = position.Subtract(bounding_box_.lower(), &bit_matrix_position);
+  if (!ok_so_far) return ok_so_far;
+  return data_.LinearIndex(bit_matrix_position, index);
+}
+
+bool imaging::binary::StructuringElement::NextSetBit(
+    const imaging::ImagePositionIndex from, bool *found,
+    imaging::ImagePositionIndex *index) const {
+  return data_.NextSetBit(from, found, index);
+}
+
+bool imaging::binary::StructuringElement::Or(
+    const imaging::binary::StructuringElement &other) {
+  if (!bounding_box_.Equals(other.bounding_box_)) return false;
+  return data_.Or(other.data_);
+}
+
+bool imaging::binary::StructuringElement::OrShifted(
+    const imaging::binary::StructuringElement &source,
+    const imaging::Position &offset) {
+  if (!bounding_box_.Equals(source.bounding_box_)) return false;
+  return data_.OrShifted(source.data_, offset);
+}
+
 bool imaging::binary::StructuringElement::ReflectByOrigin(
     imaging::binary::StructuringElement *result) const {
   if (result == NULL) return false;
@@ -1604,9 +2287,10 @@ bool imaging::binary::StructuringElement::ReflectByOrigin(
 bool imaging::binary::StructuringElement::set_value(
     const imaging::Position &position, const bool value) {
   bool ok_so_far = true;
-  ok_so_far = position.Subtract(bounding_box_.lower(), &bit_matrix_position_);
+  imaging::Position bit_matrix_position;
+  ok_so_far = position.Subtract(bounding_box_.lower(), &bit_matrix_position);
   if (!ok_so_far) return ok_so_far;
-  return data_.set_value(bit_matrix_position_, value);
+  return data_.set_value(bit_matrix_position, value);
 }
 
 bool imaging::binary::StructuringElement::SetMinus(
@@ -1618,6 +2302,12 @@ bool imaging::binary::StructuringElement::SetMinus(
   bool ok_so_far = true;
   bool position_value = true;
   imaging::binary::StructuringElement output(*this);
+  if (bounding_box_.Equals(to_be_subtracted.bounding_box_)) {
+    // Same layout: subtract word by word.
+    ok_so_far = output.AndNot(to_be_subtracted);
+    if (!ok_so_far) return ok_so_far;
+    return result->CopyFrom(output);
+  }
   ok_so_far = bounding_box_.Intersection(to_be_subtracted.bounding_box_,
                                          &empty, &intersection_bb);
   if (!ok_so_far) return ok_so_far;
@@ -1643,6 +2333,10 @@ const imaging::Size& imaging::binary::StructuringElement::size() const {
   return bounding_box_.size();
 }
 
+long imaging::binary::StructuringElement::Stride(const char index) const {
+  return data_.Stride(index);
+}
+
 bool imaging::binary::StructuringElement::Union(
     const imaging::binary::StructuringElement &other,
     imaging::binary::StructuringElement *result) const {
@@ -1650,6 +2344,13 @@ bool imaging::binary::StructuringElement::Union(
   bool ok_so_far = true;
   bool position_value = true;
   imaging::BoundingBox union_bb;
+  if (bounding_box_.Equals(other.bounding_box_)) {
+    // Same layout: unite word by word.
+    imaging::binary::StructuringElement output(*this);
+    ok_so_far = output.Or(other);
+    if (!ok_so_far) return ok_so_far;
+    return result->CopyFrom(output);
+  }
   ok_so_far = bounding_box_.Union(other.bounding_box_, &union_bb);
   if (!ok_so_far) return ok_so_far;
   imaging::binary::StructuringElement output(union_bb, true);
@@ -1680,9 +2381,16 @@ bool imaging::binary::StructuringElement::value(
     const imaging::Position &position, bool *value) const {
   if (value == NULL) return false;
   bool ok_so_far = true;
-  ok_so_far = position.Subtract(bounding_box_.lower(), &bit_matrix_position_);
+  imaging::Position bit_matrix_position;
+  ok_so_far = position.Subtract(bounding_box_.lower(), &bit_matrix_position);
   if (!ok_so_far) return ok_so_far;
-  return data_.value(bit_matrix_position_, value);
+  return data_.value(bit_matrix_position, value);
+}
+
+bool imaging::binary::StructuringElement::Xor(
+    const imaging::binary::StructuringElement &other) {
+  if (!bounding_box_.Equals(other.bounding_box_)) return false;
+  return data_.Xor(other.data_);
 }
 
 imaging::binary::StructuringElement::StructuringElement()
@@ -1811,10 +2519,257 @@ bool imaging::binary::Image::Union(
   return ok_so_far;
 }
 
+// imaging::binary::morphology::TransformPlan
+
+imaging::binary::morphology::TransformPlan::TransformPlan()
+    : initialized_(false) {
+  ; // empty
+}
+
+bool imaging::binary::morphology::TransformPlan::Initialize(
+    const std::vector<imaging::binary::StructuringElement*> &se) {
+  imaging::ImagePositionIndex i = 0;
+  imaging::SEIndex i_se = 0;
+  imaging::ImagePositionIndex j_se = 0;
+  int number_of_se = 0;
+  bool ok_so_far = true;
+  bool position_value = true;
+  std::vector<imaging::Position> q;
+  imaging::ImagePositionIndex u_cardinality = 0;
+  imaging::BoundingBox union_bb;
+  std::vector< std::vector<imaging::Position> > vectorized_se;
+  initialized_ = false;
+  // Vectorize SEs.
+  ok_so_far = ::VectorizeSEs(se, &vectorized_se);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CalculateReach(vectorized_se, &u_reach_);
+  if (!ok_so_far) return ok_so_far;
+  number_of_se = vectorized_se.size();
+  // Calculate the bounding box of the union of the SE.
+  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
+    const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
+    const long current_cardinality = current_se.size();
+    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
+      const imaging::Position &current_position = current_se.at(j_se);
+      ok_so_far = union_bb.Expand(current_position);
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  imaging::binary::StructuringElement U(union_bb, true);
+  se_cardinality_.clear();
+  se_cardinality_.resize(number_of_se, -1);
+  // Iterate SEs, counting the cardinality of the union of SEs.
+  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
+    const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
+    const imaging::ImagePositionIndex current_cardinality = current_se.size();
+    se_cardinality_.at(i_se) = current_cardinality;
+    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
+      const imaging::Position &current_position = current_se.at(j_se);
+      ok_so_far = U.value(current_position, &position_value);
+      if (!ok_so_far) continue;
+      if (position_value) continue;
+      ++u_cardinality;
+      ok_so_far = U.set_value(current_position, true);
+      q.push_back(current_position);
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  u_elements_.clear();
+  u_elements_.resize(u_cardinality);
+  if (u_cardinality != static_cast<imaging::ImagePositionIndex>(q.size())) {
+    ok_so_far = false;
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Put the position of each foreground pixel of the union of SEs
+  // into an index of 'u_elements'.
+  for (i = 0; i < u_cardinality; ++i) {
+    u_elements_.at(i) = q.at(i);
+  }
+  se_elements_.clear();
+  se_elements_.resize(number_of_se);
+  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
+    // Put the index of foreground pixels of each SE, according to 'u_elements'
+    // into a vector in 'se_elements'.
+    imaging::BoundingBox bb;
+    const imaging::ImagePositionIndex &current_cardinality =
+        se_cardinality_.at(i_se);
+    imaging::SEIndex j = 0;
+    imaging::SEIndex m = 0;
+    std::vector< imaging::ImagePositionIndex > se_indexes =
+        se_elements_.at(i_se);
+    // Temporarily creates a SE for direct position access.
+    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
+      const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
+      const imaging::Position &current_position = current_se.at(j_se);
+      ok_so_far = bb.Expand(current_position);
+    }
+    if (!ok_so_far) continue;
+    imaging::binary::StructuringElement actual_se(bb, true);
+    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
+      const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
+      const imaging::Position &current_position = current_se.at(j_se);
+      ok_so_far = actual_se.set_value(current_position, true);
+    }
+    if (!ok_so_far) continue;
+    se_indexes.clear();
+    se_indexes.resize(current_cardinality, -1);
+    while (ok_so_far && m < current_cardinality && j < u_cardinality) {
+      const imaging::Position &current = u_elements_.at(j);
+      if (actual_se.IsPositionValid(current)) {
+        ok_so_far = actual_se.value(current, &position_value);
+        if (!ok_so_far) continue;
+        if (position_value) {
+          se_indexes.at(m) = j;
+          ++m;
+        }
+      }
+      ++j;
+    }
+    if (m != current_cardinality) ok_so_far = false;
+    se_elements_.at(i_se) = se_indexes;
+  }
+  initialized_ = ok_so_far;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TransformPlan::initialized() const {
+  return initialized_;
+}
+
+const std::vector<imaging::ImagePositionIndex>&
+    imaging::binary::morphology::TransformPlan::se_cardinality() const {
+  return se_cardinality_;
+}
+
+const std::vector< std::vector<imaging::ImagePositionIndex> >&
+    imaging::binary::morphology::TransformPlan::se_elements() const {
+  return se_elements_;
+}
+
+const std::vector<imaging::Position>&
+    imaging::binary::morphology::TransformPlan::u_elements() const {
+  return u_elements_;
+}
+
+const imaging::Position& imaging::binary::morphology::TransformPlan::u_reach()
+    const {
+  return u_reach_;
+}
+
+// imaging::binary::morphology::TransformPlanCache
+
+imaging::binary::morphology::TransformPlanCache::~TransformPlanCache() {
+  entries_.clear();
+}
+
+bool imaging::binary::morphology::TransformPlanCache::Find(
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    std::shared_ptr<const imaging::binary::morphology::TransformPlan> *plan) {
+  if (plan == NULL) return false;
+  std::shared_ptr<imaging::binary::morphology::TransformPlanCache::Entry>
+      entry;
+  imaging::SEIndex i_se = 0;
+  uint64_t key = 0;
+  bool ok_so_far = true;
+  plan->reset();
+  ok_so_far = ::HashSEFamily(se, &key);
+  if (!ok_so_far) return ok_so_far;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *plan = Lookup(key, se);
+    if (*plan) return true;
+  }
+  // Preprocess without holding the lock, as it may take a while.
+  entry.reset(new imaging::binary::morphology::TransformPlanCache::Entry);
+  entry->dimension = imaging::Dimension::number();
+  for (i_se = 0; i_se < se.size(); ++i_se)
+    entry->family.push_back(*(se.at(i_se)));
+  ok_so_far = entry->plan.Initialize(se);
+  if (!ok_so_far) return ok_so_far;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Another transform may have cached the same family meanwhile.
+  *plan = Lookup(key, se);
+  if (*plan) return true;
+  if (entries_.size() >= imaging::PLAN_CACHE_CAPACITY) {
+    ok_so_far = Evict();
+    if (!ok_so_far) return ok_so_far;
+  }
+  entry->last_use = ++uses_;
+  entries_.insert(std::make_pair(key, entry));
+  *plan = std::shared_ptr<const imaging::binary::morphology::TransformPlan>(
+      entry, &(entry->plan));
+  return true;
+}
+
+imaging::binary::morphology::TransformPlanCache&
+    imaging::binary::morphology::TransformPlanCache::Instance() {
+  static imaging::binary::morphology::TransformPlanCache instance;
+  return instance;
+}
+
+bool imaging::binary::morphology::TransformPlanCache::Evict() {
+  std::multimap< uint64_t, std::shared_ptr<Entry> >::iterator entry;
+  std::multimap< uint64_t, std::shared_ptr<Entry> >::iterator oldest;
+  if (entries_.empty()) return false;
+  oldest = entries_.begin();
+  for (entry = entries_.begin(); entry != entries_.end(); ++entry) {
+    if (entry->second->last_use < oldest->second->last_use) oldest = entry;
+  }
+  // Transforms still running with the plan keep their own reference.
+  entries_.erase(oldest);
+  return true;
+}
+
+std::shared_ptr<const imaging::binary::morphology::TransformPlan>
+    imaging::binary::morphology::TransformPlanCache::Lookup(
+    const uint64_t key,
+    const std::vector<imaging::binary::StructuringElement*> &se) {
+  std::multimap< uint64_t, std::shared_ptr<Entry> >::iterator entry;
+  imaging::SEIndex i_se = 0;
+  bool same = true;
+  const std::pair<std::multimap< uint64_t, std::shared_ptr<Entry> >::iterator,
+      std::multimap< uint64_t, std::shared_ptr<Entry> >::iterator> range =
+      entries_.equal_range(key);
+  // Compare the contents, as different families may share a hash.
+  for (entry = range.first; entry != range.second; ++entry) {
+    Entry &current = *(entry->second);
+    same = (current.dimension == imaging::Dimension::number()
+        && current.family.size() == se.size());
+    for (i_se = 0; same && i_se < se.size(); ++i_se)
+      same = current.family.at(i_se).Equals(*(se.at(i_se)));
+    if (!same) continue;
+    current.last_use = ++uses_;
+    return std::shared_ptr<const imaging::binary::morphology::TransformPlan>(
+        entry->second, &(current.plan));
+  }
+  return std::shared_ptr<const imaging::binary::morphology::TransformPlan>();
+}
+
+size_t imaging::binary::morphology::TransformPlanCache::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
 // imaging::binary::morphology::Transform
 
 imaging::binary::morphology::Transform::~Transform() {
   Transform::clear();
+  if (candidate_matrix_ != NULL) {
+    delete candidate_matrix_;
+    candidate_matrix_ = NULL;
+  }
+  if (guard_band_output_ != NULL) {
+    delete guard_band_output_;
+    guard_band_output_ = NULL;
+  }
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  if (Y_ != NULL) {
+    delete Y_;
+    Y_ = NULL;
+  }
 }
 
 bool imaging::binary::morphology::Transform::Calculate(
@@ -1835,6 +2790,45 @@ bool imaging::binary::morphology::Transform::Calculate(
         *algorithm_number_of_elements_in_border,
     double *start,
     double *end) {
+  if (output == NULL) return false;
+  if (*output != NULL) return false;
+  std::shared_ptr<const imaging::binary::morphology::TransformPlan>
+      cached_plan;
+  bool ok_so_far = true;
+  // Preprocess SEs, unless the family was already seen by the process.
+  ok_so_far = imaging::binary::morphology::TransformPlanCache::Instance().Find(
+      se, &cached_plan);
+  if (!ok_so_far) return ok_so_far;
+  *output = new imaging::grayscale::Image(image.size(), -1);
+  if (*output == NULL) return false;
+  return Execute(*cached_plan, image, *output,
+      algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border,
+      start, end);
+}
+
+bool imaging::binary::morphology::Transform::Execute(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image,
+    imaging::grayscale::Image *output,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border,
+    double *start,
+    double *end) {
   if (output == NULL
       || algorithm_determinate_border_comparison_counter == NULL
       || algorithm_insert_new_candidate_comparison_counter == NULL
@@ -1844,67 +2838,25 @@ bool imaging::binary::morphology::Transform::Calculate(
       || algorithm_number_of_elements_in_border == NULL
       || start == NULL || end == NULL)
     return false;
-  if (*output != NULL) return false;
-  const size_t empty = 0;
+  if (!plan.initialized()) return false;
+  if (!output->size().Equals(image.size())) return false;
+  imaging::grayscale::Image **algorithm_output = &output;
   bool ok_so_far = true;
-  std::vector< std::vector<imaging::Position> > vectorized_se;
-  // Clear the instance data.
-  this->clear();
-  // Set current algorithm counter data.
-  if (algorithm_determinate_border_comparison_counter->size() != empty
-      || algorithm_insert_new_candidate_comparison_counter->size() != empty
-      || algorithm_insert_new_candidate_memory_access_counter->size() != empty
-      || algorithm_remove_candidate_comparison_counter->size() != empty
-      || algorithm_remove_candidate_memory_access_counter->size() != empty
-      || algorithm_number_of_elements_in_border->size() != empty)
-    return false;
-  algorithm_determinate_border_comparison_counter_ =
-      algorithm_determinate_border_comparison_counter;
-  algorithm_insert_new_candidate_comparison_counter_ =
-      algorithm_insert_new_candidate_comparison_counter;
-  algorithm_insert_new_candidate_memory_access_counter_ =
-      algorithm_insert_new_candidate_memory_access_counter;
-  algorithm_remove_candidate_comparison_counter_ =
-      algorithm_remove_candidate_comparison_counter;
-  algorithm_remove_candidate_memory_access_counter_ =
-      algorithm_remove_candidate_memory_access_counter;
-  algorithm_number_of_elements_in_border_ =
-      algorithm_number_of_elements_in_border;
-  // Initialize candidate matrix.
-  if (use_candidate_matrix_) {
-    using namespace imaging;
-    using namespace imaging::grayscale::_internal;
-    candidate_matrix_ =
-        new NumericalMatrix<ImagePositionIndex>(image.size(), imaging::HEADER);
-    if (candidate_matrix_ == NULL) return false;
-  }
-  // Initialize temporary image.
-  Y_ = new imaging::binary::Image(image);
-  if (Y_ == NULL) return false;
-  // Initialize transitional output image.
-  ok_so_far = ::InitializeAlgorithmsOutputImage(image, output);
-  if (!ok_so_far) return ok_so_far;
-  // Vectorize SEs.
-  ok_so_far = ::VectorizeSEs(se, &vectorized_se);
-  if (!ok_so_far) return ok_so_far;
-  // Start!
-  gettimeofday(&(::timer), NULL);
-  *start = (::timer).tv_sec*1000000.+(::timer).tv_usec;
-  // Initialize SE data.
-  ok_so_far = InitializeSEData(vectorized_se);
-  if (!ok_so_far) return ok_so_far;
-  // Initialize algorithm memory and comparison counters.
-  ok_so_far = InitializeCounters();
-  if (!ok_so_far) return ok_so_far;
-  // Initialize according to chosen algorithm.
-  ok_so_far = this->CustomInitialize();
-  if (!ok_so_far) return ok_so_far;
-  // Initialize candidate data.
-  ok_so_far = InitializeCandidateData(image);
-  if (!ok_so_far) return ok_so_far;
+  struct timeval timer;
+  ok_so_far = Prepare(plan, image, output,
+      algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border,
+      start);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = PrepareCandidates();
+  if (!ok_so_far) return ok_so_far;
+  if (guard_band_) algorithm_output = &guard_band_output_;
   // Actual algorithm!
-  border_.resize(candidate_position_.size(), imaging::HEADER);
-  ok_so_far = this->ActualAlgorithm(output);
+  ok_so_far = this->ActualAlgorithm(algorithm_output);
   if (!ok_so_far) return ok_so_far;
   if (debug_) {
     debug_output_ << "\tAfter actual algorithm:\n";
@@ -1913,26 +2865,225 @@ bool imaging::binary::morphology::Transform::Calculate(
     debug_output_ << "\n";
   }
   // Finally!
-  gettimeofday(&(::timer), NULL);
-  *end = (::timer).tv_sec*1000000.+(::timer).tv_usec;
-  // Clear the instance data.
-  this->clear();
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  return Finish(output);
+}
+
+bool imaging::binary::morphology::Transform::guard_band() const {
+  return guard_band_;
+}
+
+bool imaging::binary::morphology::Transform::set_guard_band(
+    const bool guard_band) {
+  guard_band_ = guard_band;
+  return true;
+}
+
+imaging::ImagePositionIndex
+    imaging::binary::morphology::Transform::max_iterations() const {
+  return max_iterations_;
+}
+
+bool imaging::binary::morphology::Transform::set_max_iterations(
+    const imaging::ImagePositionIndex max_iterations) {
+  max_iterations_ = max_iterations;
+  return true;
+}
+
+imaging::ImagePositionIndex
+    imaging::binary::morphology::Transform::completed_iterations() const {
+  return completed_iterations_;
+}
+
+bool imaging::binary::morphology::Transform::interrupted() const {
+  return interrupted_;
+}
+
+bool imaging::binary::morphology::Transform::set_cancellation_token(
+    const std::atomic<bool> *cancelled) {
+  cancelled_ = cancelled;
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::set_deadline(
+    const double deadline) {
+  deadline_ = deadline;
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::adaptive_element_order()
+    const {
+  return adaptive_element_order_;
+}
+
+bool imaging::binary::morphology::Transform::set_adaptive_element_order(
+    const bool adaptive_element_order) {
+  adaptive_element_order_ = adaptive_element_order;
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::ordered_by_cost() const {
+  return ordered_by_cost_;
+}
+
+bool imaging::binary::morphology::Transform::set_ordered_by_cost(
+    const bool ordered_by_cost) {
+  if (ordered_by_cost && !true_for_erosion_) return false;
+  ordered_by_cost_ = ordered_by_cost;
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::set_seed(const uint64_t seed,
+    const uint64_t stream) {
+  return random_seed_.Seed(seed, stream);
+}
+
+bool imaging::binary::morphology::Transform::set_threads(
+    const unsigned threads) {
+  if (threads == 0) return false;
+  threads_ = threads;
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  if (threads == 1) return true;
+  // The calling thread runs a chunk too.
+  pool_ = new imaging::WorkStealingPool(threads-1);
+  return pool_ != NULL;
+}
+
+unsigned imaging::binary::morphology::Transform::threads() const {
+  return threads_;
+}
+
+bool imaging::binary::morphology::Transform::Update(
+    const imaging::binary::Image &image,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    const imaging::BoundingBox &dirty, imaging::grayscale::Image *output) {
+  if (output == NULL) return false;
+  if (!output->size().Equals(image.size())) return false;
+  std::shared_ptr<const imaging::binary::morphology::TransformPlan>
+      cached_plan;
+  bool can_grow = false;
+  bool certain = false;
+  imaging::BoundingBox changed;
+  std::vector< std::vector<imaging::ImagePositionIndex> > counters(6);
+  double end = 0;
+  char i = 0;
+  const int kept_value = true_for_erosion_ ? -1 : 0;
+  long levels = 0;
+  long limit = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::Position reach;
+  imaging::BoundingBox recomputed;
+  double start = 0;
+  imaging::Position target;
+  const int unreached_value = true_for_erosion_ ? 0 : -1;
+  int value = 0;
+  imaging::BoundingBox window;
+  imaging::Position window_lengths;
+  ok_so_far = imaging::binary::morphology::TransformPlanCache::Instance().Find(
+      se, &cached_plan);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CalculateIterationReach(*cached_plan, &reach);
+  if (!ok_so_far) return ok_so_far;
+  // Nothing to do if no changed pixel lies inside the image.
+  for (i = 0; i < n; ++i) {
+    if (dirty.upper().coordinate(i) < 0) return true;
+    if (dirty.lower().coordinate(i) >= image.Length(i)) return true;
+    if (limit < image.Length(i)) limit = image.Length(i);
+  }
+  ok_so_far = ::GrowRegion(dirty, reach, 0, image.size(), &changed);
+  if (!ok_so_far) return ok_so_far;
+  if (!true_for_erosion_ && se.size() > 1) {
+    levels = limit;
+  } else {
+    ok_so_far = ::AffectedLevels(*output, changed, reach, true_for_erosion_,
+        limit, &levels);
+    if (!ok_so_far) return ok_so_far;
+  }
+  if (levels < 1) levels = 1;
+  while (ok_so_far && !certain) {
+    // Pixels changed by the update lie within 'recomputed'; the window is
+    // large enough for values up to 'levels' there to be exact.
+    ok_so_far = ::GrowRegion(changed, reach, levels, image.size(),
+        &recomputed);
+    if (!ok_so_far) continue;
+    ok_so_far = ::GrowRegion(changed, reach, 2*levels, image.size(), &window);
+    if (!ok_so_far) continue;
+    can_grow = false;
+    for (i = 0; ok_so_far && i < n; ++i) {
+      ok_so_far = window_lengths.set_value(i, window.Length(i));
+      if (reach.coordinate(i) > 0 && window.Length(i) < image.Length(i))
+        can_grow = true;
+    }
+    if (!ok_so_far) continue;
+    imaging::binary::Image window_image(imaging::Size(window_lengths), true);
+    imaging::grayscale::Image window_output(window_image.size(), -1);
+    ok_so_far = ::CropImage(image, window, &window_image);
+    if (!ok_so_far) continue;
+    for (i = 0; i < static_cast<char>(counters.size()); ++i) {
+      counters.at(i).clear();
+    }
+    ok_so_far = Execute(*cached_plan, window_image, &window_output,
+        &counters.at(0), &counters.at(1), &counters.at(2), &counters.at(3),
+        &counters.at(4), &counters.at(5), &start, &end);
+    if (!ok_so_far) continue;
+    // Values above 'levels' may have been cut by the border of the window,
+    // unless the window can not grow any further.
+    certain = true;
+    imaging::PositionIterator check_iterator(recomputed);
+    ok_so_far = check_iterator.begin();
+    if (!ok_so_far) continue;
+    do {
+      ok_so_far = check_iterator.value().Subtract(window.lower(), &target);
+      if (!ok_so_far) continue;
+      ok_so_far = window_output.value(target, &value);
+      if (!ok_so_far) continue;
+      if (value == kept_value) continue;
+      if (value == unreached_value || value > levels) certain = !can_grow;
+    } while (ok_so_far && certain && check_iterator.iterate());
+    if (!ok_so_far) continue;
+    if (!certain) {
+      levels *= 2;
+      continue;
+    }
+    imaging::PositionIterator iterator(recomputed);
+    ok_so_far = iterator.begin();
+    if (!ok_so_far) continue;
+    do {
+      const imaging::Position &current = iterator.value();
+      ok_so_far = current.Subtract(window.lower(), &target);
+      if (!ok_so_far) continue;
+      ok_so_far = window_output.value(target, &value);
+      if (!ok_so_far) continue;
+      ok_so_far = output->set_value(current, value);
+    } while (ok_so_far && iterator.iterate());
+    if (!iterator.IsFinished()) ok_so_far = false;
+  }
   return ok_so_far;
 }
 
 bool imaging::binary::morphology::Transform::ActualAlgorithm(
     imaging::grayscale::Image **output_image) {
-  imaging::ImagePositionIndex current = 0;
   imaging::SEIndex current_se = 0;
   imaging::SEIndex current_se_index = 0;
   imaging::ImagePositionIndex current_se_index_element = 0;
-  imaging::ImagePositionIndex i = 0;
-  const imaging::ImagePositionIndex initial_counter_value = 0;
+  std::vector<double> element_distance;
+  imaging::ImagePositionIndex element_index = 0;
+  std::vector<double> element_weight;
+  char i = 0;
+  const char n = imaging::Dimension::number();
   imaging::SEIndex not_done = 0;
   bool ok_so_far = true;
   const imaging::SEIndex number_of_se = se_elements_.size();
+  std::vector<double> se_benefit(number_of_se, 0.);
   std::vector< imaging::SEIndex > se_index;
   std::vector< std::vector<imaging::ImagePositionIndex> > shuffled_indexes;
+  imaging::ImagePositionIndex step_border = 0;
+  imaging::ImagePositionIndex step_tests = 0;
   // Setting up SE element index shuffler's data.
   for (current_se = 0; ok_so_far && current_se < number_of_se; ++current_se) {
     std::vector<imaging::ImagePositionIndex> current_se_indexes;
@@ -1942,30 +3093,54 @@ bool imaging::binary::morphology::Transform::ActualAlgorithm(
         ++current_se_index) {
       current_se_indexes.push_back(current_se_index);
     }
+    // The cost order tests the elements farthest from the origin first, as
+    // they are the likeliest to fail the test of a candidate.
+    if (ordered_by_cost_) {
+      element_distance.assign(current_cardinality, 0.);
+      for (current_se_index_element = 0;
+          current_se_index_element < current_cardinality;
+          ++current_se_index_element) {
+        const imaging::Position &element = u_elements_.at(
+            se_elements_.at(current_se).at(current_se_index_element));
+        for (i = 0; i < n; ++i) {
+          element_distance.at(current_se_index_element) +=
+              element.coordinate(i)*element.coordinate(i);
+        }
+      }
+      std::sort(current_se_indexes.begin(), current_se_indexes.end(),
+          ::GreaterWeight(element_distance));
+    }
     shuffled_indexes.push_back(current_se_indexes);
     se_index.push_back(current_se);
   }
   // Transform itself.
+  random_ = random_seed_;
+  completed_iterations_ = 0;
+  interrupted_ = false;
   se_iteration_ = 0;
   not_done = 0;
-  current = candidate_next_.at(imaging::HEADER);
-  while (ok_so_far && current != imaging::HEADER && not_done < number_of_se) {
-    // Insert current iteration counter data value.
-    algorithm_determinate_border_comparison_counter_->push_back(
-        initial_counter_value);
-    algorithm_insert_new_candidate_comparison_counter_->push_back(
-        initial_counter_value);
-    algorithm_insert_new_candidate_memory_access_counter_->push_back(
-        initial_counter_value);
-    algorithm_remove_candidate_comparison_counter_->push_back(
-        initial_counter_value);
-    algorithm_remove_candidate_memory_access_counter_->push_back(
-        initial_counter_value);
-    algorithm_number_of_elements_in_border_->push_back(
-        initial_counter_value);
+  // A token already fired or a deadline already passed interrupts the run
+  // even when it has no candidate, so every engine reports it alike.
+  this->Interrupted();
+  while (ok_so_far && !interrupted_ && this->HasCandidates()
+      && not_done < number_of_se
+      && (max_iterations_ == 0 || se_iteration_ < max_iterations_)) {
+    ok_so_far = BeginIteration();
+    if (!ok_so_far) continue;
+    // Older disqualifications weigh less in the adaptive element order.
+    if (adaptive_element_order_) {
+      for (element_index = 0; element_index < element_failures_.size();
+          ++element_index) {
+        element_failures_.at(element_index) /= 2;
+      }
+    }
     // Set up data with current values.
-    ++se_iteration_;
-    ok_so_far = shuffle(&se_index); // shuffle SE sequence
+    if (ordered_by_cost_) {
+      std::sort(se_index.begin(), se_index.end(),
+          ::GreaterWeight(se_benefit));
+    } else {
+      ok_so_far = shuffle(&se_index, &random_); // shuffle SE sequence
+    }
     not_done = 0;
     if (debug_) {
       debug_output_ << "\tBefore running iteration " << se_iteration_ << ":\n";
@@ -1980,14 +3155,36 @@ bool imaging::binary::morphology::Transform::ActualAlgorithm(
       debug_output_ << "\n";
     }
     for (current_se = 0;
-        ok_so_far && current != imaging::HEADER && current_se < number_of_se;
+        ok_so_far && this->HasCandidates() && current_se < number_of_se;
         ++current_se) {
+      if (this->Interrupted()) break;
       border_counter_ = 0;
       current_se_index = se_index.at(current_se);
       border_counter_ = 0;
-      // Determinate which candidates belongs to current border.
-      ok_so_far = shuffle(&(shuffled_indexes.at(current_se_index)));
-      if (!ok_so_far) continue;
+      // Determinate which candidates belongs to current border. Elements are
+      // shuffled even when sorted afterwards, so the SE sequences drawn next
+      // are the ones of a run without the adaptive element order.
+      if (!ordered_by_cost_) {
+        ok_so_far = shuffle(&(shuffled_indexes.at(current_se_index)),
+            &random_);
+        if (!ok_so_far) continue;
+      }
+      if (adaptive_element_order_) {
+        const std::vector<imaging::ImagePositionIndex> &current_se_vector =
+            se_elements_.at(current_se_index);
+        element_weight.assign(current_se_vector.size(), 0.);
+        for (element_index = 0; element_index < current_se_vector.size();
+            ++element_index) {
+          element_weight.at(element_index) =
+              element_failures_.at(current_se_vector.at(element_index));
+        }
+        std::sort(shuffled_indexes.at(current_se_index).begin(),
+            shuffled_indexes.at(current_se_index).end(),
+            ::GreaterWeight(element_weight));
+      }
+      step_border = algorithm_number_of_elements_in_border_->at(se_iteration_);
+      step_tests =
+          algorithm_determinate_border_comparison_counter_->at(se_iteration_);
       if (debug_) {
         const imaging::ImagePositionIndex se_cardinality
             = se_cardinality_.at(current_se_index);
@@ -2006,7 +3203,7 @@ bool imaging::binary::morphology::Transform::ActualAlgorithm(
         }
         debug_output_ << "]\n\n";
       }
-      ok_so_far = DetectBorder(current_se_index,
+      ok_so_far = DetectStepBorder(current_se_index,
           shuffled_indexes.at(current_se_index));
       if (!ok_so_far) continue;
       if (debug_) {
@@ -2016,19 +3213,7 @@ bool imaging::binary::morphology::Transform::ActualAlgorithm(
         debug_output_ << "\n";
       }
       // Remove border pixels.
-      for (i = 0; ok_so_far && i < border_counter_; ++i) {
-        const imaging::Position &p = candidate_position_.at(border_.at(i));
-        ok_so_far = Y_->set_value(p, !true_for_erosion_);
-        if (!ok_so_far) continue;
-        if (regular_removal_) {
-          ok_so_far = RemoveCandidateNode(border_.at(i));
-          if (!ok_so_far) continue;
-        }
-        algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
-            += 1;
-        ok_so_far = (*output_image)->set_value(p, se_iteration_);
-        if (!ok_so_far) continue;
-      }
+      ok_so_far = this->RemoveBorder(output_image);
       if (!ok_so_far) continue;
       // Insert new candidate pixels into candidate queue.
       ok_so_far = this->InsertNewCandidateFromBorder(output_image);
@@ -2042,16 +3227,38 @@ bool imaging::binary::morphology::Transform::ActualAlgorithm(
       algorithm_number_of_elements_in_border_->at(se_iteration_)
           += border_counter_;
       border_counter_ = 0; // setting zero for debug info
+      // Border found per border test by the step, for the cost order.
+      step_border =
+          algorithm_number_of_elements_in_border_->at(se_iteration_)
+          -step_border;
+      step_tests =
+          algorithm_determinate_border_comparison_counter_->at(se_iteration_)
+          -step_tests;
+      se_benefit.at(current_se_index) = (step_tests == 0) ? 0. :
+          static_cast<double>(step_border)/step_tests;
       if (debug_) {
         debug_output_ << "\tAfter removing border and inserting new candidates ["
             << current_se+1 << "/" << number_of_se << "]:\n";
         this->Debug();
         debug_output_ << "\n";
       }
-      current = candidate_next_.at(imaging::HEADER);
     }
   }
-  return ok_so_far;
+  if (!ok_so_far) return ok_so_far;
+  // An interrupted iteration is partial: pixels it already processed keep
+  // their value, which is completed_iterations_+1 as well, and the others
+  // are set beyond the completed ones, so no partial value is left.
+  completed_iterations_ = (interrupted_ && se_iteration_ > 0) ?
+      se_iteration_-1 : se_iteration_;
+  // Pixels left by an interruption are set beyond the completed iterations,
+  // skipping the remaining candidate work. Under a level cap, pixels left
+  // unprocessed are set beyond the cap whether or not the run got to it, so
+  // the output does not depend on where the run stopped.
+  if (interrupted_) {
+    return MarkUnprocessed(completed_iterations_+1, output_image);
+  }
+  if (max_iterations_ == 0) return ok_so_far;
+  return MarkUnprocessed(max_iterations_+1, output_image);
 }
 
 bool imaging::binary::morphology::Transform::clear() {
@@ -2063,22 +3270,19 @@ bool imaging::binary::morphology::Transform::clear() {
   algorithm_remove_candidate_memory_access_counter_ = NULL;
   border_.clear();
   border_counter_ = 0;
+  candidate_index_.clear();
   candidate_initialized_.clear();
+  candidate_interior_.clear();
   candidate_next_.clear();
-  candidate_position_.clear();
   candidate_previous_.clear();
+  element_failures_.clear();
   se_cardinality_.clear();
   se_elements_.clear();
   se_iteration_ = 0;
+  thread_candidates_.clear();
   u_elements_.clear();
-  if (candidate_matrix_ != NULL) {
-    delete candidate_matrix_;
-    candidate_matrix_ = NULL;
-  }
-  if (Y_ != NULL) {
-    delete Y_;
-    Y_ = NULL;
-  }
+  u_offsets_.clear();
+  u_reach_.SetAsOrigin();
   return true;
 }
 
@@ -2233,6 +3437,129 @@ bool imaging::binary::morphology::Transform::Debug() {
   return true;
 }
 
+bool imaging::binary::morphology::Transform::DetectBorderChunk(
+    const unsigned chunk, const imaging::SEIndex current_se_index,
+    const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  std::vector<imaging::ImagePositionIndex> &border = thread_border_.at(chunk);
+  std::vector<imaging::ImagePositionIndex> &failures =
+      thread_failures_.at(chunk);
+  const uint64_t candidates = thread_candidates_.size();
+  const uint64_t chunks = thread_border_.size();
+  imaging::ImagePositionIndex comparisons = 0;
+  const imaging::ImagePositionIndex &current_cardinality =
+      se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  const imaging::ImagePositionIndex first = candidates*chunk/chunks;
+  imaging::ImagePositionIndex i = 0;
+  imaging::ImagePositionIndex j = 0;
+  bool keep_pixel = true;
+  const imaging::ImagePositionIndex last = candidates*(chunk+1)/chunks;
+  bool ok_so_far = true;
+  bool position_value = true;
+  imaging::ImagePositionIndex removed = 0;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
+  border.clear();
+  failures.assign(u_elements_.size(), 0);
+  for (j = first; ok_so_far && j < last; ++j) {
+    const imaging::ImagePositionIndex current = thread_candidates_[j];
+    if (candidate_next_[current] == current) {
+      ++removed;
+      continue;
+    }
+    keep_pixel = true;
+    for (i = 0; ok_so_far && keep_pixel && i < current_cardinality; ++i) {
+      const imaging::ImagePositionIndex element_index =
+          current_se_vector.at(current_se_indexes.at(i));
+      ++comparisons;
+      ok_so_far = NeighborIndex(current, element_index, true_for_erosion_,
+          &valid, &target);
+      if (!ok_so_far) continue;
+      // Erosion removes a candidate with a background or outside neighbor,
+      // dilation adds a candidate with a foreground neighbor.
+      if (valid) {
+        ok_so_far = Y_->value(target, &position_value);
+        if (!ok_so_far) continue;
+        if (position_value == true_for_erosion_) continue;
+      } else if (!true_for_erosion_) {
+        continue;
+      }
+      failures.at(element_index) += 1;
+      keep_pixel = false;
+    }
+    if (!keep_pixel) border.push_back(current);
+  }
+  thread_comparisons_.at(chunk) = comparisons;
+  thread_ok_.at(chunk) = ok_so_far;
+  thread_removed_.at(chunk) = removed;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::DetectBorderInParallel(
+    const imaging::SEIndex current_se_index,
+    const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  unsigned chunk = 0;
+  unsigned chunks = pool_->threads()+1;
+  imaging::ImagePositionIndex i = 0;
+  imaging::ImagePositionIndex kept = 0;
+  bool ok_so_far = true;
+  imaging::ImagePositionIndex removed = 0;
+  if (thread_candidates_.size()/MINIMUM_CANDIDATES_PER_THREAD < chunks)
+    chunks = thread_candidates_.size()/MINIMUM_CANDIDATES_PER_THREAD;
+  if (chunks < 1) chunks = 1;
+  thread_border_.resize(chunks);
+  thread_comparisons_.assign(chunks, 0);
+  thread_failures_.resize(chunks);
+  thread_ok_.assign(chunks, true);
+  thread_removed_.assign(chunks, 0);
+  for (chunk = 1; chunk < chunks; ++chunk) {
+    if (!pool_->Submit([this, chunk, current_se_index, &current_se_indexes]() {
+          return DetectBorderChunk(chunk, current_se_index,
+              current_se_indexes);
+        })) ok_so_far = false;
+  }
+  if (!DetectBorderChunk(0, current_se_index, current_se_indexes))
+    ok_so_far = false;
+  if (!pool_->Wait()) ok_so_far = false;
+  // Merge the chunks in order, as a single thread would have found them.
+  for (chunk = 0; chunk < chunks; ++chunk) {
+    const std::vector<imaging::ImagePositionIndex> &border =
+        thread_border_.at(chunk);
+    if (!thread_ok_.at(chunk)) ok_so_far = false;
+    algorithm_determinate_border_comparison_counter_->at(se_iteration_) +=
+        thread_comparisons_.at(chunk);
+    for (i = 0; i < element_failures_.size(); ++i) {
+      element_failures_.at(i) += thread_failures_.at(chunk).at(i);
+    }
+    for (i = 0; i < border.size(); ++i) {
+      border_.at(border_counter_) = border.at(i);
+      ++border_counter_;
+    }
+    removed += thread_removed_.at(chunk);
+  }
+  // Drop the removed nodes once they are most of the candidates, which keeps
+  // the scans linear on the number of candidates left.
+  if (2*removed > thread_candidates_.size()) {
+    for (i = 0; i < thread_candidates_.size(); ++i) {
+      const imaging::ImagePositionIndex current = thread_candidates_.at(i);
+      if (candidate_next_.at(current) == current) continue;
+      thread_candidates_.at(kept) = current;
+      ++kept;
+    }
+    thread_candidates_.resize(kept);
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::DetectStepBorder(
+    const imaging::SEIndex current_se_index,
+    const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  if (pool_ != NULL && regular_removal_ && ListsCandidates())
+    return DetectBorderInParallel(current_se_index, current_se_indexes);
+  return DetectBorder(current_se_index, current_se_indexes);
+}
+
 bool imaging::binary::morphology::Transform::EnqueueCandidateNode(
     const imaging::ImagePositionIndex &image_position) {
   const imaging::ImagePositionIndex previous = candidate_previous_.at(
@@ -2248,23 +3575,25 @@ bool imaging::binary::morphology::Transform::EnqueueCandidateNode(
   candidate_previous_.at(image_position) = previous;
   candidate_next_.at(image_position) = imaging::HEADER;
   candidate_initialized_.at(image_position) = true;
+  if (pool_ != NULL) thread_candidates_.push_back(image_position);
   return true;
 }
 
+bool imaging::binary::morphology::Transform::HasCandidates() const {
+  return candidate_next_.at(imaging::HEADER) != imaging::HEADER;
+}
+
 bool imaging::binary::morphology::Transform::InitializeCandidateData(
     const imaging::binary::Image &image) {
   if (Y_ == NULL) return false;
   bool ok_so_far = true;
-  imaging::ImagePositionIndex position_counter = 0;
   bool position_value = true;
-  // Initialize candidate nodes vectors.
-  border_.push_back(imaging::HEADER);
-  candidate_initialized_.push_back(false);
-  candidate_next_.push_back(imaging::HEADER);
-  candidate_position_.push_back(imaging::Position());
-  candidate_previous_.push_back(imaging::HEADER);
-  // Put each candidate pixel of the image into a list.
-  imaging::PositionIterator iterator(image.size());
+  ok_so_far = ReserveCandidates();
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  // Put each candidate pixel of the input image region into a list.
+  imaging::PositionIterator iterator(candidate_region_);
   ok_so_far = iterator.begin();
   if (!ok_so_far) return ok_so_far;
   do {
@@ -2275,20 +3604,7 @@ bool imaging::binary::morphology::Transform::InitializeCandidateData(
     ok_so_far = image.value(current, &position_value);
     if (!ok_so_far) continue;
     if (position_value != true_for_erosion_) continue;
-    ++position_counter;
-    border_.push_back(imaging::HEADER);
-    candidate_initialized_.push_back(false);
-    candidate_next_.push_back(position_counter);
-    candidate_position_.push_back(current);
-    candidate_previous_.push_back(position_counter);
-    if (use_candidate_matrix_) {
-      algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-          += 1;
-      ok_so_far = candidate_matrix_->set_value(current, position_counter);
-      if (!ok_so_far) continue;
-    }
-    ok_so_far = this->InitialCandidatePositionFound(
-        image, position_counter, current);
+    ok_so_far = InsertInitialCandidate(image, current);
   } while (ok_so_far && iterator.iterate());
   if (!iterator.IsFinished()) ok_so_far = false;
   if (ok_so_far && debug_) {
@@ -2299,6 +3615,16 @@ bool imaging::binary::morphology::Transform::InitializeCandidateData(
   return ok_so_far;
 }
 
+bool imaging::binary::morphology::Transform::InitializeCandidateHeader() {
+  border_.push_back(imaging::HEADER);
+  candidate_index_.push_back(imaging::HEADER);
+  candidate_initialized_.push_back(false);
+  candidate_interior_.push_back(false);
+  candidate_next_.push_back(imaging::HEADER);
+  candidate_previous_.push_back(imaging::HEADER);
+  return true;
+}
+
 bool imaging::binary::morphology::Transform::InitializeCounters() {
   const imaging::ImagePositionIndex initial_counter_value = 0;
   algorithm_determinate_border_comparison_counter_->push_back(
@@ -2317,112 +3643,163 @@ bool imaging::binary::morphology::Transform::InitializeCounters() {
 }
 
 bool imaging::binary::morphology::Transform::InitializeSEData(
-    const std::vector< std::vector<imaging::Position> > &vectorized_se) {
+    const imaging::binary::morphology::TransformPlan &plan) {
+  if (Y_ == NULL) return false;
+  char dimension = 0;
+  imaging::Position index_lengths;
+  const char n = imaging::Dimension::number();
+  for (dimension = 0; dimension < n; ++dimension) {
+    index_lengths.set_value(dimension, (dimension == 0 && n > 1)
+        ? Y_->Stride(1) : Y_->Length(dimension));
+  }
+  return InitializeSEData(plan, index_lengths);
+}
+
+bool imaging::binary::morphology::Transform::InitializeSEData(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::Position &index_lengths) {
+  char dimension = 0;
   imaging::ImagePositionIndex i = 0;
-  imaging::SEIndex i_se = 0;
-  imaging::ImagePositionIndex j_se = 0;
-  const int number_of_se = vectorized_se.size();
-  bool ok_so_far = true;
-  bool position_value = true;
-  std::vector<imaging::Position> q;
+  const char n = imaging::Dimension::number();
+  long offset = 0;
+  long stride = 0;
   imaging::ImagePositionIndex u_cardinality = 0;
-  imaging::BoundingBox union_bb;
-  // Calculate the bounding box of the union of the SE.
-  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
-    const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
-    const long current_cardinality = current_se.size();
-    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
-      const imaging::Position &current_position = current_se.at(j_se);
-      ok_so_far = union_bb.Expand(current_position);
+  se_cardinality_ = plan.se_cardinality();
+  se_elements_ = plan.se_elements();
+  u_elements_ = plan.u_elements();
+  // Linear offset of each element of the union of SEs, the stride of each
+  // dimension being the product of the index lengths of the previous ones.
+  u_cardinality = u_elements_.size();
+  element_failures_.assign(u_cardinality, 0);
+  u_offsets_.resize(u_cardinality, 0);
+  for (i = 0; i < u_cardinality; ++i) {
+    const imaging::Position &current = u_elements_.at(i);
+    offset = 0;
+    stride = 1;
+    for (dimension = 0; dimension < n; ++dimension) {
+      offset += current.coordinate(dimension)*stride;
+      stride *= index_lengths.coordinate(dimension);
     }
+    u_offsets_.at(i) = offset;
   }
-  if (!ok_so_far) return ok_so_far;
-  imaging::binary::StructuringElement U(union_bb, true);
-  se_cardinality_.clear();
-  se_cardinality_.resize(number_of_se, -1);
-  // Iterate SEs, counting the cardinality of the union of SEs.
-  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
-    const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
-    const imaging::ImagePositionIndex current_cardinality = current_se.size();
-    se_cardinality_.at(i_se) = current_cardinality;
-    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
-      const imaging::Position &current_position = current_se.at(j_se);
-      ok_so_far = U.value(current_position, &position_value);
-      if (!ok_so_far) continue;
-      if (position_value) continue;
-      ++u_cardinality;
-      ok_so_far = U.set_value(current_position, true);
-      q.push_back(current_position);
-    }
+  return y_index_lengths_.CopyFrom(index_lengths);
+}
+
+bool imaging::binary::morphology::Transform::InsertInitialCandidate(
+    const imaging::binary::Image &image, const imaging::Position &current) {
+  char i = 0;
+  imaging::ImagePositionIndex index = 0;
+  bool interior = true;
+  long length = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  const imaging::ImagePositionIndex position_counter =
+      candidate_index_.size();
+  long reach = 0;
+  ok_so_far = Y_->LinearIndex(current, &index);
+  if (!ok_so_far) return ok_so_far;
+  // Neighbors of interior candidates are reached by their linear offsets.
+  for (i = 0; interior && i < n; ++i) {
+    length = Y_->Length(i);
+    reach = u_reach_.coordinate(i);
+    if (current.coordinate(i) < reach
+        || current.coordinate(i)+reach >= length) interior = false;
   }
-  if (!ok_so_far) return ok_so_far;
-  u_elements_.clear();
-  u_elements_.resize(u_cardinality);
-  if (u_cardinality != static_cast<imaging::ImagePositionIndex>(q.size())) {
-    ok_so_far = false;
+  border_.push_back(imaging::HEADER);
+  candidate_index_.push_back(index);
+  candidate_initialized_.push_back(false);
+  candidate_interior_.push_back(interior);
+  candidate_next_.push_back(position_counter);
+  candidate_previous_.push_back(position_counter);
+  if (use_candidate_matrix_) {
+    algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
+        += 1;
+    ok_so_far = candidate_matrix_->set_value(index, true);
+    if (!ok_so_far) return ok_so_far;
   }
+  return this->InitialCandidatePositionFound(image, position_counter, current);
+}
+
+bool imaging::binary::morphology::Transform::linear_position(
+    const imaging::ImagePositionIndex &linear_index,
+    imaging::ImagePositionIndex *value) const {
+  if (!use_candidate_matrix_ || value == NULL) return false;
+  bool candidate = false;
+  bool ok_so_far = true;
+  ok_so_far = candidate_matrix_->value(linear_index, &candidate);
   if (!ok_so_far) return ok_so_far;
-  // Put the position of each foreground pixel of the union of SEs
-  // into an index of 'u_elements'.
-  for (i = 0; i < u_cardinality; ++i) u_elements_.at(i) = q.at(i);
-  se_elements_.clear();
-  se_elements_.resize(number_of_se);
-  for (i_se = 0; ok_so_far && i_se < number_of_se; ++i_se) {
-    // Put the index of foreground pixels of each SE, according to 'u_elements'
-    // into a vector in 'se_elements'.
-    imaging::BoundingBox bb;
-    const imaging::ImagePositionIndex &current_cardinality =
-        se_cardinality_.at(i_se);
-    imaging::SEIndex j = 0;
-    imaging::SEIndex m = 0;
-    std::vector< imaging::ImagePositionIndex > se_indexes =
-        se_elements_.at(i_se);
-    // Temporarily creates a SE for direct position access.
-    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
-      const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
-      const imaging::Position &current_position = current_se.at(j_se);
-      ok_so_far = bb.Expand(current_position);
-    }
-    if (!ok_so_far) continue;
-    imaging::binary::StructuringElement actual_se(bb, true);
-    for (j_se = 0; ok_so_far && j_se < current_cardinality; ++j_se) {
-      const std::vector<imaging::Position> &current_se = vectorized_se.at(i_se);
-      const imaging::Position &current_position = current_se.at(j_se);
-      ok_so_far = actual_se.set_value(current_position, true);
-    }
-    if (!ok_so_far) continue;
-    se_indexes.clear();
-    se_indexes.resize(current_cardinality, -1);
-    while (ok_so_far && m < current_cardinality && j < u_cardinality) {
-      const imaging::Position &current = u_elements_.at(j);
-      if (actual_se.IsPositionValid(current)) {
-        ok_so_far = actual_se.value(current, &position_value);
-        if (!ok_so_far) continue;
-        if (position_value) {
-          se_indexes.at(m) = j;
-          ++m;
-        }
-      }
-      ++j;
-    }
-    if (m != current_cardinality) ok_so_far = false;
-    se_elements_.at(i_se) = se_indexes;
-  }
+  *value = imaging::HEADER;
+  if (!candidate) return ok_so_far;
+  // Nodes follow the header in linear index order.
+  ok_so_far = candidate_matrix_->Rank(linear_index, value);
+  if (!ok_so_far) return ok_so_far;
+  ++(*value);
   return ok_so_far;
 }
 
+bool imaging::binary::morphology::Transform::ListsCandidates() const {
+  return true;
+}
+
 bool imaging::binary::morphology::Transform::position(
     const imaging::Position &image_position,
     imaging::ImagePositionIndex *value) const {
   if (!use_candidate_matrix_ || value == NULL) return false;
-  return candidate_matrix_->value(image_position, value);
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  ok_so_far = Y_->LinearIndex(image_position, &index);
+  if (!ok_so_far) return ok_so_far;
+  return linear_position(index, value);
 }
 
 bool imaging::binary::morphology::Transform::position(
     const imaging::ImagePositionIndex &position_index,
     imaging::Position *value) const {
   if (value == NULL) return false;
-  return value->CopyFrom(candidate_position_.at(position_index));
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  long rest = candidate_index_.at(position_index);
+  // Coordinates are decoded from the linear index of the candidate at Y_.
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = value->set_value(i, rest%y_index_lengths_.coordinate(i));
+    rest /= y_index_lengths_.coordinate(i);
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::ReserveCandidates() {
+  if (Y_ == NULL) return false;
+  const imaging::ImagePositionIndex foreground = Y_->Count();
+  // The guard band is at the background and is never a candidate.
+  const size_t count = 1+(true_for_erosion_ ? foreground
+      : candidate_region_.capacity()-foreground);
+  border_.reserve(count);
+  candidate_index_.reserve(count);
+  candidate_initialized_.reserve(count);
+  candidate_interior_.reserve(count);
+  candidate_next_.reserve(count);
+  candidate_previous_.reserve(count);
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  imaging::ImagePositionIndex i = 0;
+  bool ok_so_far = true;
+  for (i = 0; ok_so_far && i < border_counter_; ++i) {
+    const imaging::ImagePositionIndex &p = candidate_index_.at(border_.at(i));
+    ok_so_far = Y_->set_value(p, !true_for_erosion_);
+    if (!ok_so_far) continue;
+    if (regular_removal_) {
+      ok_so_far = RemoveCandidateNode(border_.at(i));
+      if (!ok_so_far) continue;
+    }
+    algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+        += 1;
+    ok_so_far = (*output_image)->set_value(p, se_iteration_);
+  }
+  return ok_so_far;
 }
 
 bool imaging::binary::morphology::Transform::RemoveCandidateNode(
@@ -2444,3 +3821,262 @@ imaging::SEIndex imaging::binary::morphology::Transform::u_cardinality()
     const {
   return static_cast<imaging::SEIndex>(u_elements_.size());
 }
+
+bool imaging::binary::morphology::Transform::BeginIteration() {
+  const imaging::ImagePositionIndex initial_counter_value = 0;
+  // Insert current iteration counter data value.
+  algorithm_determinate_border_comparison_counter_->push_back(
+      initial_counter_value);
+  algorithm_insert_new_candidate_comparison_counter_->push_back(
+      initial_counter_value);
+  algorithm_insert_new_candidate_memory_access_counter_->push_back(
+      initial_counter_value);
+  algorithm_remove_candidate_comparison_counter_->push_back(
+      initial_counter_value);
+  algorithm_remove_candidate_memory_access_counter_->push_back(
+      initial_counter_value);
+  algorithm_number_of_elements_in_border_->push_back(
+      initial_counter_value);
+  ++se_iteration_;
+  return true;
+}
+
+bool imaging::binary::morphology::Transform::Finish(
+    imaging::grayscale::Image *output) {
+  if (output == NULL) return false;
+  bool ok_so_far = true;
+  // Remove the guard band from the output image.
+  if (guard_band_) {
+    ok_so_far = ::CropImage(*guard_band_output_, candidate_region_, output);
+    if (!ok_so_far) return ok_so_far;
+  }
+  // Clear the instance data.
+  this->clear();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::Interrupted() {
+  struct timeval timer;
+  if (cancelled_ != NULL && cancelled_->load()) interrupted_ = true;
+  if (deadline_ > 0) {
+    gettimeofday(&timer, NULL);
+    if (timer.tv_sec*1000000.+timer.tv_usec >= deadline_) interrupted_ = true;
+  }
+  return interrupted_;
+}
+
+bool imaging::binary::morphology::Transform::MarkUnprocessed(
+    const imaging::ImagePositionIndex level,
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  bool ok_so_far = true;
+  const int unprocessed_value = true_for_erosion_ ? 0 : -1;
+  int value = 0;
+  imaging::PositionIterator iterator(candidate_region_);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    ok_so_far = (*output_image)->value(current, &value);
+    if (!ok_so_far) continue;
+    if (value != unprocessed_value) continue;
+    ok_so_far = (*output_image)->set_value(current, static_cast<int>(level));
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::Prepare(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image,
+    imaging::grayscale::Image *output,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border,
+    double *start) {
+  imaging::grayscale::Image **algorithm_output = &output;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::Position padded_size;
+  imaging::Position region_upper;
+  struct timeval timer;
+  // Clear the instance data.
+  this->clear();
+  // Set current algorithm counter data.
+  ok_so_far = SetCounters(algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = u_reach_.CopyFrom(plan.u_reach());
+  if (!ok_so_far) return ok_so_far;
+  // Initialize temporary image, padded by the reach of the SEs if required.
+  if (guard_band_) {
+    for (i = 0; ok_so_far && i < n; ++i) {
+      ok_so_far = padded_size.set_value(i,
+          image.Length(i)+2*u_reach_.coordinate(i));
+    }
+    if (!ok_so_far) return ok_so_far;
+    ok_so_far = ReserveBuffer(imaging::Size(padded_size), true, &Y_);
+    if (!ok_so_far) return ok_so_far;
+    ok_so_far = ::PadImage(image, u_reach_, Y_);
+    if (!ok_so_far) return ok_so_far;
+    ok_so_far = u_reach_.Sum(image.size().upper(), &region_upper);
+    if (!ok_so_far) return ok_so_far;
+    candidate_region_ = imaging::BoundingBox(u_reach_, region_upper);
+    ok_so_far = ReserveBuffer(Y_->size(), -1, &guard_band_output_);
+    if (!ok_so_far) return ok_so_far;
+    algorithm_output = &guard_band_output_;
+  } else {
+    ok_so_far = ReserveBuffer(image.size(), true, &Y_);
+    if (!ok_so_far) return ok_so_far;
+    *Y_ = image;
+    candidate_region_ = image.size();
+  }
+  // Initialize candidate matrix.
+  if (use_candidate_matrix_) {
+    ok_so_far = ReserveBuffer(Y_->size(), true, &candidate_matrix_);
+    if (!ok_so_far) return ok_so_far;
+    ok_so_far = candidate_matrix_->Fill(false);
+    if (!ok_so_far) return ok_so_far;
+  }
+  // Initialize transitional output image. The guard band is marked above
+  // any iteration, as already processed, so it is never inserted as a
+  // candidate even when it holds pixels of a neighboring tile.
+  ok_so_far = ::InitializeAlgorithmsOutputImage(*Y_, candidate_region_,
+      INT_MAX, *algorithm_output);
+  if (!ok_so_far) return ok_so_far;
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  // Initialize SE data.
+  ok_so_far = InitializeSEData(plan);
+  if (!ok_so_far) return ok_so_far;
+  // Initialize algorithm memory and comparison counters.
+  ok_so_far = InitializeCounters();
+  if (!ok_so_far) return ok_so_far;
+  // Initialize according to chosen algorithm.
+  ok_so_far = this->CustomInitialize();
+  if (!ok_so_far) return ok_so_far;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::PrepareCandidates() {
+  bool ok_so_far = true;
+  // Initialize candidate data.
+  ok_so_far = this->InitializeCandidateData(*Y_);
+  if (!ok_so_far) return ok_so_far;
+  if (use_candidate_matrix_) {
+    ok_so_far = candidate_matrix_->BuildRank();
+    if (!ok_so_far) return ok_so_far;
+  }
+  border_.resize(candidate_index_.size(), imaging::HEADER);
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::Transform::PrepareSparse(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::Size &size,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border,
+    double *start) {
+  if (start == NULL || !plan.initialized()) return false;
+  char i = 0;
+  imaging::Position index_lengths;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  struct timeval timer;
+  // Clear the instance data.
+  this->clear();
+  // Set current algorithm counter data.
+  ok_so_far = SetCounters(algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = u_reach_.CopyFrom(plan.u_reach());
+  if (!ok_so_far) return ok_so_far;
+  candidate_region_ = size;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = index_lengths.set_value(i, size.Length(i));
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  // Initialize SE data.
+  ok_so_far = InitializeSEData(plan, index_lengths);
+  if (!ok_so_far) return ok_so_far;
+  // Initialize algorithm memory and comparison counters.
+  ok_so_far = InitializeCounters();
+  if (!ok_so_far) return ok_so_far;
+  // Initialize according to chosen algorithm.
+  return this->CustomInitialize();
+}
+
+bool imaging::binary::morphology::Transform::SetCounters(
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border) {
+  if (algorithm_determinate_border_comparison_counter == NULL
+      || algorithm_insert_new_candidate_comparison_counter == NULL
+      || algorithm_insert_new_candidate_memory_access_counter == NULL
+      || algorithm_remove_candidate_comparison_counter == NULL
+      || algorithm_remove_candidate_memory_access_counter == NULL
+      || algorithm_number_of_elements_in_border == NULL)
+    return false;
+  if (!algorithm_determinate_border_comparison_counter->empty()
+      || !algorithm_insert_new_candidate_comparison_counter->empty()
+      || !algorithm_insert_new_candidate_memory_access_counter->empty()
+      || !algorithm_remove_candidate_comparison_counter->empty()
+      || !algorithm_remove_candidate_memory_access_counter->empty()
+      || !algorithm_number_of_elements_in_border->empty())
+    return false;
+  algorithm_determinate_border_comparison_counter_ =
+      algorithm_determinate_border_comparison_counter;
+  algorithm_insert_new_candidate_comparison_counter_ =
+      algorithm_insert_new_candidate_comparison_counter;
+  algorithm_insert_new_candidate_memory_access_counter_ =
+      algorithm_insert_new_candidate_memory_access_counter;
+  algorithm_remove_candidate_comparison_counter_ =
+      algorithm_remove_candidate_comparison_counter;
+  algorithm_remove_candidate_memory_access_counter_ =
+      algorithm_remove_candidate_memory_access_counter;
+  algorithm_number_of_elements_in_border_ =
+      algorithm_number_of_elements_in_border;
+  return true;
+}
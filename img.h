@@ -19,11 +19,24 @@
 #ifndef IMG_H_
 #define IMG_H_
 
+#include <stdint.h>
+
+#include <atomic>
 #include <climits>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include "disallow_ca.h"
+#include "random.h"
+
+// Maximum number of dimensions held inline by imaging::Position. Builds that
+// only handle 2D images may define it as 2 to shrink every position.
+#ifndef IMAGING_MAXIMUM_DIMENSION
+#define IMAGING_MAXIMUM_DIMENSION 3
+#endif
 
 namespace imaging {
 
@@ -35,6 +48,17 @@ typedef uint32_t ImagePositionIndex; // Type definition for image elements index
 
 const imaging::ImagePositionIndex HEADER = 0;
 
+// Rows (first dimension) of every matrix are stored aligned to this number of
+// elements, so bit matrices hold whole words per row and matrices of the same
+// size share their linear indexes.
+const imaging::ImagePositionIndex ROW_ALIGNMENT = 64;
+
+// Smallest number of candidates worth handing to a border detection thread.
+const imaging::ImagePositionIndex MINIMUM_CANDIDATES_PER_THREAD = 4096;
+
+// Maximum number of SE families kept by the process wide plan cache.
+const size_t PLAN_CACHE_CAPACITY = 64;
+
 class Dimension {
  public:
   ~Dimension() {}
@@ -62,9 +86,13 @@ class Position {
   bool Subtract(const Position &other, Position *result) const;
   bool Sum(const Position &other, Position *result) const;
   bool value(const char index, long *value) const;
+  // Unchecked access for hot paths; 'index' must be below Dimension::number().
+  long coordinate(const char index) const {
+    return values_[static_cast<int>(index)];
+  }
  private:
   bool PlusFactor(const Position &other, int factor, Position *result) const;
-  std::vector<long> values_;
+  long values_[IMAGING_MAXIMUM_DIMENSION];
 }; // imaging::Position
 
 
@@ -72,6 +100,10 @@ class Position {
 class Size;
 
 
+// Forward declaration: imaging::WorkStealingPool
+class WorkStealingPool;
+
+
 class BoundingBox {
  public:
   BoundingBox();
@@ -158,7 +190,16 @@ class NDimensionalMatrixInterface {
   virtual bool CopyFrom(const NDimensionalMatrixInterface &other);
   virtual bool Equals(const NDimensionalMatrixInterface &other) const;
   virtual long Length(const char index) const;
+  // Calculates the linear index of 'position', in which the first dimension
+  // varies fastest.
+  virtual bool LinearIndex(const imaging::Position &position,
+      imaging::ImagePositionIndex *index) const;
   virtual const imaging::Size& size() const;
+  // Number of elements stored, including the ones which align the rows.
+  imaging::ImagePositionIndex storage_capacity() const;
+  // Linear index distance between two positions which differ by one unit at
+  // dimension 'index'.
+  virtual long Stride(const char index) const;
  protected:
   NDimensionalMatrixInterface();
   virtual bool CalculateIndexes(const imaging::Position &position,
@@ -185,8 +226,12 @@ class NumericalMatrix : public imaging::NDimensionalMatrixInterface {
   bool clear();
   bool CopyFrom(const NumericalMatrix &other);
   bool Equals(const NumericalMatrix &other) const;
+  bool Fill(const T value);
   bool set_value(const imaging::Position &position, const T value);
+  inline bool set_value(const imaging::ImagePositionIndex index,
+      const T value);
   bool value(const imaging::Position &position, T *value) const;
+  inline bool value(const imaging::ImagePositionIndex index, T *value) const;
  private:
   NumericalMatrix();
   std::vector<T> array_;
@@ -205,15 +250,22 @@ class Image {
   const imaging::BoundingBox& bounding_box() const;
   bool CopyFrom(const Image &other);
   bool Equals(const Image &other) const;
+  bool Fill(const int value);
   bool Maximum(const Image &other, bool *empty, Image *result) const;
   bool Minimum(const Image &other, bool *empty, Image *result) const;
   bool IsPositionValid(const imaging::Position &position) const;
   long Length(const char index) const;
+  bool LinearIndex(const imaging::Position &position,
+      imaging::ImagePositionIndex *index) const;
   bool Print(std::ostream &out) const;
   bool set_value(const imaging::Position &position, const int value);
+  inline bool set_value(const imaging::ImagePositionIndex index,
+      const int value);
   const imaging::Size& size() const;
+  long Stride(const char index) const;
   bool UnpaddedImage(Image *result) const;
   bool value(const imaging::Position &position, int *value) const;
+  inline bool value(const imaging::ImagePositionIndex index, int *value) const;
  protected:
   Image();
  private:
@@ -230,8 +282,10 @@ namespace binary {
 
 namespace _internal {
 
-typedef int BLOCK;
-const long BLOCK_MAX = INT_MAX;
+typedef uint64_t BLOCK;
+const BLOCK BLOCK_MAX = ~static_cast<BLOCK>(0);
+// Number of bits used in each block: every bit of BLOCK_MAX.
+const imaging::ImagePositionIndex BLOCK_BITS = sizeof(BLOCK)*CHAR_BIT;
 
 class BitMatrix : public imaging::NDimensionalMatrixInterface {
  public:
@@ -239,19 +293,66 @@ class BitMatrix : public imaging::NDimensionalMatrixInterface {
   BitMatrix(const BitMatrix &other);
   ~BitMatrix();
   BitMatrix& operator= (const BitMatrix &other);
+  // Bulk operations with a matrix of the same size, word by word.
+  bool And(const BitMatrix &other);
+  bool AndNot(const BitMatrix &other);
+  // Shifted operations with a matrix of the same size, row by row: each
+  // element p of this matrix is combined with the element p+offset of
+  // 'source', taken as false if such element lies outside the matrix.
+  bool AndShifted(const BitMatrix &source, const imaging::Position &offset);
   bool CopyFrom(const BitMatrix &other);
+  imaging::ImagePositionIndex Count() const;
   bool Equals(const BitMatrix &other) const;
+  bool Fill(const bool value);
   bool InvertValues();
+  // Searches the first set bit whose linear index is not less than 'from'.
+  bool NextSetBit(const imaging::ImagePositionIndex from, bool *found,
+      imaging::ImagePositionIndex *index) const;
+  bool Or(const BitMatrix &other);
+  bool OrShifted(const BitMatrix &source, const imaging::Position &offset);
   bool set_value(const imaging::Position &position, const bool value);
+  inline bool set_value(const imaging::ImagePositionIndex index,
+      const bool value);
   bool value(const imaging::Position &position, bool *value) const;
- private:
+  inline bool value(const imaging::ImagePositionIndex index, bool *value) const;
+  long words_per_row() const;
+  bool Xor(const BitMatrix &other);
+ protected:
   BitMatrix();
+  // Blocks of the matrix, row by row.
+  const std::vector<BLOCK>& array() const { return array_; }
+ private:
+  bool ClearAlignmentBits();
   bool SetSize(const imaging::Size &size, const bool empty);
+  bool ShiftedOperation(const BitMatrix &source,
+      const imaging::Position &offset, const bool conjunction);
   std::vector<BLOCK> array_;
   long blocks_;
+  BLOCK last_block_mask_; // valid bits of the last block of each row
+  long words_per_row_;
 }; // imaging::binary::_internal::BitMatrix
 
 
+// Bit matrix counting in constant time the set elements before any linear
+// index. Every 8 blocks keep the count of set elements before them and, in 9
+// bits each, the counts before their other 7 blocks: 1.25 bits per element,
+// along with the bits themselves. Counts are the ones at the last BuildRank.
+class RankBitMatrix : public BitMatrix {
+ public:
+  RankBitMatrix(const imaging::Size &size, const bool empty)
+      : BitMatrix(size, empty), counts_() {}
+  ~RankBitMatrix() {}
+  bool BuildRank();
+  // Sets 'rank' as the number of set elements whose linear index is less
+  // than 'index'.
+  bool Rank(const imaging::ImagePositionIndex index,
+      imaging::ImagePositionIndex *rank) const;
+ private:
+  RankBitMatrix() {}
+  std::vector<BLOCK> counts_; // absolute and packed counts of each 8 blocks
+}; // imaging::binary::_internal::RankBitMatrix
+
+
 } // namespace imaging::binary::_internal
 
 
@@ -262,26 +363,48 @@ class StructuringElement {
   StructuringElement(const StructuringElement &other);
   virtual ~StructuringElement() {}
   virtual StructuringElement& operator= (const StructuringElement &other);
+  // Bulk operations with a SE of the same bounding box.
+  bool And(const StructuringElement &other);
+  bool AndNot(const StructuringElement &other);
+  // Combines each element p with the element p+offset of 'source', which is
+  // taken as false outside its bounding box.
+  bool AndShifted(const StructuringElement &source,
+      const imaging::Position &offset);
   const imaging::BoundingBox& bounding_box() const;
   virtual bool CopyFrom(const StructuringElement &other);
+  imaging::ImagePositionIndex Count() const;
   bool DelimitedComplement(StructuringElement *result) const;
   bool Equals(const StructuringElement &other) const;
+  bool Fill(const bool value);
   bool Intersection(const StructuringElement &other, bool *empty,
       StructuringElement *result) const;
   bool IsPositionValid(const imaging::Position &position) const;
   long Length(const char index) const;
+  // Linear index of 'position' relative to the lower corner of the
+  // bounding box, as used by the index based accessors.
+  bool LinearIndex(const imaging::Position &position,
+      imaging::ImagePositionIndex *index) const;
+  bool NextSetBit(const imaging::ImagePositionIndex from, bool *found,
+      imaging::ImagePositionIndex *index) const;
+  bool Or(const StructuringElement &other);
+  bool OrShifted(const StructuringElement &source,
+      const imaging::Position &offset);
   virtual bool ReflectByOrigin(StructuringElement *result) const;
   bool set_value(const imaging::Position &position, const bool value);
+  inline bool set_value(const imaging::ImagePositionIndex index,
+      const bool value);
   bool SetMinus(const StructuringElement &to_be_subtracted,
       StructuringElement *result) const;
   const imaging::Size& size() const;
+  long Stride(const char index) const;
   virtual bool Union(const StructuringElement &other,
       StructuringElement *result) const;
   bool value(const imaging::Position &position, bool *value) const;
+  inline bool value(const imaging::ImagePositionIndex index, bool *value) const;
+  bool Xor(const StructuringElement &other);
  protected:
   StructuringElement();
  private:
-  mutable imaging::Position bit_matrix_position_;
   imaging::BoundingBox bounding_box_;
   imaging::binary::_internal::BitMatrix data_;
 }; // imaging::binary::StructuringElement
@@ -305,6 +428,64 @@ class Image : public StructuringElement {
 namespace morphology {
 
 
+// Preprocessed data of a family of SEs, which may be shared by any number of
+// transforms and images.
+class TransformPlan {
+ public:
+  TransformPlan();
+  ~TransformPlan() {}
+  bool Initialize(const std::vector<imaging::binary::StructuringElement*> &se);
+  bool initialized() const;
+  const std::vector<imaging::ImagePositionIndex>& se_cardinality() const;
+  const std::vector< std::vector<imaging::ImagePositionIndex> >&
+      se_elements() const;
+  const std::vector<imaging::Position>& u_elements() const;
+  const imaging::Position& u_reach() const;
+ private:
+  bool initialized_;
+  std::vector<imaging::ImagePositionIndex> se_cardinality_;
+  std::vector< std::vector<imaging::ImagePositionIndex> > se_elements_;
+  std::vector<imaging::Position> u_elements_;
+  imaging::Position u_reach_; // maximum absolute U coordinate by dimension
+  DISALLOW_COPY_AND_ASSIGN(TransformPlan);
+}; // imaging::binary::morphology::TransformPlan
+
+
+// Process wide cache of plans, keyed by a hash of the contents of the SE
+// family and shared by every transform. Once PLAN_CACHE_CAPACITY families
+// are cached, the least recently found one is evicted for a new one; plans
+// are shared with their callers, so an evicted plan lives on until the last
+// transform using it lets it go.
+class TransformPlanCache {
+ public:
+  static TransformPlanCache& Instance();
+  // Sets 'plan' as the cached plan of 'se', preprocessing it on a miss.
+  bool Find(const std::vector<imaging::binary::StructuringElement*> &se,
+      std::shared_ptr<const TransformPlan> *plan);
+  size_t size();
+ private:
+  struct Entry {
+    char dimension;
+    std::vector<imaging::binary::StructuringElement> family;
+    uint64_t last_use; // value of uses_ when last found
+    TransformPlan plan;
+  };
+
+  TransformPlanCache() : uses_(0) {}
+  ~TransformPlanCache();
+  // Must be called with 'mutex_' held.
+  bool Evict();
+  // Must be called with 'mutex_' held.
+  std::shared_ptr<const TransformPlan> Lookup(const uint64_t key,
+      const std::vector<imaging::binary::StructuringElement*> &se);
+
+  std::multimap< uint64_t, std::shared_ptr<Entry> > entries_;
+  std::mutex mutex_; // guards entries_ and uses_
+  uint64_t uses_;
+  DISALLOW_COPY_AND_ASSIGN(TransformPlanCache);
+}; // imaging::binary::morphology::TransformPlanCache
+
+
 class Transform {
  public:
   Transform(const bool true_for_erosion, const bool use_candidate_matrix,
@@ -316,9 +497,13 @@ class Transform {
         algorithm_remove_candidate_memory_access_counter_(NULL),
         algorithm_number_of_elements_in_border_(NULL),
         border_counter_(0), candidate_matrix_(NULL), debug_(debug),
-        debug_output_(debug_output), se_iteration_(0), Y_(NULL),
+        debug_output_(debug_output), guard_band_output_(NULL),
+        se_iteration_(0), Y_(NULL), adaptive_element_order_(false),
+        cancelled_(NULL), completed_iterations_(0),
+        deadline_(0), guard_band_(false), interrupted_(false),
+        max_iterations_(0), ordered_by_cost_(false), pool_(NULL),
         regular_removal_(regular_removal),
-        true_for_erosion_(true_for_erosion),
+        threads_(1), true_for_erosion_(true_for_erosion),
         use_candidate_matrix_(use_candidate_matrix) {}
   virtual ~Transform();
   bool Calculate(const imaging::binary::Image &image,
@@ -337,8 +522,92 @@ class Transform {
       std::vector<imaging::ImagePositionIndex>
           *algorithm_number_of_elements_in_border,
        double *start, double *end);
+  // Same as Calculate, for SEs already preprocessed by 'plan'. The caller
+  // owns 'output', which must have the size of 'image'. Temporary images are
+  // kept between calls while the size of the image does not change.
+  bool Execute(const TransformPlan &plan, const imaging::binary::Image &image,
+      imaging::grayscale::Image *output,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border,
+       double *start, double *end);
+  bool guard_band() const;
+  // When set, the input image is padded by the reach of the union of SEs,
+  // so every neighbor access of the engines lies inside Y_. The pad is
+  // background at Y_ and is never taken as a candidate; the output keeps
+  // the size of the input image.
+  bool set_guard_band(const bool guard_band);
+  imaging::ImagePositionIndex max_iterations() const;
+  // When nonzero, a run stops after 'max_iterations' iterations and the
+  // pixels still unprocessed are set as max_iterations+1, meaning a level
+  // beyond the cap. That includes the pixels no iteration would ever reach,
+  // even when the run ends before the cap. Defaults to 0, which runs until
+  // no pixel is left.
+  bool set_max_iterations(const imaging::ImagePositionIndex max_iterations);
+  bool adaptive_element_order() const;
+  // When set, the elements of each SE are tested in decreasing order of the
+  // candidates they disqualified at the border detection of the naive and
+  // border engines, counts which are halved every iteration so the order
+  // follows the shrinking shape. The order of the elements of a SE does not
+  // change the output, only the number of border tests.
+  bool set_adaptive_element_order(const bool adaptive_element_order);
+  bool ordered_by_cost() const;
+  // When set, SEs and their elements are run in a fixed order instead of
+  // being shuffled. Each iteration runs the SEs by decreasing border found
+  // per border test at their previous step, as measured by the counters;
+  // the first one runs them in plan order. The elements of each SE are
+  // tested farthest from the origin first. Only erosions, whose output does
+  // not depend on the SE order, may be ordered.
+  bool set_ordered_by_cost(const bool ordered_by_cost);
+  // Seeds the engine shuffling the SE sequences. Every run restarts it at
+  // stream 'stream' of 'seed', so runs with the same seed and stream give
+  // the same output whichever thread runs them and whatever ran before.
+  // Both default to 0.
+  bool set_seed(const uint64_t seed, const uint64_t stream);
+  // Iterations fully completed by the last run. If the run was interrupted,
+  // only values up to this one are final: the pixels it left unprocessed are
+  // set as this plus one, as are the pixels reached by the interrupted
+  // iteration, so that value only means a level beyond it. Capped runs set
+  // their unprocessed pixels as described at set_max_iterations.
+  imaging::ImagePositionIndex completed_iterations() const;
+  // Whether the last run was stopped by the deadline or by the cancellation
+  // token, both checked as the run starts and before each SE step; its
+  // output is then partial, as described at completed_iterations.
+  bool interrupted() const;
+  // Runs are interrupted once '*cancelled' is set, possibly by another
+  // thread. Defaults to NULL, which sets no token.
+  bool set_cancellation_token(const std::atomic<bool> *cancelled);
+  // Time, in microseconds as 'start' and 'end' of Calculate, after which
+  // runs are interrupted. Defaults to 0, which sets no deadline.
+  bool set_deadline(const double deadline);
+  // Number of threads used by engines detecting the border from the
+  // candidate list, which is split in contiguous chunks run by a pool kept
+  // along the transform. Defaults to 1.
+  bool set_threads(const unsigned threads);
+  unsigned threads() const;
+  // Brings 'output', as calculated for 'se' by Calculate, up to date after
+  // the pixels of 'image' within 'dirty' changed. Only 'dirty' grown by the
+  // reach of one iteration times the number of affected iterations is
+  // recomputed, on a crop of 'image' padded by as much again; the number is
+  // doubled while some recomputed value may have been cut by the crop, so
+  // 'output' matches a full recalculation. Dilations by more than one SE
+  // depend on the SE order and are recomputed over the whole image.
+  bool Update(const imaging::binary::Image &image,
+      const std::vector<imaging::binary::StructuringElement*> &se,
+      const imaging::BoundingBox &dirty, imaging::grayscale::Image *output);
  protected:
   bool ActualAlgorithm(imaging::grayscale::Image **output_image);
+  // Clears the data of a run; temporary images are only released by the
+  // destructor.
   virtual bool clear();
   virtual bool CustomInitialize();
   virtual bool Debug();
@@ -346,22 +615,78 @@ class Transform {
       const imaging::SEIndex current_se_index,
       const std::vector<imaging::ImagePositionIndex> &current_se_indexes) = 0;
   bool EnqueueCandidateNode(const imaging::ImagePositionIndex &position);
-  bool InitializeCandidateData(const imaging::binary::Image &image);
+  // Whether there is any candidate left to be checked.
+  virtual bool HasCandidates() const;
+  // Appends the header node to every candidate vector.
+  bool InitializeCandidateHeader();
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
   virtual bool InitialCandidatePositionFound(
       const imaging::binary::Image &image,
       const imaging::ImagePositionIndex &image_position,
       const imaging::Position &value) = 0;
   bool InitializeCounters();
-  bool InitializeSEData(
-      const std::vector< std::vector<imaging::Position> > &vectorized_se);
+  bool InitializeSEData(const TransformPlan &plan);
+  // Same as above, with linear indexes of an image whose lengths in linear
+  // index units are 'index_lengths'.
+  bool InitializeSEData(const TransformPlan &plan,
+      const imaging::Position &index_lengths);
+  // Appends 'current', a pixel of 'image' at the candidate region, as a
+  // new candidate node.
+  bool InsertInitialCandidate(const imaging::binary::Image &image,
+      const imaging::Position &current);
   virtual bool InsertNewCandidateFromBorder(
       imaging::grayscale::Image **output_image) = 0;
+  bool linear_position(const imaging::ImagePositionIndex &linear_index,
+      imaging::ImagePositionIndex *value) const;
+  // Whether candidates are the node lists filled pixel by pixel by
+  // InitializeCandidateData, so a single scan may fill them for an erosion
+  // and a dilation at once.
+  virtual bool ListsCandidates() const;
+  // Sets the pixels of the candidate region still unprocessed by the run as
+  // 'level'.
+  virtual bool MarkUnprocessed(const imaging::ImagePositionIndex level,
+      imaging::grayscale::Image **output_image);
+  // Calculates the linear index at Y_ of the candidate 'image_position'
+  // added ('sum') or subtracted by the U element 'element_index'. 'valid' is
+  // set to false if such neighbor lies outside the image.
+  inline bool NeighborIndex(const imaging::ImagePositionIndex &image_position,
+      const imaging::ImagePositionIndex &element_index, const bool sum,
+      bool *valid, imaging::ImagePositionIndex *neighbor) const;
   bool position(const imaging::Position &image_position,
       imaging::ImagePositionIndex *value) const;
+  // Decodes the coordinates at Y_ of the candidate 'position_index' from its
+  // linear index.
   bool position(const imaging::ImagePositionIndex &position_index,
       imaging::Position *value) const;
+  // Same as Prepare for engines keeping the image and the levels themselves:
+  // neither Y_ nor an output image is allocated, the candidate region is
+  // 'size', and linear indexes follow an image of 'size' without aligned
+  // rows.
+  bool PrepareSparse(const TransformPlan &plan, const imaging::Size &size,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border,
+      double *start);
+  // Reserves the candidate vectors for the header and every candidate of Y_.
+  bool ReserveCandidates();
+  // Removes the current border from Y_, setting its elements at the output
+  // image to the current iteration.
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
   virtual bool RemoveCandidateNode(
       const imaging::ImagePositionIndex &image_position);
+  // Keeps '*buffer' if it already has 'size', allocating it otherwise.
+  template< class T, class V >
+  static inline bool ReserveBuffer(const imaging::Size &size,
+      const V default_value, T **buffer);
   imaging::SEIndex u_cardinality() const;
 
 
@@ -379,19 +704,32 @@ class Transform {
       *algorithm_number_of_elements_in_border_;
   std::vector<imaging::ImagePositionIndex> border_;
   imaging::ImagePositionIndex border_counter_;
+  std::vector<imaging::ImagePositionIndex> candidate_index_;
   std::vector<bool> candidate_initialized_;
-  imaging::grayscale::_internal::NumericalMatrix<imaging::ImagePositionIndex>*
-      candidate_matrix_;
+  // Whether every U neighbor of the candidate lies inside the image.
+  std::vector<bool> candidate_interior_;
+  // Candidates of the list at Y_, whose node is their rank plus one, as they
+  // are inserted in linear index order.
+  imaging::binary::_internal::RankBitMatrix* candidate_matrix_;
   std::vector<imaging::ImagePositionIndex> candidate_next_;
-  std::vector<imaging::Position> candidate_position_;
   std::vector<imaging::ImagePositionIndex> candidate_previous_;
+  imaging::BoundingBox candidate_region_; // input image region at Y_
   bool debug_;
   std::ostream &debug_output_;
+  // Candidates disqualified by each U element at the border detection.
+  std::vector<imaging::ImagePositionIndex> element_failures_;
+  imaging::grayscale::Image* guard_band_output_;
   std::vector<imaging::ImagePositionIndex> se_cardinality_;
   std::vector< std::vector< imaging::ImagePositionIndex > > se_elements_;
   imaging::ImagePositionIndex se_iteration_;
   std::vector<imaging::Position> u_elements_;
+  std::vector<long> u_offsets_; // linear index offset of each U element at Y_
+  imaging::Position u_reach_; // maximum absolute U coordinate by dimension
   imaging::binary::Image* Y_;
+  // Lengths of Y_ in linear index units, that is, with the aligned row
+  // length at dimension 0, which decode the coordinates of a candidate; the
+  // lengths of the image itself for runs set up by PrepareSparse.
+  imaging::Position y_index_lengths_;
  private:
   Transform()
       : algorithm_determinate_border_comparison_counter_(NULL),
@@ -401,17 +739,104 @@ class Transform {
         algorithm_remove_candidate_memory_access_counter_(NULL),
         algorithm_number_of_elements_in_border_(NULL),
         border_counter_(0), candidate_matrix_(NULL), debug_(false),
-        debug_output_(std::cout), se_iteration_(0), Y_(NULL),
-        regular_removal_(false), true_for_erosion_(true),
+        debug_output_(std::cout), guard_band_output_(NULL),
+        se_iteration_(0), Y_(NULL), adaptive_element_order_(false),
+        cancelled_(NULL), completed_iterations_(0),
+        deadline_(0), guard_band_(false), interrupted_(false),
+        max_iterations_(0), ordered_by_cost_(false), pool_(NULL),
+        regular_removal_(false), threads_(1), true_for_erosion_(true),
         use_candidate_matrix_(false) {}
-
+  // Pieces of Execute, which TiledTransform also drives step by step: Prepare
+  // sets up a run up to the candidate scan, PrepareCandidates scans them,
+  // BeginIteration starts a new iteration and Finish writes the output and
+  // clears the run data.
+  bool BeginIteration();
+  bool Finish(imaging::grayscale::Image *output);
+  bool Prepare(const TransformPlan &plan, const imaging::binary::Image &image,
+      imaging::grayscale::Image *output,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border,
+      double *start);
+  bool PrepareCandidates();
+  // Sets the counters of the run, which must be empty.
+  bool SetCounters(
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border);
+  // Checks the deadline and the cancellation token, setting interrupted_.
+  bool Interrupted();
+  // Tests the candidates of chunk 'chunk' of thread_candidates_, skipping
+  // the removed ones, storing its border, comparisons, removed nodes and
+  // result at the respective thread_ vectors.
+  bool DetectBorderChunk(const unsigned chunk,
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  // Detects the border by testing each candidate against its neighbors at
+  // Y_, which is only read, with the threads of pool_. The border found is
+  // appended to border_ in candidate list order.
+  bool DetectBorderInParallel(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  // Detects the border of a step in parallel for the engines removing
+  // candidates from their list if there is a pool, with DetectBorder
+  // otherwise.
+  bool DetectStepBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+
+  bool adaptive_element_order_;
+  const std::atomic<bool>* cancelled_;
+  imaging::ImagePositionIndex completed_iterations_;
+  double deadline_;
+  bool guard_band_;
+  bool interrupted_;
+  imaging::ImagePositionIndex max_iterations_;
+  bool ordered_by_cost_;
+  imaging::WorkStealingPool* pool_; // workers besides the calling thread
+  imaging::RandomEngine random_;
+  imaging::RandomEngine random_seed_; // random_ at the start of a run
   bool regular_removal_;
+  std::vector< std::vector<imaging::ImagePositionIndex> > thread_border_;
+  // Nodes enqueued while there is a pool, in list order, including the ones
+  // since removed, which are dropped once they are most of them.
+  std::vector<imaging::ImagePositionIndex> thread_candidates_;
+  std::vector<imaging::ImagePositionIndex> thread_comparisons_;
+  std::vector< std::vector<imaging::ImagePositionIndex> > thread_failures_;
+  std::vector<char> thread_ok_; // not vector<bool>: written concurrently
+  std::vector<imaging::ImagePositionIndex> thread_removed_;
+  unsigned threads_;
   bool true_for_erosion_;
   bool use_candidate_matrix_;
+  friend class FusedTransform;
+  friend class StreamTransform;
+  friend class TiledTransform;
   DISALLOW_COPY_AND_ASSIGN(Transform);
 }; // imaging::binary::morphology::Transform
 
 
+// Creates an engine, such as the ones run by the tiled and batch transforms.
+typedef imaging::binary::morphology::Transform* (*TransformFactory)();
+
+
 class DilationTransform : public Transform {
  public:
   DilationTransform(const bool use_candidate_matrix, const bool regular_removal,
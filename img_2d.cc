@@ -16,16 +16,54 @@
 
 // This file contains the implementation of 2D image file handlers.
 
+#include <cctype>
+
 #include <Magick++.h>
 
 #include "img_2d.h"
 
+namespace {
+
+// Padding of the images for dilations, as a function of the image lengths.
+long DilationPadding(const long width, const long height) {
+  const long maximum = width < height ? height : width;
+  return maximum < 100 ? maximum : 15*maximum/1000;
+}
+
+// Reads the next number of a PBM header, skipping blanks and comments.
+bool ReadHeaderNumber(std::istream &input, long *value) {
+  if (value == NULL) return false;
+  int c = 0;
+  while (input.good()) {
+    c = input.peek();
+    if (c == '#') {
+      while (input.good() && input.get() != '\n') {}
+    } else if (std::isspace(c)) {
+      input.get();
+    } else {
+      break;
+    }
+  }
+  input >> *value;
+  return !input.fail();
+}
+
+// Gray level of 'value' as shaded by SaveGrayscaleImage.
+char GrayLevel(const int value) {
+  const int levels = 256;
+  int level = value+1; // adjustment of pixel level
+  if (level < 0) level = 0;
+  if (level > levels-1) level = levels-1;
+  return static_cast<char>(static_cast<unsigned char>(level));
+}
+
+} // namespace
+
 bool bidimensional::LoadBinaryImage(const std::string &file_path,
                                     imaging::binary::Image **image_d,
                                     imaging::binary::Image **image_e) {
   if (image_d == NULL || image_e == NULL) return false;
   if (*image_d != NULL || *image_e != NULL) return false;
-  long maximum = 0;
   char n = imaging::Dimension::number();
   if (n == 0) n = imaging::Dimension::Set(2);
   if (n != 2) return false;
@@ -45,8 +83,7 @@ bool bidimensional::LoadBinaryImage(const std::string &file_path,
   // Set image size.
   const long real_width = static_cast<long>(original_image.columns());
   const long real_height = static_cast<long>(original_image.rows());
-  maximum = real_width < real_height ? real_height : real_width;
-  padding = maximum < 100 ? maximum : 15*maximum/1000;
+  padding = ::DilationPadding(real_width, real_height);
   ok_so_far = external_upper_d.set_value(0, real_width+2*padding);
   if (!ok_so_far) return ok_so_far;
   ok_so_far = external_upper_d.set_value(1, real_height+2*padding);
@@ -57,37 +94,45 @@ bool bidimensional::LoadBinaryImage(const std::string &file_path,
   if (!ok_so_far) return ok_so_far;
   imaging::Size size_d(external_upper_d, padding);
   imaging::Size size_e(external_upper_e);
-  imaging::binary::Image output_d(size_d, true);
-  imaging::binary::Image output_e(size_e, true);
+  // The images are filled in place, so no copy of them is ever made.
+  *image_d = new imaging::binary::Image(size_d, true);
+  *image_e = new imaging::binary::Image(size_e, true);
+  if (*image_d == NULL || *image_e == NULL) ok_so_far = false;
   imaging::PositionIterator iterator(size_e);
-  ok_so_far = iterator.begin();
-  if (!ok_so_far) return ok_so_far;
+  if (ok_so_far) ok_so_far = iterator.begin();
   // Copy image data.
-  do {
-    const imaging::Position &p = iterator.value();
-    ok_so_far = p.value(0, &x);
-    if (!ok_so_far) continue;
-    ok_so_far = p.value(1, &y);
-    if (!ok_so_far) continue;
-    u_x = static_cast<unsigned long>(x);
-    u_y = static_cast<unsigned long>(y);
-    value = original_image.pixelColor(u_x, u_y);
-    position_value = value.mono();
-    if (!position_value) continue;
-    ok_so_far = output_e.set_value(p, position_value);
-    if (!ok_so_far) continue;
-    ok_so_far = position_d.set_value(0, x+padding);
-    if (!ok_so_far) continue;
-    ok_so_far = position_d.set_value(1, y+padding);
-    if (!ok_so_far) continue;
-    ok_so_far = output_d.set_value(position_d, position_value);
-  } while (ok_so_far && iterator.iterate());
-  if (!iterator.IsFinished()) ok_so_far = false;
-  if (!ok_so_far) return ok_so_far;
-  *image_d = new imaging::binary::Image(output_d);
-  if (*image_d == NULL) return false;
-  *image_e = new imaging::binary::Image(output_e);
-  if (*image_e == NULL) return false;
+  if (ok_so_far) {
+    do {
+      const imaging::Position &p = iterator.value();
+      ok_so_far = p.value(0, &x);
+      if (!ok_so_far) continue;
+      ok_so_far = p.value(1, &y);
+      if (!ok_so_far) continue;
+      u_x = static_cast<unsigned long>(x);
+      u_y = static_cast<unsigned long>(y);
+      value = original_image.pixelColor(u_x, u_y);
+      position_value = value.mono();
+      if (!position_value) continue;
+      ok_so_far = (*image_e)->set_value(p, position_value);
+      if (!ok_so_far) continue;
+      ok_so_far = position_d.set_value(0, x+padding);
+      if (!ok_so_far) continue;
+      ok_so_far = position_d.set_value(1, y+padding);
+      if (!ok_so_far) continue;
+      ok_so_far = (*image_d)->set_value(position_d, position_value);
+    } while (ok_so_far && iterator.iterate());
+    if (!iterator.IsFinished()) ok_so_far = false;
+  }
+  if (ok_so_far) return ok_so_far;
+  // Both images are left as NULL on failure.
+  if (*image_d != NULL) {
+    delete *image_d;
+    *image_d = NULL;
+  }
+  if (*image_e != NULL) {
+    delete *image_e;
+    *image_e = NULL;
+  }
   return ok_so_far;
 }
 
@@ -224,3 +269,166 @@ bool bidimensional::SaveGrayscaleImage(const std::string &file_path,
   output.write(file_path);
   return ok_so_far;
 }
+
+// bidimensional::BinaryImageRowSource
+
+bool bidimensional::BinaryImageRowSource::Open(const std::string &file_path,
+                                               const bool padded) {
+  char n = imaging::Dimension::number();
+  if (n == 0) n = imaging::Dimension::Set(2);
+  if (n != 2) return false;
+  if (input_.is_open()) return false;
+  std::string magic;
+  bool ok_so_far = true;
+  long real_height = 0;
+  long real_width = 0;
+  imaging::Position upper;
+  input_.open(file_path.c_str(), std::ifstream::in | std::ifstream::binary);
+  if (!input_.is_open()) return false;
+  input_ >> magic;
+  raw_ = (magic == "P4");
+  if (!raw_ && magic != "P1") ok_so_far = false;
+  if (ok_so_far) ok_so_far = ::ReadHeaderNumber(input_, &real_width);
+  if (ok_so_far) ok_so_far = ::ReadHeaderNumber(input_, &real_height);
+  if (ok_so_far && (real_width < 1 || real_height < 1)) ok_so_far = false;
+  // A single blank ends the header of raw files.
+  if (ok_so_far && raw_ && !std::isspace(input_.get())) ok_so_far = false;
+  if (!ok_so_far) {
+    input_.close();
+    return ok_so_far;
+  }
+  next_row_ = 0;
+  padding_ = padded ? ::DilationPadding(real_width, real_height) : 0;
+  row_.assign(static_cast<size_t>(real_width), false);
+  ok_so_far = upper.set_value(0, real_width+2*padding_);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = upper.set_value(1, real_height+2*padding_);
+  if (!ok_so_far) return ok_so_far;
+  size_ = imaging::Size(upper, padding_);
+  return ok_so_far;
+}
+
+bool bidimensional::BinaryImageRowSource::Read(const long first,
+                                               const long count,
+                                               const long target,
+                                               imaging::binary::Image *image) {
+  if (image == NULL || !input_.is_open()) return false;
+  if (image->Length(0) != size_.Length(0)) return false;
+  if (first < 0 || count < 1 || first+count > size_.Length(1)) return false;
+  if (target < 0 || target+count > image->Length(1)) return false;
+  bool ok_so_far = true;
+  imaging::Position p;
+  bool position_value = false;
+  const long real_height = size_.Length(1)-2*padding_;
+  const long real_width = size_.Length(0)-2*padding_;
+  long x = 0;
+  long y = 0;
+  for (y = 0; ok_so_far && y < count; ++y) {
+    const long real_y = first+y-padding_;
+    const bool inside = (real_y >= 0 && real_y < real_height);
+    // Rows already decoded can not be read again.
+    if (inside && real_y < next_row_) ok_so_far = false;
+    while (ok_so_far && inside && next_row_ <= real_y) ok_so_far = DecodeRow();
+    if (ok_so_far) ok_so_far = p.set_value(1, target+y);
+    for (x = 0; ok_so_far && x < size_.Length(0); ++x) {
+      const long real_x = x-padding_;
+      position_value = inside && real_x >= 0 && real_x < real_width
+          && row_.at(static_cast<size_t>(real_x));
+      ok_so_far = p.set_value(0, x);
+      if (!ok_so_far) continue;
+      ok_so_far = image->set_value(p, position_value);
+    }
+  }
+  return ok_so_far;
+}
+
+const imaging::Size& bidimensional::BinaryImageRowSource::size() const {
+  return size_;
+}
+
+bool bidimensional::BinaryImageRowSource::DecodeRow() {
+  int c = 0;
+  std::string packed;
+  const size_t width = row_.size();
+  size_t x = 0;
+  // Black pixels, set bits, are the background, as for LoadBinaryImage.
+  if (raw_) {
+    packed.resize((width+7)/8);
+    input_.read(&packed[0], static_cast<std::streamsize>(packed.size()));
+    if (!input_.good()) return false;
+    for (x = 0; x < width; ++x) {
+      row_.at(x) = ((packed.at(x/8) >> (7-x%8)) & 1) == 0;
+    }
+  } else {
+    for (x = 0; x < width; ++x) {
+      do {
+        c = input_.get();
+      } while (input_.good() && std::isspace(c));
+      if (!input_.good() || (c != '0' && c != '1')) return false;
+      row_.at(x) = (c == '0');
+    }
+  }
+  ++next_row_;
+  return true;
+}
+
+// bidimensional::GrayscaleImageRowSink
+
+bool bidimensional::GrayscaleImageRowSink::Open(const std::string &file_path,
+                                                const imaging::Size &size) {
+  char n = imaging::Dimension::number();
+  if (n != 2) return false;
+  if (output_.is_open()) return false;
+  const long padding = size.padding();
+  if (padding < 0) return false;
+  if (2*padding >= size.Length(0)) return false;
+  if (2*padding >= size.Length(1)) return false;
+  size_ = size;
+  next_row_ = 0;
+  output_.open(file_path.c_str(), std::ofstream::out | std::ofstream::binary);
+  if (!output_.is_open()) return false;
+  output_ << "P5\n" << size.Length(0)-2*padding << " "
+          << size.Length(1)-2*padding << "\n255\n";
+  return output_.good();
+}
+
+bool bidimensional::GrayscaleImageRowSink::Write(
+    const long first, const long count, const long source,
+    const imaging::grayscale::Image &image) {
+  if (!output_.is_open()) return false;
+  if (first != next_row_ || count < 1) return false;
+  if (first+count > size_.Length(1)) return false;
+  if (source < 0 || source+count > image.Length(1)) return false;
+  if (image.Length(0) != size_.Length(0)) return false;
+  bool ok_so_far = true;
+  imaging::Position p;
+  const long padding = size_.padding();
+  std::string row;
+  int position_value = 0;
+  long x = 0;
+  long y = 0;
+  const long width = size_.Length(0);
+  const long height = size_.Length(1);
+  row.reserve(static_cast<size_t>(width-2*padding));
+  for (y = first; ok_so_far && y < first+count; ++y) {
+    if (y < padding || y >= height-padding) continue;
+    row.clear();
+    ok_so_far = p.set_value(1, source+y-first);
+    for (x = padding; ok_so_far && x < width-padding; ++x) {
+      ok_so_far = p.set_value(0, x);
+      if (!ok_so_far) continue;
+      position_value = 0;
+      ok_so_far = image.value(p, &position_value);
+      if (!ok_so_far) continue;
+      row.push_back(::GrayLevel(position_value));
+    }
+    if (!ok_so_far) continue;
+    output_.write(row.data(), static_cast<std::streamsize>(row.size()));
+    if (!output_.good()) ok_so_far = false;
+  }
+  if (!ok_so_far) return ok_so_far;
+  next_row_ = first+count;
+  // The file is complete once its last row is written.
+  if (next_row_ == height) output_.close();
+  return ok_so_far;
+}
@@ -19,9 +19,12 @@
 #ifndef IMG_2D_H_
 #define IMG_2D_H_
 
+#include <fstream>
 #include <string>
+#include <vector>
 
 #include "img.h"
+#include "stream.h"
 
 namespace bidimensional {
 
@@ -41,6 +44,54 @@ namespace bidimensional {
   bool SaveGrayscaleImage(const std::string &file_path, const int pixel_size,
                           const imaging::grayscale::Image &image);
 
+  // Reads a binary PBM file, plain (P1) or raw (P4), a row at a time, so
+  // only the rows of the strip being read are decoded into memory. Rows
+  // must be read in increasing order, as by StreamTransform; the rows
+  // skipped are decoded and dropped. Other formats can not be decoded by
+  // rows and are rejected by Open, so they must be converted to PBM first.
+  // If 'padded' is set, the image is padded as the one for dilations of
+  // LoadBinaryImage.
+  class BinaryImageRowSource
+      : public imaging::binary::morphology::RowSource {
+   public:
+    BinaryImageRowSource() : next_row_(0), padding_(0), raw_(false) {}
+    virtual ~BinaryImageRowSource() {}
+    bool Open(const std::string &file_path, const bool padded);
+    virtual bool Read(const long first, const long count, const long target,
+        imaging::binary::Image *image);
+    virtual const imaging::Size& size() const;
+   private:
+    // Decodes the next row of the file into row_.
+    bool DecodeRow();
+
+    std::ifstream input_;
+    long next_row_; // row of the file decoded next
+    long padding_;
+    bool raw_;
+    std::vector<bool> row_; // foreground of the last row decoded
+    imaging::Size size_;
+
+    DISALLOW_COPY_AND_ASSIGN(BinaryImageRowSource);
+  }; // bidimensional::BinaryImageRowSource
+
+  // Writes a grayscale image as a binary PGM file a strip of rows at a
+  // time, shaded as by SaveGrayscaleImage and without the padding of
+  // 'size', the size of the whole image.
+  class GrayscaleImageRowSink : public imaging::binary::morphology::RowSink {
+   public:
+    GrayscaleImageRowSink() : next_row_(0) {}
+    virtual ~GrayscaleImageRowSink() {}
+    bool Open(const std::string &file_path, const imaging::Size &size);
+    virtual bool Write(const long first, const long count, const long source,
+        const imaging::grayscale::Image &image);
+   private:
+    long next_row_;
+    std::ofstream output_;
+    imaging::Size size_;
+
+    DISALLOW_COPY_AND_ASSIGN(GrayscaleImageRowSink);
+  }; // bidimensional::GrayscaleImageRowSink
+
 } // namespace bidimensional
 
 #endif // IMG_2D_H_
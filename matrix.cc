@@ -17,6 +17,7 @@
 // This file contains the implementation of matrix border erosion and dilation.
 
 #include "matrix.h"
+#include "img-inl.h"
 
 // imaging::binary::morphology::MatrixDilation
 
@@ -29,23 +30,18 @@ bool imaging::binary::morphology::MatrixDilation::clear() {
 }
 
 bool imaging::binary::morphology::MatrixDilation::CustomInitialize() {
-  imaging::SEIndex i = 0;
-  std::vector<imaging::ImagePositionIndex> default_values;
-  std::vector<imaging::ImagePositionIndex> next_link_default;
+  if (Y_ == NULL) return false;
+  const imaging::ImagePositionIndex foreground = Y_->Count();
+  // The header and every background pixel of the candidate region.
+  const imaging::ImagePositionIndex nodes =
+      1+candidate_region_.capacity()-foreground;
   algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-      += 3;
+      += nodes*(1+3*u_cardinality());
   // Initialize doubly-linked lists' vectors.
-  default_values.push_back(imaging::HEADER);
-  next_link_default.push_back(u_cardinality());
-  for (i = 0; i < u_cardinality(); ++i) {
-    algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-        += 3;
-    link_next_link_.push_back(next_link_default);
-    link_next_.push_back(default_values);
-    link_previous_.push_back(default_values);
-  }
-  // Initialize next link node's vectors.
-  candidate_next_link_.push_back(u_cardinality());
+  candidate_next_link_.assign(nodes, u_cardinality());
+  link_next_.assign(LinkIndex(nodes, 0), imaging::HEADER);
+  link_next_link_.assign(LinkIndex(nodes, 0), u_cardinality());
+  link_previous_.assign(LinkIndex(nodes, 0), imaging::HEADER);
   return true;
 }
 
@@ -67,46 +63,34 @@ bool imaging::binary::morphology::MatrixDilation::DetectBorder(
         current_se_indexes.at(i);
     const imaging::ImagePositionIndex element_index =
         current_se_vector.at(current_element_index);
-    const std::vector<imaging::ImagePositionIndex> &current_element_next =
-        link_next_.at(element_index);
-    first = current_element_next.at(imaging::HEADER);
+    const size_t header = LinkIndex(imaging::HEADER, element_index);
+    first = link_next_.at(header);
     while (ok_so_far && first != imaging::HEADER) {
       ok_so_far = RemoveCandidateNode(first);
       if (!ok_so_far) continue;
       border_.at(border_counter_) = first;
       ++border_counter_;
-      first = current_element_next.at(imaging::HEADER);
+      first = link_next_.at(header);
     }
   }
   return ok_so_far;
 }
 
 bool imaging::binary::morphology::MatrixDilation::InitialCandidatePositionFound(
-    const imaging::binary::Image &image,
+    const imaging::binary::Image &/*image*/,
     const imaging::ImagePositionIndex &image_position,
-    const imaging::Position &value) {
+    const imaging::Position &/*value*/) {
   imaging::SEIndex i = 0;
-  imaging::Position neighbor;
+  imaging::ImagePositionIndex neighbor = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  // Include new vector positions related to the new position found.
-  algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-      += 1;
-  candidate_next_link_.push_back(u_cardinality());
-  for (i = 0; i < u_cardinality(); ++i) {
-    algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-        += 3;
-    (link_next_link_.at(i)).push_back(u_cardinality());
-    (link_next_.at(i)).push_back(imaging::HEADER);
-    (link_previous_.at(i)).push_back(imaging::HEADER);
-  }
+  bool valid = false;
   // Verify new link nodes.
   for (i = 0; ok_so_far && i < u_cardinality(); ++i) {
-    const imaging::Position &delta = u_elements_.at(i);
     algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_) += 1;
-    ok_so_far = value.Subtract(delta, &neighbor);
+    ok_so_far = NeighborIndex(image_position, i, false, &valid, &neighbor);
     if (!ok_so_far) continue;
-    if (image.IsPositionValid(neighbor)) {
+    if (valid) {
       ok_so_far = Y_->value(neighbor, &position_value);
       if (!ok_so_far) continue;
       if (!position_value) continue;
@@ -126,19 +110,19 @@ bool imaging::binary::morphology::MatrixDilation::InsertNewCandidateFromBorder(
   imaging::ImagePositionIndex node = 0;
   int one_less_than_the_minimum_value = -1;
   bool ok_so_far = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
   bool position_value = true;
+  bool valid = false;
   for (i = 0; ok_so_far && i < border_counter_; ++i) {
     // Update the sparse matrix by including new Candidate and Link nodes
     // at 'candidates'.
-    const imaging::Position &p = candidate_position_.at(border_.at(i));
+    const imaging::ImagePositionIndex &p = border_.at(i);
     for (j = 0; ok_so_far && j < u_cardinality(); ++j) {
-      const imaging::Position &delta = u_elements_.at(j);
       algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_)
           += 1;
-      ok_so_far = p.Sum(delta, &target);
+      ok_so_far = NeighborIndex(p, j, true, &valid, &target);
       if (!ok_so_far) continue;
-      if (!Y_->IsPositionValid(target)) continue;
+      if (!valid) continue;
       position_value = true;
       ok_so_far = Y_->value(target, &position_value);
       if (!ok_so_far) continue;
@@ -147,7 +131,7 @@ bool imaging::binary::morphology::MatrixDilation::InsertNewCandidateFromBorder(
       ok_so_far = (*output_image)->value(target, &marked_value);
       if (!ok_so_far) continue;
       if (marked_value > one_less_than_the_minimum_value) continue;
-      ok_so_far = position(target, &node);
+      ok_so_far = linear_position(target, &node);
       if (!ok_so_far) continue;
       ok_so_far = LinkingProcedure(node, j);
       if (!ok_so_far) continue;
@@ -168,21 +152,28 @@ bool imaging::binary::morphology::MatrixDilation::RemoveCandidateNode(
   return Transform::RemoveCandidateNode(image_position);
 }
 
+inline size_t imaging::binary::morphology::MatrixDilation::LinkIndex(
+    const imaging::ImagePositionIndex &image_position,
+    const imaging::SEIndex &link_se_index) const {
+  return static_cast<size_t>(image_position)*u_cardinality()+link_se_index;
+}
+
 inline bool imaging::binary::morphology::MatrixDilation::LinkingProcedure(
     const imaging::ImagePositionIndex &image_position,
     const imaging::SEIndex &link_se_index) {
-  const imaging::ImagePositionIndex previous =
-      (link_previous_.at(link_se_index)).at(imaging::HEADER);
-  const imaging::SEIndex &next_se = candidate_next_link_.at(image_position);
+  const size_t header = LinkIndex(imaging::HEADER, link_se_index);
+  const size_t node = LinkIndex(image_position, link_se_index);
+  const imaging::ImagePositionIndex previous = link_previous_.at(header);
+  const imaging::SEIndex next_se = candidate_next_link_.at(image_position);
   algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
       += 6;
   // Related to linked node.
-  (link_next_.at(link_se_index)).at(image_position) = imaging::HEADER;
-  (link_previous_.at(link_se_index)).at(image_position) = previous;
-  (link_next_.at(link_se_index)).at(previous) = image_position;
-  (link_previous_.at(link_se_index)).at(imaging::HEADER) = image_position;
+  link_next_.at(node) = imaging::HEADER;
+  link_previous_.at(node) = previous;
+  link_next_.at(LinkIndex(previous, link_se_index)) = image_position;
+  link_previous_.at(header) = image_position;
   // Related to candidate node.
-  (link_next_link_.at(link_se_index)).at(image_position) = next_se;
+  link_next_link_.at(node) = next_se;
   candidate_next_link_.at(image_position) = link_se_index;
   return EnqueueCandidateNode(image_position);
 }
@@ -190,17 +181,17 @@ inline bool imaging::binary::morphology::MatrixDilation::LinkingProcedure(
 inline bool imaging::binary::morphology::MatrixDilation::RemoveLinkNode(
     const imaging::ImagePositionIndex &image_position,
     const imaging::SEIndex &link_se_index) {
-  if (link_se_index == u_cardinality()) return true;
-  const imaging::ImagePositionIndex next =
-      (link_next_.at(link_se_index)).at(image_position);
-  const imaging::ImagePositionIndex previous =
-      (link_previous_.at(link_se_index)).at(image_position);
-  const imaging::ImagePositionIndex next_link =
-      (link_next_link_.at(link_se_index)).at(image_position);
-  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_) += 2;
-  (link_previous_.at(link_se_index)).at(next) = previous;
-  (link_next_.at(link_se_index)).at(previous) = next;
-  return RemoveLinkNode(image_position, next_link);
+  imaging::SEIndex link = link_se_index;
+  while (link != u_cardinality()) {
+    const size_t node = LinkIndex(image_position, link);
+    const imaging::ImagePositionIndex next = link_next_.at(node);
+    const imaging::ImagePositionIndex previous = link_previous_.at(node);
+    algorithm_remove_candidate_memory_access_counter_->at(se_iteration_) += 2;
+    link_previous_.at(LinkIndex(next, link)) = previous;
+    link_next_.at(LinkIndex(previous, link)) = next;
+    link = link_next_link_.at(node);
+  }
+  return true;
 }
 
 // imaging::binary::morphology::MatrixErosion
@@ -214,23 +205,17 @@ bool imaging::binary::morphology::MatrixErosion::clear() {
 }
 
 bool imaging::binary::morphology::MatrixErosion::CustomInitialize() {
-  imaging::SEIndex i = 0;
-  std::vector<imaging::ImagePositionIndex> default_values;
-  std::vector<imaging::ImagePositionIndex> next_link_default;
+  if (Y_ == NULL) return false;
+  const imaging::ImagePositionIndex foreground = Y_->Count();
+  // The header and every foreground pixel of the candidate region.
+  const imaging::ImagePositionIndex nodes = 1+foreground;
   algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-      += 3;
+      += nodes*(1+3*u_cardinality());
   // Initialize doubly-linked lists' vectors.
-  default_values.push_back(imaging::HEADER);
-  next_link_default.push_back(u_cardinality());
-  for (i = 0; i < u_cardinality(); ++i) {
-    algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-        += 3;
-    link_next_link_.push_back(next_link_default);
-    link_next_.push_back(default_values);
-    link_previous_.push_back(default_values);
-  }
-  // Initialize next link node's vectors.
-  candidate_next_link_.push_back(u_cardinality());
+  candidate_next_link_.assign(nodes, u_cardinality());
+  link_next_.assign(LinkIndex(nodes, 0), imaging::HEADER);
+  link_next_link_.assign(LinkIndex(nodes, 0), u_cardinality());
+  link_previous_.assign(LinkIndex(nodes, 0), imaging::HEADER);
   return true;
 }
 
@@ -252,46 +237,34 @@ bool imaging::binary::morphology::MatrixErosion::DetectBorder(
         current_se_indexes.at(i);
     const imaging::ImagePositionIndex element_index =
         current_se_vector.at(current_element_index);
-    const std::vector<imaging::ImagePositionIndex> &current_element_next =
-        link_next_.at(element_index);
-    first = current_element_next.at(imaging::HEADER);
+    const size_t header = LinkIndex(imaging::HEADER, element_index);
+    first = link_next_.at(header);
     while (ok_so_far && first != imaging::HEADER) {
       ok_so_far = RemoveCandidateNode(first);
       if (!ok_so_far) continue;
       border_.at(border_counter_) = first;
       ++border_counter_;
-      first = current_element_next.at(imaging::HEADER);
+      first = link_next_.at(header);
     }
   }
   return ok_so_far;
 }
 
 bool imaging::binary::morphology::MatrixErosion::InitialCandidatePositionFound(
-    const imaging::binary::Image &image,
+    const imaging::binary::Image &/*image*/,
     const imaging::ImagePositionIndex &image_position,
-    const imaging::Position &value) {
+    const imaging::Position &/*value*/) {
   imaging::SEIndex i = 0;
-  imaging::Position neighbor;
+  imaging::ImagePositionIndex neighbor = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  // Include new vector positions related to the new position found.
-  algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-      += 1;
-  candidate_next_link_.push_back(u_cardinality());
-  for (i = 0; i < u_cardinality(); ++i) {
-    algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
-        += 3;
-    (link_next_link_.at(i)).push_back(u_cardinality());
-    (link_next_.at(i)).push_back(imaging::HEADER);
-    (link_previous_.at(i)).push_back(imaging::HEADER);
-  }
+  bool valid = false;
   // Verify new link nodes.
   for (i = 0; ok_so_far && i < u_cardinality(); ++i) {
-    const imaging::Position &delta = u_elements_.at(i);
     algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_) += 1;
-    ok_so_far = value.Sum(delta, &neighbor);
+    ok_so_far = NeighborIndex(image_position, i, true, &valid, &neighbor);
     if (!ok_so_far) continue;
-    if (image.IsPositionValid(neighbor)) {
+    if (valid) {
       ok_so_far = Y_->value(neighbor, &position_value);
       if (!ok_so_far) continue;
       if (position_value) continue;
@@ -309,19 +282,19 @@ bool imaging::binary::morphology::MatrixErosion::InsertNewCandidateFromBorder(
   imaging::ImagePositionIndex node = 0;
   int one_less_than_the_minimum_value = 0;
   bool ok_so_far = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
   bool position_value = true;
+  bool valid = false;
   for (i = 0; ok_so_far && i < border_counter_; ++i) {
     // Update the sparse matrix by including new Candidate and Link nodes
     // at 'candidates'.
-    const imaging::Position &p = candidate_position_.at(border_.at(i));
+    const imaging::ImagePositionIndex &p = border_.at(i);
     for (j = 0; ok_so_far && j < u_cardinality(); ++j) {
-      const imaging::Position &delta = u_elements_.at(j);
       algorithm_insert_new_candidate_comparison_counter_->at(se_iteration_)
           += 1;
-      ok_so_far = p.Subtract(delta, &target);
+      ok_so_far = NeighborIndex(p, j, false, &valid, &target);
       if (!ok_so_far) continue;
-      if (!Y_->IsPositionValid(target)) continue;
+      if (!valid) continue;
       position_value = false;
       ok_so_far = Y_->value(target, &position_value);
       if (!ok_so_far) continue;
@@ -330,7 +303,7 @@ bool imaging::binary::morphology::MatrixErosion::InsertNewCandidateFromBorder(
       ok_so_far = (*output_image)->value(target, &marked_value);
       if (!ok_so_far) continue;
       if (marked_value > one_less_than_the_minimum_value) continue;
-      ok_so_far = position(target, &node);
+      ok_so_far = linear_position(target, &node);
       if (!ok_so_far) continue;
       ok_so_far = LinkingProcedure(node, j);
       if (!ok_so_far) continue;
@@ -351,21 +324,28 @@ bool imaging::binary::morphology::MatrixErosion::RemoveCandidateNode(
   return Transform::RemoveCandidateNode(image_position);
 }
 
+inline size_t imaging::binary::morphology::MatrixErosion::LinkIndex(
+    const imaging::ImagePositionIndex &image_position,
+    const imaging::SEIndex &link_se_index) const {
+  return static_cast<size_t>(image_position)*u_cardinality()+link_se_index;
+}
+
 inline bool imaging::binary::morphology::MatrixErosion::LinkingProcedure(
     const imaging::ImagePositionIndex &image_position,
     const imaging::SEIndex &link_se_index) {
-  const imaging::ImagePositionIndex previous =
-      (link_previous_.at(link_se_index)).at(imaging::HEADER);
-  const imaging::SEIndex &next_se = candidate_next_link_.at(image_position);
+  const size_t header = LinkIndex(imaging::HEADER, link_se_index);
+  const size_t node = LinkIndex(image_position, link_se_index);
+  const imaging::ImagePositionIndex previous = link_previous_.at(header);
+  const imaging::SEIndex next_se = candidate_next_link_.at(image_position);
   algorithm_insert_new_candidate_memory_access_counter_->at(se_iteration_)
       += 6;
   // Related to linked node.
-  (link_next_.at(link_se_index)).at(image_position) = imaging::HEADER;
-  (link_previous_.at(link_se_index)).at(image_position) = previous;
-  (link_next_.at(link_se_index)).at(previous) = image_position;
-  (link_previous_.at(link_se_index)).at(imaging::HEADER) = image_position;
+  link_next_.at(node) = imaging::HEADER;
+  link_previous_.at(node) = previous;
+  link_next_.at(LinkIndex(previous, link_se_index)) = image_position;
+  link_previous_.at(header) = image_position;
   // Related to candidate node.
-  (link_next_link_.at(link_se_index)).at(image_position) = next_se;
+  link_next_link_.at(node) = next_se;
   candidate_next_link_.at(image_position) = link_se_index;
   return EnqueueCandidateNode(image_position);
 }
@@ -373,15 +353,15 @@ inline bool imaging::binary::morphology::MatrixErosion::LinkingProcedure(
 inline bool imaging::binary::morphology::MatrixErosion::RemoveLinkNode(
     const imaging::ImagePositionIndex &image_position,
     const imaging::SEIndex &link_se_index) {
-  if (link_se_index == u_cardinality()) return true;
-  const imaging::ImagePositionIndex next =
-      (link_next_.at(link_se_index)).at(image_position);
-  const imaging::ImagePositionIndex previous =
-      (link_previous_.at(link_se_index)).at(image_position);
-  const imaging::ImagePositionIndex next_link =
-      (link_next_link_.at(link_se_index)).at(image_position);
-  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_) += 2;
-  (link_previous_.at(link_se_index)).at(next) = previous;
-  (link_next_.at(link_se_index)).at(previous) = next;
-  return RemoveLinkNode(image_position, next_link);
+  imaging::SEIndex link = link_se_index;
+  while (link != u_cardinality()) {
+    const size_t node = LinkIndex(image_position, link);
+    const imaging::ImagePositionIndex next = link_next_.at(node);
+    const imaging::ImagePositionIndex previous = link_previous_.at(node);
+    algorithm_remove_candidate_memory_access_counter_->at(se_iteration_) += 2;
+    link_previous_.at(LinkIndex(next, link)) = previous;
+    link_next_.at(LinkIndex(previous, link)) = next;
+    link = link_next_link_.at(node);
+  }
+  return true;
 }
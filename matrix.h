@@ -52,17 +52,26 @@ class MatrixDilation : public DilationTransform {
       const imaging::ImagePositionIndex &image_position);
  private:
   MatrixDilation() : DilationTransform(false, true, false, std::cout) {}
+  // Index of the link node of candidate 'image_position' and U element
+  // 'link_se_index' at the link vectors.
+  inline size_t LinkIndex(const imaging::ImagePositionIndex &image_position,
+      const imaging::SEIndex &link_se_index) const;
   inline bool LinkingProcedure(
       const imaging::ImagePositionIndex &image_position,
       const imaging::SEIndex &link_se_index);
+  // Removes every link node of candidate 'image_position', starting at the
+  // one of U element 'link_se_index'.
   inline bool RemoveLinkNode(
       const imaging::ImagePositionIndex &image_position,
       const imaging::SEIndex &link_se_index);
 
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_next_;
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_next_link_;
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_previous_;
-  std::vector<imaging::ImagePositionIndex> candidate_next_link_;  
+  std::vector<imaging::ImagePositionIndex> candidate_next_link_;
+  // Link nodes are stored candidate by candidate, so the links of a
+  // candidate are next to each other; the ones of HEADER are the headers of
+  // the list of each U element. They are allocated once per run.
+  std::vector<imaging::ImagePositionIndex> link_next_;
+  std::vector<imaging::ImagePositionIndex> link_next_link_;
+  std::vector<imaging::ImagePositionIndex> link_previous_;
 
   DISALLOW_COPY_AND_ASSIGN(MatrixDilation);
 }; // imaging:::binary::morphology::MatrixDilation
@@ -89,17 +98,26 @@ class MatrixErosion : public ErosionTransform {
       const imaging::ImagePositionIndex &image_position);
  private:
   MatrixErosion() : ErosionTransform(false, true, false, std::cout) {}
+  // Index of the link node of candidate 'image_position' and U element
+  // 'link_se_index' at the link vectors.
+  inline size_t LinkIndex(const imaging::ImagePositionIndex &image_position,
+      const imaging::SEIndex &link_se_index) const;
   inline bool LinkingProcedure(
       const imaging::ImagePositionIndex &image_position,
       const imaging::SEIndex &link_se_index);
+  // Removes every link node of candidate 'image_position', starting at the
+  // one of U element 'link_se_index'.
   inline bool RemoveLinkNode(
       const imaging::ImagePositionIndex &image_position,
       const imaging::SEIndex &link_se_index);
 
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_next_;
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_next_link_;
-  std::vector< std::vector<imaging::ImagePositionIndex> > link_previous_;
-  std::vector<imaging::ImagePositionIndex> candidate_next_link_;  
+  std::vector<imaging::ImagePositionIndex> candidate_next_link_;
+  // Link nodes are stored candidate by candidate, so the links of a
+  // candidate are next to each other; the ones of HEADER are the headers of
+  // the list of each U element. They are allocated once per run.
+  std::vector<imaging::ImagePositionIndex> link_next_;
+  std::vector<imaging::ImagePositionIndex> link_next_link_;
+  std::vector<imaging::ImagePositionIndex> link_previous_;
 
   DISALLOW_COPY_AND_ASSIGN(MatrixErosion);
 }; // imaging:::binary::morphology::MatrixErosion
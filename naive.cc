@@ -20,6 +20,7 @@
 #include <cstdio>
 
 #include "naive.h"
+#include "img-inl.h"
 
 // imaging::binary::morphology::NaiveDilation
 
@@ -36,11 +37,11 @@ bool imaging::binary::morphology::NaiveDilation::DetectBorder(
   imaging::ImagePositionIndex next = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   current = candidate_next_.at(imaging::HEADER);
   while (ok_so_far && current != imaging::HEADER) {
     keep_pixel = true;
-    const imaging::Position &current_p = candidate_position_.at(current);
     next = candidate_next_.at(current);
     for (i = 0; ok_so_far && keep_pixel && i < current_cardinality; ++i) {
       // For this iteration, calculate border, which is
@@ -50,17 +51,17 @@ bool imaging::binary::morphology::NaiveDilation::DetectBorder(
           current_se_indexes.at(i);
       const imaging::ImagePositionIndex element_index =
           current_se_vector.at(current_element_index);
-      const imaging::Position &delta = u_elements_.at(element_index);
       algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
-      ok_so_far = current_p.Subtract(delta, &target);
+      ok_so_far = NeighborIndex(current, element_index, false, &valid, &target);
       if (!ok_so_far) continue;
-      if (Y_->IsPositionValid(target)) {
+      if (valid) {
         ok_so_far = Y_->value(target, &position_value);
         if (!ok_so_far) continue;
         if (!position_value) continue;
       } else {
         continue;
       }
+      element_failures_.at(element_index) += 1;
       keep_pixel = false;
     }
     if (!keep_pixel) {
@@ -101,11 +102,11 @@ bool imaging::binary::morphology::NaiveErosion::DetectBorder(
   imaging::ImagePositionIndex next = 0;
   bool ok_so_far = true;
   bool position_value = true;
-  imaging::Position target;
+  imaging::ImagePositionIndex target = 0;
+  bool valid = false;
   current = candidate_next_.at(imaging::HEADER);
   while (ok_so_far && current != imaging::HEADER) {
     keep_pixel = true;
-    const imaging::Position &current_p = candidate_position_.at(current);
     next = candidate_next_.at(current);
     for (i = 0; ok_so_far && keep_pixel && i < current_cardinality; ++i) {
       // For this iteration, calculate border, which is
@@ -115,15 +116,15 @@ bool imaging::binary::morphology::NaiveErosion::DetectBorder(
           current_se_indexes.at(i);
       const imaging::ImagePositionIndex element_index =
           current_se_vector.at(current_element_index);
-      const imaging::Position &delta = u_elements_.at(element_index);
       algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
-      ok_so_far = current_p.Sum(delta, &target);
+      ok_so_far = NeighborIndex(current, element_index, true, &valid, &target);
       if (!ok_so_far) continue;
-      if (Y_->IsPositionValid(target)) {
+      if (valid) {
         ok_so_far = Y_->value(target, &position_value);
         if (!ok_so_far) continue;
         if (position_value) continue;
       }
+      element_failures_.at(element_index) += 1;
       keep_pixel = false;
     }
     if (!keep_pixel) {
@@ -0,0 +1,133 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+
+// This file contains the implementation of the work-stealing pool.
+
+#include "pool.h"
+
+// imaging::WorkStealingPool
+
+imaging::WorkStealingPool::WorkStealingPool(const unsigned threads)
+    : failed_(false), next_(0), pending_(0), queued_(0), stopping_(false) {
+  unsigned count = threads;
+  unsigned worker = 0;
+  if (count == 0) count = std::thread::hardware_concurrency();
+  if (count == 0) count = 1;
+  for (worker = 0; worker < count; ++worker) {
+    deques_.push_back(new Deque());
+  }
+  for (worker = 0; worker < count; ++worker) {
+    workers_.push_back(std::thread(&imaging::WorkStealingPool::Run, this,
+        worker));
+  }
+}
+
+imaging::WorkStealingPool::~WorkStealingPool() {
+  unsigned worker = 0;
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (worker = 0; worker < workers_.size(); ++worker) {
+    workers_.at(worker).join();
+  }
+  for (worker = 0; worker < deques_.size(); ++worker) {
+    delete deques_.at(worker);
+  }
+}
+
+bool imaging::WorkStealingPool::Submit(const Job &job) {
+  if (!job) return false;
+  unsigned worker = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) return false;
+    worker = next_;
+    next_ = (next_+1)%deques_.size();
+    ++pending_;
+  }
+  {
+    // Counted while the job is pushed, so queued_ is always the number of
+    // jobs in the deques.
+    Deque &deque = *deques_.at(worker);
+    std::lock_guard<std::mutex> deque_lock(deque.mutex);
+    deque.jobs.push_back(job);
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++queued_;
+  }
+  wake_.notify_one();
+  return true;
+}
+
+unsigned imaging::WorkStealingPool::threads() const {
+  return workers_.size();
+}
+
+bool imaging::WorkStealingPool::Wait() {
+  bool ok_so_far = true;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (pending_ != 0) done_.wait(lock);
+  ok_so_far = !failed_;
+  failed_ = false;
+  return ok_so_far;
+}
+
+bool imaging::WorkStealingPool::Run(const unsigned worker) {
+  Job job;
+  bool ok_so_far = true;
+  while (true) {
+    if (!TakeJob(worker, &job)) {
+      // Workers only retry while some deque holds a job.
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queued_ == 0 && !stopping_) wake_.wait(lock);
+      if (queued_ == 0) return true;
+      continue;
+    }
+    ok_so_far = job();
+    job = Job();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!ok_so_far) failed_ = true;
+    --pending_;
+    if (pending_ == 0) done_.notify_all();
+  }
+  return true;
+}
+
+bool imaging::WorkStealingPool::TakeJob(const unsigned worker, Job *job) {
+  if (job == NULL) return false;
+  unsigned i = 0;
+  bool found = false;
+  // The own deque is used as a stack; the others are stolen from the front.
+  for (i = 0; !found && i < deques_.size(); ++i) {
+    Deque &deque = *deques_.at((worker+i)%deques_.size());
+    std::lock_guard<std::mutex> deque_lock(deque.mutex);
+    if (deque.jobs.empty()) continue;
+    if (i == 0) {
+      *job = deque.jobs.back();
+      deque.jobs.pop_back();
+    } else {
+      *job = deque.jobs.front();
+      deque.jobs.pop_front();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    --queued_;
+    found = true;
+  }
+  return found;
+}
@@ -0,0 +1,78 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+
+// This file contains the declaration of the work-stealing pool which runs
+// transform jobs, such as whole images or tiles of an image.
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "disallow_ca.h"
+
+namespace imaging {
+
+
+// Each worker thread takes jobs from the back of its own deque and, when it
+// is empty, steals from the front of the deques of the other workers, so a
+// few long jobs do not leave the other workers idle.
+class WorkStealingPool {
+ public:
+  typedef std::function<bool ()> Job;
+  // A zero 'threads' uses one thread per hardware thread.
+  explicit WorkStealingPool(const unsigned threads);
+  ~WorkStealingPool();
+  // Queues 'job' at the deques of the workers in turn.
+  bool Submit(const Job &job);
+  unsigned threads() const;
+  // Waits until every submitted job has run. Returns false if any of them
+  // failed since the last call.
+  bool Wait();
+ private:
+  struct Deque {
+    std::deque<Job> jobs;
+    std::mutex mutex;
+  };
+
+  WorkStealingPool();
+  bool Run(const unsigned worker);
+  bool TakeJob(const unsigned worker, Job *job);
+
+  std::condition_variable done_;
+  std::vector<Deque*> deques_;
+  bool failed_;
+  std::mutex mutex_; // guards failed_, next_, pending_, queued_ and stopping_
+  unsigned next_; // deque receiving the next submitted job
+  unsigned pending_; // jobs submitted and not finished
+  unsigned queued_; // jobs in the deques
+  bool stopping_;
+  std::condition_variable wake_;
+  std::vector<std::thread> workers_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingPool);
+}; // imaging::WorkStealingPool
+
+
+} // namespace imaging
+
+#endif // POOL_H_
@@ -0,0 +1,75 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the pseudorandom engine.
+
+#include <cstddef>
+
+#include "random.h"
+
+// imaging::RandomEngine
+
+imaging::RandomEngine::RandomEngine() {
+  Seed(0, 0);
+}
+
+bool imaging::RandomEngine::Below(const uint64_t bound, uint64_t *value) {
+  if (value == NULL || bound == 0) return false;
+  // Values below 'threshold' would make the lowest residues likelier.
+  const uint64_t threshold = (0-bound) % bound;
+  uint64_t candidate = Next();
+  while (candidate < threshold) candidate = Next();
+  *value = candidate % bound;
+  return true;
+}
+
+void imaging::RandomEngine::Jump() {
+  static const uint64_t jump[] = {
+    0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+    0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+  };
+  int bit = 0;
+  int i = 0;
+  uint64_t jumped[4] = {0, 0, 0, 0};
+  int word = 0;
+  for (word = 0; word < 4; ++word) {
+    for (bit = 0; bit < 64; ++bit) {
+      if (jump[word] & (static_cast<uint64_t>(1) << bit)) {
+        for (i = 0; i < 4; ++i) jumped[i] ^= state_[i];
+      }
+      Next();
+    }
+  }
+  for (i = 0; i < 4; ++i) state_[i] = jumped[i];
+}
+
+bool imaging::RandomEngine::Seed(const uint64_t seed, const uint64_t stream) {
+  int i = 0;
+  uint64_t s = 0;
+  uint64_t split = seed;
+  uint64_t z = 0;
+  // The state is expanded from the seed by splitmix64, as the authors of
+  // xoshiro recommend.
+  for (i = 0; i < 4; ++i) {
+    split += 0x9e3779b97f4a7c15ULL;
+    z = split;
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27))*0x94d049bb133111ebULL;
+    state_[i] = z ^ (z >> 31);
+  }
+  for (s = 0; s < stream; ++s) Jump();
+  return true;
+}
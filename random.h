@@ -0,0 +1,63 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the pseudorandom engine shuffling
+// the SE sequences of the transforms, the xoshiro256** generator.
+
+#ifndef RANDOM_H_
+#define RANDOM_H_
+
+#include <stdint.h>
+
+namespace imaging {
+
+
+// Each transform owns its engine, so transforms running at once on several
+// threads neither share state nor depend on each other's sequence. A seed
+// gives a family of streams, each one 2^128 outputs ahead of the previous.
+class RandomEngine {
+ public:
+  RandomEngine();
+  ~RandomEngine() {}
+  // Sets 'value' as a uniform value below 'bound', which must be positive.
+  bool Below(const uint64_t bound, uint64_t *value);
+  // Advances the engine by 2^128 outputs.
+  void Jump();
+  uint64_t Next() {
+    const uint64_t result = RotateLeft(state_[1]*5, 7)*9;
+    const uint64_t t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = RotateLeft(state_[3], 45);
+    return result;
+  }
+  // Restarts the engine at stream 'stream' of 'seed'.
+  bool Seed(const uint64_t seed, const uint64_t stream);
+ private:
+  static uint64_t RotateLeft(const uint64_t x, const int k) {
+    return (x << k) | (x >> (64-k));
+  }
+
+  uint64_t state_[4];
+}; // imaging::RandomEngine
+
+
+} // namespace imaging
+
+#endif // RANDOM_H_
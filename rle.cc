@@ -0,0 +1,585 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the run-length encoded binary
+// image and of the run-length erosion and dilation transforms.
+
+#include <algorithm>
+#include <cstdio>
+
+#include "rle.h"
+#include "img-inl.h"
+
+namespace {
+
+bool Conjunction(const bool a, const bool b) {
+  return a && b;
+}
+
+bool Difference(const bool a, const bool b) {
+  return a && !b;
+}
+
+bool Disjunction(const bool a, const bool b) {
+  return a || b;
+}
+
+// Linear index distance between the rows of 'image', which is the length of
+// the only row of a one dimensional image.
+long RowStride(const imaging::binary::Image &image) {
+  if (imaging::Dimension::number() < 2) return image.Length(0);
+  return image.Stride(1);
+}
+
+} // namespace
+
+// imaging::binary::RunLengthImage
+
+imaging::binary::RunLengthImage::RunLengthImage()
+    : bounds_(), lengths_(), row_bounds_(1, 0), rows_(0) {}
+
+bool imaging::binary::RunLengthImage::And(
+    const imaging::binary::RunLengthImage &other) {
+  const imaging::Position origin;
+  return Combine(other, origin, &::Conjunction);
+}
+
+bool imaging::binary::RunLengthImage::AndNot(
+    const imaging::binary::RunLengthImage &other) {
+  const imaging::Position origin;
+  return Combine(other, origin, &::Difference);
+}
+
+bool imaging::binary::RunLengthImage::AndShifted(
+    const imaging::binary::RunLengthImage &source,
+    const imaging::Position &offset) {
+  return Combine(source, offset, &::Conjunction);
+}
+
+bool imaging::binary::RunLengthImage::Clip(
+    const imaging::BoundingBox &region) {
+  long begin = 0;
+  std::vector<long> bounds;
+  long coordinate_value = 0;
+  long end = 0;
+  char i = 0;
+  size_t k = 0;
+  const long lower = region.lower().coordinate(0);
+  const char n = imaging::Dimension::number();
+  long rest = 0;
+  long row = 0;
+  std::vector<size_t> row_bounds(rows_+1, 0);
+  const long upper = region.upper().coordinate(0)+1;
+  bool valid = true;
+  bounds.reserve(bounds_.size());
+  for (row = 0; row < rows_; ++row) {
+    row_bounds.at(row) = bounds.size();
+    rest = row;
+    valid = true;
+    for (i = 1; valid && i < n; ++i) {
+      coordinate_value = rest%lengths_.coordinate(i);
+      rest /= lengths_.coordinate(i);
+      if (coordinate_value < region.lower().coordinate(i)
+          || coordinate_value > region.upper().coordinate(i)) valid = false;
+    }
+    if (!valid) continue;
+    for (k = row_bounds_[row]; k < row_bounds_[row+1]; k += 2) {
+      begin = std::max(bounds_[k], lower);
+      end = std::min(bounds_[k+1], upper);
+      if (begin >= end) continue;
+      bounds.push_back(begin);
+      bounds.push_back(end);
+    }
+  }
+  row_bounds.at(rows_) = bounds.size();
+  bounds_.swap(bounds);
+  row_bounds_.swap(row_bounds);
+  return true;
+}
+
+bool imaging::binary::RunLengthImage::Combine(
+    const imaging::binary::RunLengthImage &source,
+    const imaging::Position &offset,
+    imaging::binary::RunLengthImage::RunOperation operation) {
+  if (!SameLengths(source)) return false;
+  long begin = 0;
+  std::vector<long> bounds;
+  const long dx = offset.coordinate(0);
+  long end = 0;
+  bool in_a = false;
+  bool in_b = false;
+  bool inside = false;
+  size_t j = 0;
+  size_t k = 0;
+  size_t last = 0;
+  const long length = lengths_.coordinate(0);
+  long next = 0;
+  bool ok_so_far = true;
+  long row = 0;
+  std::vector<size_t> row_bounds(rows_+1, 0);
+  std::vector<long> shifted;
+  long source_row = 0;
+  bool valid = true;
+  bounds.reserve(bounds_.size()+source.bounds_.size());
+  for (row = 0; ok_so_far && row < rows_; ++row) {
+    row_bounds.at(row) = bounds.size();
+    // Source runs moved onto the row, clipped to it.
+    shifted.clear();
+    ok_so_far = ShiftedRow(row, offset, &valid, &source_row);
+    if (!ok_so_far) continue;
+    if (valid) {
+      for (k = source.row_bounds_[source_row];
+          k < source.row_bounds_[source_row+1]; k += 2) {
+        begin = std::max(source.bounds_[k]-dx, 0L);
+        end = std::min(source.bounds_[k+1]-dx, length);
+        if (begin >= end) continue;
+        shifted.push_back(begin);
+        shifted.push_back(end);
+      }
+    }
+    // Both bound sequences are increasing: each bound toggles its side and
+    // a bound is kept whenever the combined value changes.
+    in_a = false;
+    in_b = false;
+    inside = false;
+    j = 0;
+    k = row_bounds_[row];
+    last = row_bounds_[row+1];
+    while (k < last || j < shifted.size()) {
+      if (j >= shifted.size() || (k < last && bounds_[k] <= shifted[j])) {
+        next = bounds_[k];
+      } else {
+        next = shifted[j];
+      }
+      if (k < last && bounds_[k] == next) {
+        in_a = !in_a;
+        ++k;
+      }
+      if (j < shifted.size() && shifted[j] == next) {
+        in_b = !in_b;
+        ++j;
+      }
+      if (operation(in_a, in_b) != inside) {
+        inside = !inside;
+        bounds.push_back(next);
+      }
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  row_bounds.at(rows_) = bounds.size();
+  bounds_.swap(bounds);
+  row_bounds_.swap(row_bounds);
+  return ok_so_far;
+}
+
+bool imaging::binary::RunLengthImage::CopyFrom(
+    const imaging::binary::Image &image) {
+  long end = 0;
+  bool found = false;
+  char i = 0;
+  imaging::ImagePositionIndex index = 0;
+  const long length = image.Length(0);
+  const char n = imaging::Dimension::number();
+  long next_row = 0;
+  bool ok_so_far = true;
+  long row = 0;
+  const long stride = ::RowStride(image);
+  bool value = true;
+  long x = 0;
+  if (length < 1 || stride < 1) return false;
+  rows_ = 1;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = lengths_.set_value(i, image.Length(i));
+    if (i > 0) rows_ *= image.Length(i);
+  }
+  if (!ok_so_far) return ok_so_far;
+  bounds_.clear();
+  row_bounds_.assign(rows_+1, 0);
+  ok_so_far = image.NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    row = index/stride;
+    x = index%stride;
+    for (; next_row <= row; ++next_row) {
+      row_bounds_.at(next_row) = bounds_.size();
+    }
+    // Alignment bits are clear, so no run goes beyond its row.
+    value = true;
+    for (end = x+1; ok_so_far && value && end < length; ) {
+      ok_so_far = image.value(
+          static_cast<imaging::ImagePositionIndex>(row*stride+end), &value);
+      if (value) ++end;
+    }
+    if (!ok_so_far) continue;
+    bounds_.push_back(x);
+    bounds_.push_back(end);
+    ok_so_far = image.NextSetBit(
+        static_cast<imaging::ImagePositionIndex>(row*stride+end), &found,
+        &index);
+  }
+  if (!ok_so_far) return ok_so_far;
+  for (; next_row <= rows_; ++next_row) {
+    row_bounds_.at(next_row) = bounds_.size();
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::RunLengthImage::CopyTo(
+    imaging::binary::Image *image) const {
+  if (image == NULL) return false;
+  char i = 0;
+  size_t k = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  long row = 0;
+  long x = 0;
+  for (i = 0; i < n; ++i) {
+    if (image->Length(i) != lengths_.coordinate(i)) return false;
+  }
+  const long stride = ::RowStride(*image);
+  ok_so_far = image->Fill(false);
+  for (row = 0; ok_so_far && row < rows_; ++row) {
+    for (k = row_bounds_[row]; ok_so_far && k < row_bounds_[row+1]; k += 2) {
+      for (x = bounds_[k]; ok_so_far && x < bounds_[k+1]; ++x) {
+        ok_so_far = image->set_value(
+            static_cast<imaging::ImagePositionIndex>(row*stride+x), true);
+      }
+    }
+  }
+  return ok_so_far;
+}
+
+imaging::ImagePositionIndex imaging::binary::RunLengthImage::Count() const {
+  imaging::ImagePositionIndex count = 0;
+  size_t k = 0;
+  for (k = 0; k < bounds_.size(); k += 2) count += bounds_[k+1]-bounds_[k];
+  return count;
+}
+
+long imaging::binary::RunLengthImage::Length(const char index) const {
+  if (index < 0 || index >= imaging::Dimension::number()) return -1;
+  return lengths_.coordinate(index);
+}
+
+bool imaging::binary::RunLengthImage::Or(
+    const imaging::binary::RunLengthImage &other) {
+  const imaging::Position origin;
+  return Combine(other, origin, &::Disjunction);
+}
+
+bool imaging::binary::RunLengthImage::OrShifted(
+    const imaging::binary::RunLengthImage &source,
+    const imaging::Position &offset) {
+  return Combine(source, offset, &::Disjunction);
+}
+
+bool imaging::binary::RunLengthImage::run(const long row, const size_t k,
+    long *begin, long *end) const {
+  if (begin == NULL || end == NULL) return false;
+  if (row < 0 || row >= rows_) return false;
+  if (k >= runs(row)) return false;
+  *begin = bounds_[row_bounds_[row]+2*k];
+  *end = bounds_[row_bounds_[row]+2*k+1];
+  return true;
+}
+
+long imaging::binary::RunLengthImage::rows() const {
+  return rows_;
+}
+
+size_t imaging::binary::RunLengthImage::runs(const long row) const {
+  if (row < 0 || row >= rows_) return 0;
+  return (row_bounds_[row+1]-row_bounds_[row])/2;
+}
+
+bool imaging::binary::RunLengthImage::SameLengths(
+    const imaging::binary::RunLengthImage &other) const {
+  return rows_ == other.rows_ && lengths_.Equals(other.lengths_);
+}
+
+bool imaging::binary::RunLengthImage::ShiftedRow(const long row,
+    const imaging::Position &offset, bool *valid, long *source_row) const {
+  if (valid == NULL || source_row == NULL) return false;
+  long coordinate_value = 0;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  long rest = row;
+  long row_stride = 1;
+  *valid = true;
+  *source_row = 0;
+  for (i = 1; *valid && i < n; ++i) {
+    coordinate_value = rest%lengths_.coordinate(i)+offset.coordinate(i);
+    rest /= lengths_.coordinate(i);
+    if (coordinate_value < 0 || coordinate_value >= lengths_.coordinate(i)) {
+      *valid = false;
+      continue;
+    }
+    *source_row += coordinate_value*row_stride;
+    row_stride *= lengths_.coordinate(i);
+  }
+  return true;
+}
+
+// imaging::binary::morphology::RleDilation
+
+imaging::binary::morphology::RleDilation::~RleDilation() {
+  RleDilation::clear();
+}
+
+bool imaging::binary::morphology::RleDilation::clear() {
+  candidates_ = 0;
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::RleDilation::CustomInitialize() {
+  if (Y_ == NULL) return false;
+  return y_.CopyFrom(*Y_);
+}
+
+bool imaging::binary::morphology::RleDilation::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << candidates_ << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::RleDilation::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  imaging::Position offset;
+  bool ok_so_far = true;
+  // The external morphological gradient is calculated with the runs of each
+  // row: a background pixel p is at the border if some p-u is at the
+  // foreground.
+  step_ = y_;
+  for (i = 0; ok_so_far && i < current_cardinality; ++i) {
+    const imaging::ImagePositionIndex current_element_index =
+        current_se_indexes.at(i);
+    const imaging::ImagePositionIndex element_index =
+        current_se_vector.at(current_element_index);
+    algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
+    ok_so_far = offset.CopyOppositeOf(u_elements_.at(element_index));
+    if (!ok_so_far) continue;
+    ok_so_far = step_.OrShifted(y_, offset);
+  }
+  if (!ok_so_far) return ok_so_far;
+  if (guard_band()) {
+    // The guard band must never be reached by the dilation.
+    ok_so_far = step_.Clip(candidate_region_);
+    if (!ok_so_far) return ok_so_far;
+  }
+  border_runs_ = step_;
+  ok_so_far = border_runs_.AndNot(y_);
+  if (!ok_so_far) return ok_so_far;
+  border_counter_ = border_runs_.Count();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::RleDilation::HasCandidates() const {
+  return candidates_ > 0;
+}
+
+bool imaging::binary::morphology::RleDilation::InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::RleDilation::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool ok_so_far = true;
+  // Candidates are kept as the gaps between the runs of y_, so only the
+  // header is needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  // Every background pixel of the input image region is a candidate.
+  candidates_ = candidate_region_.capacity()-image.Count();
+  if (debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::RleDilation::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::RleDilation::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::RleDilation::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  long begin = 0;
+  long end = 0;
+  size_t k = 0;
+  bool ok_so_far = true;
+  long row = 0;
+  const long stride = ::RowStride(*Y_);
+  long x = 0;
+  for (row = 0; ok_so_far && row < border_runs_.rows(); ++row) {
+    for (k = 0; ok_so_far && k < border_runs_.runs(row); ++k) {
+      ok_so_far = border_runs_.run(row, k, &begin, &end);
+      for (x = begin; ok_so_far && x < end; ++x) {
+        ok_so_far = (*output_image)->set_value(
+            static_cast<imaging::ImagePositionIndex>(row*stride+x),
+            se_iteration_);
+      }
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  candidates_ -= border_counter_;
+  return y_.Or(border_runs_);
+}
+
+// imaging::binary::morphology::RleErosion
+
+imaging::binary::morphology::RleErosion::~RleErosion() {
+  RleErosion::clear();
+}
+
+bool imaging::binary::morphology::RleErosion::clear() {
+  candidates_ = 0;
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::RleErosion::CustomInitialize() {
+  if (Y_ == NULL) return false;
+  return y_.CopyFrom(*Y_);
+}
+
+bool imaging::binary::morphology::RleErosion::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << candidates_ << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::RleErosion::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  bool ok_so_far = true;
+  // The internal morphological gradient is calculated with the runs of each
+  // row: a foreground pixel p is kept if every p+u is at the foreground.
+  step_ = y_;
+  for (i = 0; ok_so_far && i < current_cardinality; ++i) {
+    const imaging::ImagePositionIndex current_element_index =
+        current_se_indexes.at(i);
+    const imaging::ImagePositionIndex element_index =
+        current_se_vector.at(current_element_index);
+    algorithm_determinate_border_comparison_counter_->at(se_iteration_) += 1;
+    ok_so_far = step_.AndShifted(y_, u_elements_.at(element_index));
+  }
+  if (!ok_so_far) return ok_so_far;
+  border_runs_ = y_;
+  ok_so_far = border_runs_.AndNot(step_);
+  if (!ok_so_far) return ok_so_far;
+  border_counter_ = border_runs_.Count();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::RleErosion::HasCandidates() const {
+  return candidates_ > 0;
+}
+
+bool imaging::binary::morphology::RleErosion::InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::RleErosion::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool ok_so_far = true;
+  // Candidates are kept as the runs of y_, so only the header is needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  // Every foreground pixel is a candidate.
+  candidates_ = image.Count();
+  if (debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::RleErosion::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::RleErosion::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::RleErosion::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (*output_image == NULL) return false;
+  long begin = 0;
+  long end = 0;
+  size_t k = 0;
+  bool ok_so_far = true;
+  long row = 0;
+  const long stride = ::RowStride(*Y_);
+  long x = 0;
+  for (row = 0; ok_so_far && row < border_runs_.rows(); ++row) {
+    for (k = 0; ok_so_far && k < border_runs_.runs(row); ++k) {
+      ok_so_far = border_runs_.run(row, k, &begin, &end);
+      for (x = begin; ok_so_far && x < end; ++x) {
+        ok_so_far = (*output_image)->set_value(
+            static_cast<imaging::ImagePositionIndex>(row*stride+x),
+            se_iteration_);
+      }
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  candidates_ -= border_counter_;
+  return y_.AndNot(border_runs_);
+}
@@ -0,0 +1,167 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the run-length encoded binary image
+// and of the erosion and dilation transforms processing each SE step over
+// its runs.
+
+#ifndef RLE_H_
+#define RLE_H_
+
+#include <vector>
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+// Binary image stored as the runs of foreground pixels along dimension 0.
+// Each row, that is, each combination of the other coordinates, keeps the
+// [begin, end) pairs of its runs, which are sorted, disjoint and never
+// adjacent. Rows are numbered as the rows of imaging::binary::Image, so the
+// linear index of pixel x of row r is r*Stride(1)+x at an image of the same
+// size. Memory scales with the number of runs, that is, with the perimeter
+// of the foreground, instead of with the area of the image.
+class RunLengthImage {
+ public:
+  RunLengthImage();
+  ~RunLengthImage() {}
+  // Bulk operations with an image of the same lengths, run by run.
+  bool And(const RunLengthImage &other);
+  bool AndNot(const RunLengthImage &other);
+  // Combines each pixel p with the pixel p+offset of 'source', which is
+  // taken as false outside the image.
+  bool AndShifted(const RunLengthImage &source,
+      const imaging::Position &offset);
+  // Clears every pixel outside 'region'.
+  bool Clip(const imaging::BoundingBox &region);
+  bool CopyFrom(const imaging::binary::Image &image);
+  // Sets the pixels of 'image', whose size must match, to the ones of the
+  // runs.
+  bool CopyTo(imaging::binary::Image *image) const;
+  imaging::ImagePositionIndex Count() const;
+  long Length(const char index) const;
+  bool Or(const RunLengthImage &other);
+  bool OrShifted(const RunLengthImage &source,
+      const imaging::Position &offset);
+  // Run 'k' of row 'row' as the [begin, end) coordinates at dimension 0.
+  bool run(const long row, const size_t k, long *begin, long *end) const;
+  long rows() const;
+  size_t runs(const long row) const;
+ private:
+  typedef bool (*RunOperation)(const bool, const bool);
+
+  bool Combine(const RunLengthImage &source, const imaging::Position &offset,
+      RunOperation operation);
+  bool SameLengths(const RunLengthImage &other) const;
+  // Row of 'source' holding the pixels p+offset of the pixels p of 'row'.
+  bool ShiftedRow(const long row, const imaging::Position &offset,
+      bool *valid, long *source_row) const;
+
+  std::vector<long> bounds_; // begin and end of each run, row by row
+  imaging::Position lengths_;
+  std::vector<size_t> row_bounds_; // first bound of each row, and the last
+  long rows_;
+}; // imaging::binary::RunLengthImage
+
+
+namespace morphology {
+
+
+class RleDilation : public DilationTransform {
+ public:
+  RleDilation(const bool debug, std::ostream &debug_output)
+      : DilationTransform(false, false, debug, debug_output),
+        candidates_(0) {}
+  virtual ~RleDilation();
+ protected:
+  virtual bool clear();
+  virtual bool CustomInitialize();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  RleDilation()
+      : DilationTransform(false, false, false, std::cout), candidates_(0) {}
+
+  imaging::binary::RunLengthImage border_runs_;
+  imaging::ImagePositionIndex candidates_; // background pixels left
+  imaging::binary::RunLengthImage step_;
+  imaging::binary::RunLengthImage y_; // runs of Y_
+
+  DISALLOW_COPY_AND_ASSIGN(RleDilation);
+}; // imaging:::binary::morphology::RleDilation
+
+
+class RleErosion : public ErosionTransform {
+ public:
+  RleErosion(const bool debug, std::ostream &debug_output)
+      : ErosionTransform(false, false, debug, debug_output),
+        candidates_(0) {}
+  virtual ~RleErosion();
+ protected:
+  virtual bool clear();
+  virtual bool CustomInitialize();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  RleErosion()
+      : ErosionTransform(false, false, false, std::cout), candidates_(0) {}
+
+  imaging::binary::RunLengthImage border_runs_;
+  imaging::ImagePositionIndex candidates_; // foreground pixels left
+  imaging::binary::RunLengthImage step_;
+  imaging::binary::RunLengthImage y_; // runs of Y_
+
+  DISALLOW_COPY_AND_ASSIGN(RleErosion);
+}; // imaging:::binary::morphology::RleErosion
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // RLE_H_
@@ -20,26 +20,27 @@
 #ifndef SHUFFLE_INL_H_
 #define SHUFFLE_INL_H_
 
-#include <cmath>
-#include <cstdlib>
 #include <vector>
 
+#include "random.h"
+
+// Each of the orders of 'data' is equally likely, drawn from 'random'.
 template< class T >
-inline bool shuffle(std::vector<T> *data) {
-  if (data == NULL) return false;
+inline bool shuffle(std::vector<T> *data, imaging::RandomEngine *random) {
+  if (data == NULL || random == NULL) return false;
   long j = static_cast<long>(data->size())-1;
-  long k = 0;
+  uint64_t k = 0;
+  bool ok_so_far = true;
   T tmp;
-  double U = 0.;
-  while (j > 0) {
-    U = (1.*rand())/(1.*RAND_MAX);
-    k = static_cast<long>(floor(j*U));
+  while (ok_so_far && j > 0) {
+    ok_so_far = random->Below(j+1, &k);
+    if (!ok_so_far) continue;
     tmp = data->at(j);
     data->at(j) = data->at(k);
     data->at(k) = tmp;
     --j;
   }
-  return true;
+  return ok_so_far;
 }
 
 #endif // SHUFFLE_INL_H_
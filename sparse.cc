@@ -0,0 +1,658 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the sparse binary image and
+// levels and of the sparse erosion and dilation transforms.
+
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/time.h>
+
+#include "sparse.h"
+#include "img-inl.h"
+
+namespace {
+
+// Sets 'lower' and 'upper' as the bounds of the pixels of 'region' whose
+// neighbors up to 'reach' away lie in 'region' as well.
+bool InteriorBounds(const imaging::BoundingBox &region,
+    const imaging::Position &reach, imaging::Position *lower,
+    imaging::Position *upper) {
+  if (lower == NULL || upper == NULL) return false;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = lower->set_value(i,
+        region.lower().coordinate(i)+reach.coordinate(i));
+    if (!ok_so_far) continue;
+    ok_so_far = upper->set_value(i,
+        region.upper().coordinate(i)-reach.coordinate(i));
+  }
+  return ok_so_far;
+}
+
+// Sets 'position' as the coordinates of the pixel at 'index' of an image of
+// 'lengths' in linear index units, and 'interior' to whether it lies between
+// 'lower' and 'upper'.
+inline void IndexPosition(const imaging::Position &lengths,
+    const imaging::Position &lower, const imaging::Position &upper,
+    const imaging::ImagePositionIndex index, long *position,
+    bool *interior) {
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  long rest = index;
+  *interior = true;
+  for (i = 0; i < n; ++i) {
+    position[static_cast<int>(i)] = rest%lengths.coordinate(i);
+    rest /= lengths.coordinate(i);
+    if (position[static_cast<int>(i)] < lower.coordinate(i)
+        || position[static_cast<int>(i)] > upper.coordinate(i))
+      *interior = false;
+  }
+}
+
+// Whether the pixel 'delta' away from the pixel at 'position' lies between
+// 'lower' and 'upper'.
+inline bool IsNeighborValid(const imaging::Position &lower,
+    const imaging::Position &upper, const long *position,
+    const imaging::Position &delta) {
+  long coordinate_value = 0;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  for (i = 0; i < n; ++i) {
+    coordinate_value = position[static_cast<int>(i)]+delta.coordinate(i);
+    if (coordinate_value < lower.coordinate(i)
+        || coordinate_value > upper.coordinate(i)) return false;
+  }
+  return true;
+}
+
+// Converts the index 'from' of 'image' to the index 'to' of an image of the
+// same size without aligned rows ('to_aligned' false) or the other way
+// round. Rows are numbered alike by both, so only the row length changes.
+inline void ConvertIndex(const imaging::binary::Image &image,
+    const bool to_aligned, const imaging::ImagePositionIndex from,
+    imaging::ImagePositionIndex *to) {
+  const long aligned_length = image.Stride(1);
+  const long length = image.Length(0);
+  if (imaging::Dimension::number() < 2) {
+    *to = from;
+  } else if (to_aligned) {
+    *to = (from/length)*aligned_length+from%length;
+  } else {
+    *to = (from/aligned_length)*length+from%aligned_length;
+  }
+}
+
+// Sets 'position' as the coordinates of the pixel at 'index' of an image of
+// 'size' without aligned rows.
+bool SparsePosition(const imaging::Size &size,
+    const imaging::ImagePositionIndex index, imaging::Position *position) {
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  imaging::ImagePositionIndex rest = index;
+  for (i = 0; ok_so_far && i < n; ++i) {
+    ok_so_far = position->set_value(i, rest%size.Length(i));
+    rest /= size.Length(i);
+  }
+  return ok_so_far && rest == 0;
+}
+
+} // namespace
+
+// imaging::binary::SparseImage
+
+bool imaging::binary::SparseImage::CopyFrom(
+    const imaging::binary::Image &image) {
+  bool found = false;
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  imaging::ImagePositionIndex sparse_index = 0;
+  size_ = image.size();
+  foreground_.clear();
+  // Aligned and sparse indexes keep the same order.
+  ok_so_far = image.NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    ::ConvertIndex(image, false, index, &sparse_index);
+    foreground_.push_back(sparse_index);
+    ok_so_far = image.NextSetBit(index+1, &found, &index);
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::SparseImage::CopyTo(
+    imaging::binary::Image *image) const {
+  if (image == NULL) return false;
+  if (!image->size().Equals(size_)) return false;
+  imaging::ImagePositionIndex index = 0;
+  size_t k = 0;
+  bool ok_so_far = true;
+  ok_so_far = image->Fill(false);
+  for (k = 0; ok_so_far && k < foreground_.size(); ++k) {
+    ::ConvertIndex(*image, true, foreground_[k], &index);
+    ok_so_far = image->set_value(index, true);
+  }
+  return ok_so_far;
+}
+
+const std::vector<imaging::ImagePositionIndex>&
+    imaging::binary::SparseImage::foreground() const {
+  return foreground_;
+}
+
+bool imaging::binary::SparseImage::Insert(const imaging::Position &position) {
+  if (!size_.IsValid(position)) return false;
+  char i = 0;
+  imaging::ImagePositionIndex index = 0;
+  const char n = imaging::Dimension::number();
+  imaging::ImagePositionIndex stride = 1;
+  for (i = 0; i < n; ++i) {
+    index += position.coordinate(i)*stride;
+    stride *= size_.Length(i);
+  }
+  if (foreground_.empty() || foreground_.back() < index) {
+    foreground_.push_back(index);
+    return true;
+  }
+  std::vector<imaging::ImagePositionIndex>::iterator place =
+      std::lower_bound(foreground_.begin(), foreground_.end(), index);
+  if (*place != index) foreground_.insert(place, index);
+  return true;
+}
+
+const imaging::Size& imaging::binary::SparseImage::size() const {
+  return size_;
+}
+
+// imaging::binary::morphology::SparseLevels
+
+bool imaging::binary::morphology::SparseLevels::CopyTo(
+    imaging::grayscale::Image *image) const {
+  if (image == NULL) return false;
+  if (!image->size().Equals(size_)) return false;
+  size_t k = 0;
+  bool ok_so_far = true;
+  imaging::Position position;
+  ok_so_far = image->Fill(others_);
+  for (k = 0; ok_so_far && k < levels_.size(); ++k) {
+    ok_so_far = ::SparsePosition(size_, levels_[k].first, &position);
+    if (!ok_so_far) continue;
+    ok_so_far = image->set_value(position, levels_[k].second);
+  }
+  return ok_so_far;
+}
+
+const std::vector< std::pair<imaging::ImagePositionIndex, int> >&
+    imaging::binary::morphology::SparseLevels::levels() const {
+  return levels_;
+}
+
+int imaging::binary::morphology::SparseLevels::others() const {
+  return others_;
+}
+
+bool imaging::binary::morphology::SparseLevels::Set(
+    const imaging::Size &size,
+    std::vector< std::pair<imaging::ImagePositionIndex, int> > *levels,
+    const int others) {
+  if (levels == NULL) return false;
+  levels_.clear();
+  levels_.swap(*levels);
+  std::sort(levels_.begin(), levels_.end());
+  others_ = others;
+  size_ = size;
+  return true;
+}
+
+const imaging::Size&
+    imaging::binary::morphology::SparseLevels::size() const {
+  return size_;
+}
+
+// imaging::binary::morphology::SparseDilation
+
+imaging::binary::morphology::SparseDilation::~SparseDilation() {
+  SparseDilation::clear();
+}
+
+bool imaging::binary::morphology::SparseDilation::clear() {
+  border_indexes_.clear();
+  candidates_ = 0;
+  expanded_.clear();
+  foreground_ = 0;
+  keeps_levels_ = false;
+  levels_.clear();
+  reached_.clear();
+  reached_set_.clear();
+  unreached_value_ = -1;
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::SparseDilation::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << candidates_ << "\n";
+  debug_output_ << "\t\treached pixels: " << reached_.size() << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::SparseDilation::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  bool interior = true;
+  size_t k = 0;
+  const size_t last = reached_.size();
+  const imaging::Position &lower = candidate_region_.lower();
+  imaging::ImagePositionIndex neighbor = 0;
+  long position[IMAGING_MAXIMUM_DIMENSION] = {0};
+  const imaging::Position &upper = candidate_region_.upper();
+  // A background pixel p is at the border if some p-u is at the foreground,
+  // so the border is found from the pixels this SE has not visited yet.
+  border_indexes_.clear();
+  for (k = expanded_.at(current_se_index); k < last; ++k) {
+    const imaging::ImagePositionIndex p = reached_[k];
+    ::IndexPosition(y_index_lengths_, interior_lower_, interior_upper_, p,
+        position, &interior);
+    for (i = 0; i < current_cardinality; ++i) {
+      const imaging::ImagePositionIndex element_index =
+          current_se_vector.at(current_se_indexes.at(i));
+      algorithm_determinate_border_comparison_counter_->at(se_iteration_)
+          += 1;
+      if (!interior && !::IsNeighborValid(lower, upper, position,
+          u_elements_[element_index])) continue;
+      neighbor = p+u_offsets_[element_index];
+      // Pixels found are only visited by later steps, so they are reached
+      // at once, which keeps them from being found twice.
+      if (!reached_set_.insert(neighbor).second) continue;
+      border_indexes_.push_back(neighbor);
+    }
+  }
+  expanded_.at(current_se_index) = last;
+  border_counter_ = border_indexes_.size();
+  return true;
+}
+
+bool imaging::binary::morphology::SparseDilation::ExecuteSparse(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::SparseImage &image,
+    imaging::binary::morphology::SparseLevels *output,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border,
+    double *start,
+    double *end) {
+  if (output == NULL || end == NULL) return false;
+  size_t k = 0;
+  imaging::grayscale::Image *no_output = NULL;
+  bool ok_so_far = true;
+  struct timeval timer;
+  ok_so_far = PrepareSparse(plan, image.size(),
+      algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border,
+      start);
+  if (!ok_so_far) return ok_so_far;
+  keeps_levels_ = true;
+  reached_ = image.foreground();
+  ok_so_far = InitializeReached();
+  if (!ok_so_far) return ok_so_far;
+  // Actual algorithm!
+  ok_so_far = this->ActualAlgorithm(&no_output);
+  if (!ok_so_far) return ok_so_far;
+  // Input pixels keep their value.
+  for (k = 0; k < foreground_; ++k) {
+    levels_.push_back(std::make_pair(reached_[k], 0));
+  }
+  ok_so_far = output->Set(image.size(), &levels_, unreached_value_);
+  // Finally!
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  this->clear();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::SparseDilation::HasCandidates() const {
+  return candidates_ > 0;
+}
+
+bool imaging::binary::morphology::SparseDilation::
+    InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::SparseDilation::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool found = false;
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  ok_so_far = image.NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    reached_.push_back(index);
+    ok_so_far = image.NextSetBit(index+1, &found, &index);
+  }
+  if (!ok_so_far) return ok_so_far;
+  return InitializeReached();
+}
+
+bool imaging::binary::morphology::SparseDilation::InitializeReached() {
+  bool ok_so_far = true;
+  // Candidates are the background pixels left, so only the header is
+  // needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::InteriorBounds(candidate_region_, u_reach_, &interior_lower_,
+      &interior_upper_);
+  if (!ok_so_far) return ok_so_far;
+  foreground_ = reached_.size();
+  reached_set_.insert(reached_.begin(), reached_.end());
+  expanded_.assign(se_elements_.size(), 0);
+  // Every background pixel of the input image region is a candidate.
+  candidates_ = candidate_region_.capacity()-reached_.size();
+  if (debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::SparseDilation::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (!keeps_levels_ && *output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::SparseDilation::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::SparseDilation::MarkUnprocessed(
+    const imaging::ImagePositionIndex level,
+    imaging::grayscale::Image **output_image) {
+  if (!keeps_levels_) return Transform::MarkUnprocessed(level, output_image);
+  // Unprocessed pixels are the ones left out of levels_.
+  unreached_value_ = static_cast<int>(level);
+  return true;
+}
+
+bool imaging::binary::morphology::SparseDilation::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (!keeps_levels_ && *output_image == NULL) return false;
+  imaging::ImagePositionIndex i = 0;
+  bool ok_so_far = true;
+  for (i = 0; ok_so_far && i < border_counter_; ++i) {
+    if (keeps_levels_) {
+      levels_.push_back(std::make_pair(border_indexes_[i],
+          static_cast<int>(se_iteration_)));
+    } else {
+      ok_so_far = (*output_image)->set_value(border_indexes_[i],
+          se_iteration_);
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  candidates_ -= border_counter_;
+  reached_.insert(reached_.end(), border_indexes_.begin(),
+      border_indexes_.end());
+  return ok_so_far;
+}
+
+// imaging::binary::morphology::SparseErosion
+
+imaging::binary::morphology::SparseErosion::~SparseErosion() {
+  SparseErosion::clear();
+}
+
+bool imaging::binary::morphology::SparseErosion::clear() {
+  border_indexes_.clear();
+  keeps_levels_ = false;
+  levels_.clear();
+  remaining_.clear();
+  return Transform::clear();
+}
+
+bool imaging::binary::morphology::SparseErosion::Debug() {
+  if (!debug_) {
+    debug_output_ << "ERROR: debug not set.\n";
+    return false;
+  }
+  debug_output_ << "\t\tse_iteration_: " << se_iteration_ << "\n";
+  debug_output_ << "\t\tcandidate pixels: " << remaining_.size() << "\n";
+  debug_output_ << "\t\tborder pixels: " << border_counter_ << "\n";
+  return true;
+}
+
+bool imaging::binary::morphology::SparseErosion::DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes) {
+  const imaging::ImagePositionIndex current_cardinality =
+          se_cardinality_.at(current_se_index);
+  const std::vector< imaging::ImagePositionIndex > &current_se_vector =
+      se_elements_.at(current_se_index);
+  imaging::ImagePositionIndex i = 0;
+  bool interior = true;
+  size_t k = 0;
+  bool kept = true;
+  const imaging::Position &lower = candidate_region_.lower();
+  long position[IMAGING_MAXIMUM_DIMENSION] = {0};
+  const imaging::Position &upper = candidate_region_.upper();
+  // A foreground pixel p is kept if every p+u is at the foreground, that is,
+  // among the pixels left; pixels outside the image region are at the
+  // background.
+  border_indexes_.clear();
+  for (k = 0; k < remaining_.size(); ++k) {
+    const imaging::ImagePositionIndex p = remaining_[k];
+    ::IndexPosition(y_index_lengths_, interior_lower_, interior_upper_, p,
+        position, &interior);
+    kept = true;
+    for (i = 0; kept && i < current_cardinality; ++i) {
+      const imaging::ImagePositionIndex element_index =
+          current_se_vector.at(current_se_indexes.at(i));
+      algorithm_determinate_border_comparison_counter_->at(se_iteration_)
+          += 1;
+      kept = interior || ::IsNeighborValid(lower, upper, position,
+          u_elements_[element_index]);
+      if (kept) {
+        kept = std::binary_search(remaining_.begin(), remaining_.end(),
+            p+u_offsets_[element_index]);
+      }
+      if (!kept) element_failures_[element_index] += 1;
+    }
+    if (!kept) border_indexes_.push_back(p);
+  }
+  border_counter_ = border_indexes_.size();
+  return true;
+}
+
+bool imaging::binary::morphology::SparseErosion::ExecuteSparse(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::SparseImage &image,
+    imaging::binary::morphology::SparseLevels *output,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_determinate_border_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_insert_new_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_comparison_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_remove_candidate_memory_access_counter,
+    std::vector<imaging::ImagePositionIndex>
+        *algorithm_number_of_elements_in_border,
+    double *start,
+    double *end) {
+  if (output == NULL || end == NULL) return false;
+  size_t k = 0;
+  imaging::grayscale::Image *no_output = NULL;
+  bool ok_so_far = true;
+  struct timeval timer;
+  ok_so_far = PrepareSparse(plan, image.size(),
+      algorithm_determinate_border_comparison_counter,
+      algorithm_insert_new_candidate_comparison_counter,
+      algorithm_insert_new_candidate_memory_access_counter,
+      algorithm_remove_candidate_comparison_counter,
+      algorithm_remove_candidate_memory_access_counter,
+      algorithm_number_of_elements_in_border,
+      start);
+  if (!ok_so_far) return ok_so_far;
+  keeps_levels_ = true;
+  remaining_ = image.foreground();
+  ok_so_far = InitializeRemaining();
+  if (!ok_so_far) return ok_so_far;
+  // Actual algorithm!
+  ok_so_far = this->ActualAlgorithm(&no_output);
+  if (!ok_so_far) return ok_so_far;
+  // Pixels left, which no SE could erode, keep the unreached value.
+  for (k = 0; k < remaining_.size(); ++k) {
+    levels_.push_back(std::make_pair(remaining_[k], 0));
+  }
+  ok_so_far = output->Set(image.size(), &levels_, -1);
+  // Finally!
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  this->clear();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::SparseErosion::HasCandidates() const {
+  return !remaining_.empty();
+}
+
+bool imaging::binary::morphology::SparseErosion::InitialCandidatePositionFound(
+    const imaging::binary::Image &/*image*/,
+    const imaging::ImagePositionIndex &/*image_position*/,
+    const imaging::Position &/*value*/) {
+  return true;
+}
+
+bool imaging::binary::morphology::SparseErosion::InitializeCandidateData(
+    const imaging::binary::Image &image) {
+  bool found = false;
+  imaging::ImagePositionIndex index = 0;
+  bool ok_so_far = true;
+  // Every foreground pixel is a candidate.
+  ok_so_far = image.NextSetBit(0, &found, &index);
+  while (ok_so_far && found) {
+    remaining_.push_back(index);
+    ok_so_far = image.NextSetBit(index+1, &found, &index);
+  }
+  if (!ok_so_far) return ok_so_far;
+  return InitializeRemaining();
+}
+
+bool imaging::binary::morphology::SparseErosion::InitializeRemaining() {
+  bool ok_so_far = true;
+  // Candidates are kept as a sorted list, so only the header is needed.
+  ok_so_far = InitializeCandidateHeader();
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::InteriorBounds(candidate_region_, u_reach_, &interior_lower_,
+      &interior_upper_);
+  if (ok_so_far && debug_) {
+    debug_output_ << "\tAfter initialize candidate data:\n";
+    ok_so_far = this->Debug();
+    debug_output_ << "\n";
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::SparseErosion::InsertNewCandidateFromBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (!keeps_levels_ && *output_image == NULL) return false;
+  return true;
+}
+
+bool imaging::binary::morphology::SparseErosion::ListsCandidates() const {
+  return false;
+}
+
+bool imaging::binary::morphology::SparseErosion::MarkUnprocessed(
+    const imaging::ImagePositionIndex level,
+    imaging::grayscale::Image **output_image) {
+  if (!keeps_levels_) return Transform::MarkUnprocessed(level, output_image);
+  size_t k = 0;
+  // Unprocessed pixels are the ones left.
+  for (k = 0; k < remaining_.size(); ++k) {
+    levels_.push_back(std::make_pair(remaining_[k],
+        static_cast<int>(level)));
+  }
+  remaining_.clear();
+  return true;
+}
+
+bool imaging::binary::morphology::SparseErosion::RemoveBorder(
+    imaging::grayscale::Image **output_image) {
+  if (output_image == NULL) return false;
+  if (!keeps_levels_ && *output_image == NULL) return false;
+  imaging::ImagePositionIndex i = 0;
+  size_t k = 0;
+  size_t kept = 0;
+  bool ok_so_far = true;
+  for (i = 0; ok_so_far && i < border_counter_; ++i) {
+    if (keeps_levels_) {
+      levels_.push_back(std::make_pair(border_indexes_[i],
+          static_cast<int>(se_iteration_)));
+    } else {
+      ok_so_far = (*output_image)->set_value(border_indexes_[i],
+          se_iteration_);
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  algorithm_remove_candidate_memory_access_counter_->at(se_iteration_)
+      += border_counter_;
+  // Both lists are sorted, so the border is dropped in a single pass.
+  i = 0;
+  for (k = 0; k < remaining_.size(); ++k) {
+    if (i < border_counter_ && border_indexes_[i] == remaining_[k]) {
+      ++i;
+      continue;
+    }
+    remaining_[kept++] = remaining_[k];
+  }
+  remaining_.resize(kept);
+  return ok_so_far;
+}
@@ -0,0 +1,240 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the sparse binary image and levels,
+// which keep only the pixels a run touches, and of the sparse erosion and
+// dilation transforms, which keep the pixels they work on as sets of linear
+// indexes.
+
+#ifndef SPARSE_H_
+#define SPARSE_H_
+
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+// Binary image stored as the linear indexes of its foreground pixels, sorted
+// and without repetitions. Indexes number the pixels with the first
+// dimension varying fastest and without the row alignment of
+// imaging::binary::Image. Memory scales with the foreground area instead of
+// with the area of the image.
+class SparseImage {
+ public:
+  explicit SparseImage(const imaging::Size &size) : size_(size) {}
+  ~SparseImage() {}
+  // Takes the size and the foreground of 'image'.
+  bool CopyFrom(const imaging::binary::Image &image);
+  // Sets the pixels of 'image', whose size must match, as the ones of this
+  // image.
+  bool CopyTo(imaging::binary::Image *image) const;
+  const std::vector<imaging::ImagePositionIndex>& foreground() const;
+  // Sets the pixel at 'position' as foreground. Pixels inserted in
+  // increasing index order are appended in constant time.
+  bool Insert(const imaging::Position &position);
+  const imaging::Size& size() const;
+ private:
+  std::vector<imaging::ImagePositionIndex> foreground_;
+  imaging::Size size_;
+}; // imaging::binary::SparseImage
+
+
+namespace morphology {
+
+
+// Output of a sparse run: the level of every pixel the run touched, as
+// (index, level) pairs sorted by the index, numbered as by SparseImage; every
+// other pixel takes a single level.
+class SparseLevels {
+ public:
+  SparseLevels() : others_(-1) {}
+  ~SparseLevels() {}
+  // Sets 'image', whose size must match the one of the run, as the dense
+  // output of the run.
+  bool CopyTo(imaging::grayscale::Image *image) const;
+  const std::vector< std::pair<imaging::ImagePositionIndex, int> >&
+      levels() const;
+  int others() const;
+  // Takes the pairs of '*levels', which is left empty, for an image of
+  // 'size' whose other pixels take 'others'.
+  bool Set(const imaging::Size &size,
+      std::vector< std::pair<imaging::ImagePositionIndex, int> > *levels,
+      const int others);
+  const imaging::Size& size() const;
+ private:
+  std::vector< std::pair<imaging::ImagePositionIndex, int> > levels_;
+  int others_;
+  imaging::Size size_;
+}; // imaging:::binary::morphology::SparseLevels
+
+
+// Dilation for very sparse inputs. Membership is a hash set of the reached
+// pixels, and each SE step only visits the pixels reached since the previous
+// step of the same SE, as the neighbors of the older ones are already at the
+// foreground. Through ExecuteSparse, no image sized structure is allocated:
+// time and memory scale with the reached area instead of the image area.
+// Execute keeps the dense output and Y_ of the other engines.
+class SparseDilation : public DilationTransform {
+ public:
+  SparseDilation(const bool debug, std::ostream &debug_output)
+      : DilationTransform(false, false, debug, debug_output),
+        candidates_(0), foreground_(0), keeps_levels_(false),
+        unreached_value_(-1) {}
+  virtual ~SparseDilation();
+  // Same as Execute, for an image and an output kept sparse. The guard band
+  // is not needed, as neighbors are always checked against the image.
+  bool ExecuteSparse(const TransformPlan &plan,
+      const imaging::binary::SparseImage &image, SparseLevels *output,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border,
+      double *start, double *end);
+ protected:
+  virtual bool clear();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool MarkUnprocessed(const imaging::ImagePositionIndex level,
+      imaging::grayscale::Image **output_image);
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  SparseDilation()
+      : DilationTransform(false, false, false, std::cout), candidates_(0),
+        foreground_(0), keeps_levels_(false), unreached_value_(-1) {}
+  // Sets up the run from the input pixels, which reached_ holds in index
+  // order.
+  bool InitializeReached();
+
+  std::vector<imaging::ImagePositionIndex> border_indexes_;
+  imaging::ImagePositionIndex candidates_; // background pixels left
+  // Number of pixels of reached_ already visited by each SE.
+  std::vector<size_t> expanded_;
+  size_t foreground_; // input pixels, which lead reached_
+  // Bounds of the pixels whose neighbors lie in the candidate region.
+  imaging::Position interior_lower_;
+  imaging::Position interior_upper_;
+  // Whether levels go to levels_, for ExecuteSparse, instead of the output
+  // image.
+  bool keeps_levels_;
+  std::vector< std::pair<imaging::ImagePositionIndex, int> > levels_;
+  // Foreground pixels, in the order they were reached, and as a set.
+  std::vector<imaging::ImagePositionIndex> reached_;
+  std::unordered_set<imaging::ImagePositionIndex> reached_set_;
+  int unreached_value_; // level of the pixels left out of levels_
+
+  DISALLOW_COPY_AND_ASSIGN(SparseDilation);
+}; // imaging:::binary::morphology::SparseDilation
+
+
+// Erosion for very sparse inputs. Membership is the sorted list of the
+// foreground pixels left, and each SE step only visits those pixels instead
+// of every pixel of the image. Through ExecuteSparse, no image sized
+// structure is allocated: time and memory scale with the foreground area.
+// Execute keeps the dense output and Y_ of the other engines.
+class SparseErosion : public ErosionTransform {
+ public:
+  SparseErosion(const bool debug, std::ostream &debug_output)
+      : ErosionTransform(false, false, debug, debug_output),
+        keeps_levels_(false) {}
+  virtual ~SparseErosion();
+  // Same as SparseDilation::ExecuteSparse.
+  bool ExecuteSparse(const TransformPlan &plan,
+      const imaging::binary::SparseImage &image, SparseLevels *output,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_determinate_border_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_insert_new_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_comparison_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_remove_candidate_memory_access_counter,
+      std::vector<imaging::ImagePositionIndex>
+          *algorithm_number_of_elements_in_border,
+      double *start, double *end);
+ protected:
+  virtual bool clear();
+  virtual bool Debug();
+  virtual bool DetectBorder(
+      const imaging::SEIndex current_se_index,
+      const std::vector<imaging::ImagePositionIndex> &current_se_indexes);
+  virtual bool HasCandidates() const;
+  virtual bool InitialCandidatePositionFound(
+      const imaging::binary::Image &image,
+      const imaging::ImagePositionIndex &image_position,
+      const imaging::Position &value);
+  virtual bool InitializeCandidateData(const imaging::binary::Image &image);
+  virtual bool InsertNewCandidateFromBorder(
+      imaging::grayscale::Image **output_image);
+  virtual bool ListsCandidates() const;
+  virtual bool MarkUnprocessed(const imaging::ImagePositionIndex level,
+      imaging::grayscale::Image **output_image);
+  virtual bool RemoveBorder(imaging::grayscale::Image **output_image);
+ private:
+  SparseErosion()
+      : ErosionTransform(false, false, false, std::cout),
+        keeps_levels_(false) {}
+  // Sets up the run from the input pixels, which remaining_ holds in index
+  // order.
+  bool InitializeRemaining();
+
+  std::vector<imaging::ImagePositionIndex> border_indexes_; // sorted
+  imaging::Position interior_lower_;
+  imaging::Position interior_upper_;
+  bool keeps_levels_; // as SparseDilation::keeps_levels_
+  std::vector< std::pair<imaging::ImagePositionIndex, int> > levels_;
+  std::vector<imaging::ImagePositionIndex> remaining_; // sorted
+
+  DISALLOW_COPY_AND_ASSIGN(SparseErosion);
+}; // imaging:::binary::morphology::SparseErosion
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // SPARSE_H_
@@ -0,0 +1,255 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the implementation of the streaming transform.
+
+#include <vector>
+
+#include <sys/time.h>
+
+#include "stream.h"
+#include "img-inl.h"
+
+namespace {
+
+// Number of counters taken by Transform::Execute.
+const unsigned COUNTERS = 6;
+
+// Sets rows [target, target+count) of 'target_image' as rows [source,
+// source+count) of 'image', whose rows must have the same stride. Rows are
+// copied in increasing order, so an image may move its rows backwards.
+bool CopyRows(const imaging::binary::Image &image, const long source,
+    const long count, const long target, imaging::binary::Image *target_image) {
+  if (target_image == NULL) return false;
+  const char last = imaging::Dimension::number()-1;
+  const long stride = image.Stride(last);
+  if (stride != target_image->Stride(last)) return false;
+  imaging::ImagePositionIndex i = 0;
+  const imaging::ImagePositionIndex length = count*stride;
+  bool ok_so_far = true;
+  const imaging::ImagePositionIndex source_index = source*stride;
+  const imaging::ImagePositionIndex target_index = target*stride;
+  bool value = false;
+  for (i = 0; ok_so_far && i < length; ++i) {
+    ok_so_far = image.value(source_index+i, &value);
+    if (!ok_so_far) continue;
+    ok_so_far = target_image->set_value(target_index+i, value);
+  }
+  return ok_so_far;
+}
+
+// Rows reached by an iteration, that is, the sum over the SEs of the
+// largest absolute last coordinate of their elements.
+bool CalculateRowReach(const imaging::binary::morphology::TransformPlan &plan,
+    long *reach) {
+  if (reach == NULL) return false;
+  long coordinate_value = 0;
+  const char last = imaging::Dimension::number()-1;
+  long se_reach = 0;
+  std::vector< std::vector<imaging::ImagePositionIndex> >::const_iterator
+      current_se;
+  std::vector<imaging::ImagePositionIndex>::const_iterator current;
+  *reach = 0;
+  for (current_se = plan.se_elements().begin();
+      current_se != plan.se_elements().end(); ++current_se) {
+    se_reach = 0;
+    for (current = current_se->begin(); current != current_se->end();
+        ++current) {
+      coordinate_value = plan.u_elements().at(*current).coordinate(last);
+      if (coordinate_value < 0) coordinate_value = -coordinate_value;
+      if (coordinate_value > se_reach) se_reach = coordinate_value;
+    }
+    *reach += se_reach;
+  }
+  return true;
+}
+
+} // namespace
+
+// imaging::binary::morphology::StreamTransform
+
+imaging::binary::morphology::StreamTransform::~StreamTransform() {
+  clear();
+  if (engine_ != NULL) {
+    delete engine_;
+    engine_ = NULL;
+  }
+}
+
+bool imaging::binary::morphology::StreamTransform::Execute(
+    const imaging::binary::morphology::TransformPlan &plan,
+    imaging::binary::morphology::RowSource *source,
+    imaging::binary::morphology::RowSink *sink,
+    double *start,
+    double *end) {
+  if (source == NULL || sink == NULL || start == NULL || end == NULL)
+    return false;
+  if (factory_ == NULL || !plan.initialized()) return false;
+  if (strip_rows_ < 1 || levels_ < 1) return false;
+  long count = 0;
+  std::vector< std::vector<imaging::ImagePositionIndex> > counters(COUNTERS);
+  long first = 0;
+  long halo = 0;
+  unsigned k = 0;
+  const char last = imaging::Dimension::number()-1;
+  long lower = 0;
+  bool ok_so_far = true;
+  long row_reach = 0;
+  const long rows = source->size().Length(last);
+  struct timeval timer;
+  long upper = 0;
+  double window_end = 0.;
+  double window_start = 0.;
+  this->clear();
+  if (rows < 1) return false;
+  ok_so_far = ::CalculateRowReach(plan, &row_reach);
+  if (!ok_so_far) return ok_so_far;
+  halo = static_cast<long>(levels_)*row_reach;
+  if (engine_ == NULL) engine_ = factory_();
+  if (engine_ == NULL) return false;
+  ok_so_far = engine_->set_max_iterations(levels_);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = engine_->set_seed(seed_, stream_);
+  if (!ok_so_far) return ok_so_far;
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  for (first = 0; ok_so_far && first < rows; first += strip_rows_) {
+    count = rows-first < strip_rows_ ? rows-first : strip_rows_;
+    lower = first-halo < 0 ? 0 : first-halo;
+    upper = first+count+halo > rows ? rows : first+count+halo;
+    ok_so_far = SlideWindow(lower, upper-lower, source);
+    if (!ok_so_far) continue;
+    if (output_ != NULL && !output_->size().Equals(window_->size())) {
+      delete output_;
+      output_ = NULL;
+    }
+    if (output_ == NULL) output_ = new imaging::grayscale::Image(
+        window_->size(), 0);
+    if (output_ == NULL) ok_so_far = false;
+    if (!ok_so_far) continue;
+    for (k = 0; k < COUNTERS; ++k) counters.at(k).clear();
+    ok_so_far = engine_->Execute(plan, *window_, output_, &counters.at(0),
+        &counters.at(1), &counters.at(2), &counters.at(3), &counters.at(4),
+        &counters.at(5), &window_start, &window_end);
+    if (!ok_so_far) continue;
+    ok_so_far = DetectCapped(first-lower, count);
+    if (!ok_so_far) continue;
+    ok_so_far = sink->Write(first, count, first-lower, *output_);
+  }
+  // The end.
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::StreamTransform::capped() const {
+  return capped_;
+}
+
+bool imaging::binary::morphology::StreamTransform::set_seed(
+    const uint64_t seed, const uint64_t stream) {
+  seed_ = seed;
+  stream_ = stream;
+  return true;
+}
+
+bool imaging::binary::morphology::StreamTransform::clear() {
+  capped_ = false;
+  if (output_ != NULL) {
+    delete output_;
+    output_ = NULL;
+  }
+  if (window_ != NULL) {
+    delete window_;
+    window_ = NULL;
+  }
+  window_first_ = 0;
+  return true;
+}
+
+bool imaging::binary::morphology::StreamTransform::DetectCapped(
+    const long first, const long count) {
+  if (capped_) return true;
+  char i = 0;
+  const char last = imaging::Dimension::number()-1;
+  const int marked_value = static_cast<int>(levels_+1);
+  bool ok_so_far = true;
+  imaging::Position strip_lower;
+  imaging::Position strip_upper;
+  int value = 0;
+  for (i = 0; ok_so_far && i < last; ++i) {
+    ok_so_far = strip_lower.set_value(i, 0);
+    if (!ok_so_far) continue;
+    ok_so_far = strip_upper.set_value(i, window_->Length(i)-1);
+  }
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = strip_lower.set_value(last, first);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = strip_upper.set_value(last, first+count-1);
+  if (!ok_so_far) return ok_so_far;
+  const imaging::BoundingBox strip(strip_lower, strip_upper);
+  imaging::PositionIterator iterator(strip);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    ok_so_far = output_->value(iterator.value(), &value);
+    if (!ok_so_far) continue;
+    if (value == marked_value) capped_ = true;
+  } while (ok_so_far && !capped_ && iterator.iterate());
+  if (ok_so_far && !capped_ && !iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::StreamTransform::SlideWindow(
+    const long first, const long count, RowSource *source) {
+  if (source == NULL || count < 1) return false;
+  char i = 0;
+  long kept_end = first;
+  long kept_first = first;
+  const char last = imaging::Dimension::number()-1;
+  imaging::Position lengths;
+  bool ok_so_far = true;
+  imaging::binary::Image *previous = window_;
+  // Windows only move forward, so the rows kept are a prefix of the new
+  // window and a suffix of the previous one.
+  if (previous != NULL) {
+    if (first < window_first_) return false;
+    kept_end = window_first_+previous->Length(last);
+    if (kept_end > first+count) kept_end = first+count;
+    if (kept_end < first) kept_end = first;
+  }
+  if (previous == NULL || previous->Length(last) != count) {
+    for (i = 0; ok_so_far && i < last; ++i) {
+      ok_so_far = lengths.set_value(i, source->size().Length(i));
+    }
+    if (!ok_so_far) return ok_so_far;
+    ok_so_far = lengths.set_value(last, count);
+    if (!ok_so_far) return ok_so_far;
+    window_ = new imaging::binary::Image(imaging::Size(lengths), true);
+    if (window_ == NULL) return false;
+  }
+  if (kept_first < kept_end) {
+    ok_so_far = ::CopyRows(*previous, kept_first-window_first_,
+        kept_end-kept_first, 0, window_);
+  }
+  if (previous != NULL && previous != window_) delete previous;
+  if (!ok_so_far) return ok_so_far;
+  window_first_ = first;
+  if (kept_end == first+count) return ok_so_far;
+  return source->Read(kept_end, first+count-kept_end, kept_end-first,
+      window_);
+}
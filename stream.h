@@ -0,0 +1,132 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+// This file contains the declaration of the streaming transform, which runs
+// an image strip by strip, so the whole image is never held in memory.
+
+#ifndef STREAM_H_
+#define STREAM_H_
+
+#include "img.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+// Input of a streaming transform. Rows are the slices of the image at its
+// last dimension, which are read in increasing order.
+class RowSource {
+ public:
+  RowSource() {}
+  virtual ~RowSource() {}
+  // Sets rows [first, first+count) of the image as rows [target,
+  // target+count) of 'image', whose other lengths are the ones of the image.
+  virtual bool Read(const long first, const long count, const long target,
+      imaging::binary::Image *image) = 0;
+  // Size of the whole image.
+  virtual const imaging::Size& size() const = 0;
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RowSource);
+}; // imaging:::binary::morphology::RowSource
+
+
+// Output of a streaming transform, which takes each row once it is final,
+// in increasing order.
+class RowSink {
+ public:
+  RowSink() {}
+  virtual ~RowSink() {}
+  // Takes rows [source, source+count) of 'image' as rows [first,
+  // first+count) of the output.
+  virtual bool Write(const long first, const long count, const long source,
+      const imaging::grayscale::Image &image) = 0;
+ private:
+  DISALLOW_COPY_AND_ASSIGN(RowSink);
+}; // imaging:::binary::morphology::RowSink
+
+
+// Runs a transform over strips of rows of the image. Only a window is kept
+// in memory: the strip and, at each side, a halo as tall as the levels in
+// flight times the rows reached by an iteration. The window slides from
+// strip to strip, so only rows new to it are read, and the rows of the
+// strip are written as soon as its run ends.
+//
+// Each window is run with max_iterations set as the levels in flight. The
+// rows of a strip lie farther than the reach of those levels from the
+// window sides which are not sides of the image, so the output equals the
+// one of a whole image run capped at the same levels: pixels of levels up
+// to the cap are exact, and the ones beyond it are set as the cap plus one,
+// which capped reports.
+class StreamTransform {
+ public:
+  // Strips have 'strip_rows' rows, except the last one, which takes the
+  // remaining rows. Both arguments must be positive.
+  StreamTransform(TransformFactory factory, const long strip_rows,
+      const imaging::ImagePositionIndex levels)
+      : capped_(false), engine_(NULL), factory_(factory), levels_(levels),
+        output_(NULL), seed_(0), strip_rows_(strip_rows), stream_(0),
+        window_(NULL), window_first_(0) {}
+  ~StreamTransform();
+  // Same as Transform::Execute, reading the image from 'source' and writing
+  // the output to 'sink', without per iteration counters.
+  bool Execute(const TransformPlan &plan, RowSource *source, RowSink *sink,
+      double *start, double *end);
+  // Whether the last run left pixels beyond the levels in flight.
+  bool capped() const;
+  // Same as Transform::set_seed. Every window restarts the same sequence.
+  bool set_seed(const uint64_t seed, const uint64_t stream);
+ private:
+  StreamTransform()
+      : capped_(false), engine_(NULL), factory_(NULL), levels_(0),
+        output_(NULL), seed_(0), strip_rows_(0), stream_(0), window_(NULL),
+        window_first_(0) {}
+  bool clear();
+  // Sets capped_ if rows [first, first+count) of output_ hold pixels beyond
+  // the levels in flight.
+  bool DetectCapped(const long first, const long count);
+  // Slides the window to rows [first, first+count) of the image, keeping
+  // the rows it already holds and reading the other ones from 'source'.
+  bool SlideWindow(const long first, const long count, RowSource *source);
+
+  bool capped_;
+  imaging::binary::morphology::Transform* engine_;
+  TransformFactory factory_;
+  imaging::ImagePositionIndex levels_;
+  imaging::grayscale::Image* output_; // of the window
+  uint64_t seed_;
+  long strip_rows_;
+  uint64_t stream_;
+  imaging::binary::Image* window_;
+  long window_first_; // image row held as the first window row
+
+  DISALLOW_COPY_AND_ASSIGN(StreamTransform);
+}; // imaging:::binary::morphology::StreamTransform
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // STREAM_H_
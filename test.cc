@@ -17,18 +17,30 @@
 // This file contains the implementation of an algorithm tester for both
 // erosion and dilation for 2D images.
 
+#include <atomic>
 #include <cmath>
 #include <fstream>
+#include <vector>
 
+#include "batch.h"
+#include "bitwise.h"
 #include "border.h"
+#include "fuse.h"
 #include "naive.h"
 #include "matrix.h"
+#include "rle.h"
+#include "sparse.h"
+#include "stream.h"
+#include "tile.h"
 
 #include "img_2d.h"
 #include "test.h"
 
 namespace {
 
+// Engines of the tester, each one with an erosion and a dilation.
+const int ENGINES = 6;
+
 static imaging::BoundingBox *bb = NULL;
 static int half_se_length = 0;
 static imaging::Position *p = NULL;
@@ -111,6 +123,831 @@ bool SetRandomSE(imaging::binary::StructuringElement **se_to_be) {
   return ok_so_far;
 }
 
+// Engine of the algorithm selected by bit 'algorithm': 0 naive, 1 border,
+// 2 matrix, 3 bitwise, 4 rle and 5 sparse. Bits 0 to 5 keep the naive,
+// border and matrix erosions and dilations; later engines take the next
+// bits, erosion first, so selections of existing scripts keep their meaning.
+int AlgorithmEngine(const int algorithm) {
+  if (algorithm < 6) return algorithm%3;
+  return 3+(algorithm-6)/2;
+}
+
+bool IsErosion(const int algorithm) {
+  if (algorithm < 6) return algorithm < 3;
+  return (algorithm%2) == 0;
+}
+
+const char* EngineName(const int engine) {
+  switch (engine) {
+    case 0:  return "naive";
+    case 1:  return "border";
+    case 2:  return "matrix";
+    case 3:  return "bitwise";
+    case 4:  return "rle";
+    case 5:  return "sparse";
+    default: return "unknown";
+  }
+}
+
+// Erosion or dilation of 'engine', as numbered by AlgorithmEngine.
+imaging::binary::morphology::Transform* NewTransform(const int engine,
+    const bool true_for_erosion, const bool debug,
+    std::ostream &debug_output) {
+  switch (engine) {
+    case 0:  if (true_for_erosion) {
+               return new imaging::binary::morphology::NaiveErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::NaiveDilation(debug,
+                 debug_output);
+    case 1:  if (true_for_erosion) {
+               return new imaging::binary::morphology::BorderErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::BorderDilation(debug,
+                 debug_output);
+    case 2:  if (true_for_erosion) {
+               return new imaging::binary::morphology::MatrixErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::MatrixDilation(debug,
+                 debug_output);
+    case 3:  if (true_for_erosion) {
+               return new imaging::binary::morphology::BitwiseErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::BitwiseDilation(debug,
+                 debug_output);
+    case 4:  if (true_for_erosion) {
+               return new imaging::binary::morphology::RleErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::RleDilation(debug,
+                 debug_output);
+    case 5:  if (true_for_erosion) {
+               return new imaging::binary::morphology::SparseErosion(debug,
+                   debug_output);
+             }
+             return new imaging::binary::morphology::SparseDilation(debug,
+                 debug_output);
+    default: return NULL;
+  }
+}
+
+template< int engine, bool true_for_erosion >
+imaging::binary::morphology::Transform* NewEngine() {
+  return ::NewTransform(engine, true_for_erosion, false, std::cout);
+}
+
+// Factory of the erosion or dilation of 'engine', for the transforms that
+// create their own engines.
+imaging::binary::morphology::TransformFactory Factory(const int engine,
+    const bool true_for_erosion) {
+  static const imaging::binary::morphology::TransformFactory
+      factories[2*::ENGINES] = {
+    &::NewEngine<0, true>, &::NewEngine<0, false>,
+    &::NewEngine<1, true>, &::NewEngine<1, false>,
+    &::NewEngine<2, true>, &::NewEngine<2, false>,
+    &::NewEngine<3, true>, &::NewEngine<3, false>,
+    &::NewEngine<4, true>, &::NewEngine<4, false>,
+    &::NewEngine<5, true>, &::NewEngine<5, false>
+  };
+  if (engine < 0 || engine >= ::ENGINES) return NULL;
+  return factories[2*engine+(true_for_erosion ? 0 : 1)];
+}
+
+// Runs 'transform' over 'image' for the SEs of 'plan', without keeping its
+// counters. 'output' must have the size of 'image'.
+bool RunTransform(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image,
+    imaging::binary::morphology::Transform *transform,
+    imaging::grayscale::Image *output) {
+  if (transform == NULL || output == NULL) return false;
+  std::vector<imaging::ImagePositionIndex> c0, c1, c2, c3, c4, c5;
+  double end = 0.;
+  double start = 0.;
+  return transform->Execute(plan, image, output, &c0, &c1, &c2, &c3, &c4,
+      &c5, &start, &end);
+}
+
+// Whether 'capped' is 'plain' with every level beyond 'levels', unreached
+// pixels included, set as levels+1. Pixels kept as at the input match as
+// they are.
+bool EqualsClamped(const imaging::grayscale::Image &plain,
+    const imaging::grayscale::Image &capped, const bool true_for_erosion,
+    const int levels, bool *equal) {
+  if (equal == NULL) return false;
+  int capped_value = 0;
+  const int kept_value = true_for_erosion ? -1 : 0;
+  bool ok_so_far = true;
+  int value = 0;
+  *equal = plain.size().Equals(capped.size());
+  if (!*equal) return ok_so_far;
+  imaging::PositionIterator iterator(plain.size());
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    ok_so_far = plain.value(iterator.value(), &value);
+    if (!ok_so_far) continue;
+    ok_so_far = capped.value(iterator.value(), &capped_value);
+    if (!ok_so_far) continue;
+    if (value != kept_value && (value < 1 || value > levels)) value = levels+1;
+    if (value != capped_value) *equal = false;
+  } while (ok_so_far && *equal && iterator.iterate());
+  return ok_so_far;
+}
+
+// Copies rows [from_row, from_row+count) of 'from' as rows [to_row,
+// to_row+count) of 'to', both images with the same lengths but the last.
+template< class I, class V >
+bool CopyRows(const I &from, const long from_row, const long count,
+    const long to_row, I *to) {
+  if (to == NULL || count < 1) return false;
+  char i = 0;
+  const char last = imaging::Dimension::number()-1;
+  imaging::Position lower;
+  bool ok_so_far = true;
+  imaging::Position target;
+  imaging::Position upper;
+  V value;
+  for (i = 0; ok_so_far && i < last; ++i) {
+    ok_so_far = upper.set_value(i, from.Length(i)-1);
+  }
+  if (ok_so_far) ok_so_far = lower.set_value(last, from_row);
+  if (ok_so_far) ok_so_far = upper.set_value(last, from_row+count-1);
+  if (!ok_so_far) return ok_so_far;
+  const imaging::BoundingBox rows(lower, upper);
+  imaging::PositionIterator iterator(rows);
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    ok_so_far = from.value(current, &value);
+    if (!ok_so_far) continue;
+    ok_so_far = target.CopyFrom(current);
+    if (!ok_so_far) continue;
+    ok_so_far = target.set_value(last,
+        current.coordinate(last)-from_row+to_row);
+    if (!ok_so_far) continue;
+    ok_so_far = to->set_value(target, value);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+// Streams the rows of an image held in memory.
+class ImageRowSource : public imaging::binary::morphology::RowSource {
+ public:
+  explicit ImageRowSource(const imaging::binary::Image &image)
+      : image_(image) {}
+  virtual ~ImageRowSource() {}
+  virtual bool Read(const long first, const long count, const long target,
+      imaging::binary::Image *image) {
+    return ::CopyRows<imaging::binary::Image, bool>(image_, first, count,
+        target, image);
+  }
+  virtual const imaging::Size& size() const {
+    return image_.size();
+  }
+ private:
+  const imaging::binary::Image &image_;
+  DISALLOW_COPY_AND_ASSIGN(ImageRowSource);
+}; // ::ImageRowSource
+
+// Writes the streamed rows to an image held in memory.
+class ImageRowSink : public imaging::binary::morphology::RowSink {
+ public:
+  explicit ImageRowSink(imaging::grayscale::Image *image) : image_(image) {}
+  virtual ~ImageRowSink() {}
+  virtual bool Write(const long first, const long count, const long source,
+      const imaging::grayscale::Image &image) {
+    return ::CopyRows<imaging::grayscale::Image, int>(image, source, count,
+        first, image_);
+  }
+ private:
+  imaging::grayscale::Image *image_;
+  DISALLOW_COPY_AND_ASSIGN(ImageRowSink);
+}; // ::ImageRowSink
+
+// Reports the result of comparing the outputs of 'mode' to plain runs.
+void ReportCheck(const std::string &mode, const int engine,
+    const bool true_for_erosion, const bool be_verbose, const bool equal) {
+  if (equal && !be_verbose) return;
+  if (equal) {
+    printf("verbose message: ");
+  } else {
+    printf("error: ");
+  }
+  printf("%s %s %s ", mode.c_str(), ::EngineName(engine),
+      true_for_erosion ? "erosion" : "dilation");
+  printf(equal ? "equals the plain run.\n" : "differs from the plain run.\n");
+}
+
+// Runs with the flag set by 'setter' must give the outputs of plain runs,
+// for dilations too unless 'erosion_only' is set.
+bool CheckFlag(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const std::string &mode,
+    bool (imaging::binary::morphology::Transform::*setter)(const bool),
+    const bool erosion_only, const bool be_verbose, bool *equal) {
+  if (equal == NULL || setter == NULL) return false;
+  int delta = 0;
+  int engine = 0;
+  bool ok_so_far = true;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < (erosion_only ? 1 : 2); ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &image = true_for_erosion ? image_e : image_d;
+    imaging::grayscale::Image flagged(image.size(), 0);
+    imaging::grayscale::Image plain(image.size(), 0);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      transform = ::NewTransform(engine, true_for_erosion, false, std::cout);
+      if (transform == NULL) ok_so_far = false;
+      if (!ok_so_far) continue;
+      ok_so_far = transform->set_seed(seed, 0);
+      if (ok_so_far) ok_so_far = ::RunTransform(plan, image, transform, &plain);
+      if (ok_so_far) ok_so_far = (transform->*setter)(true);
+      if (ok_so_far) {
+        ok_so_far = ::RunTransform(plan, image, transform, &flagged);
+      }
+      delete transform;
+      transform = NULL;
+      if (!ok_so_far) continue;
+      ::ReportCheck(mode, engine, true_for_erosion, be_verbose,
+          plain.Equals(flagged));
+      if (!plain.Equals(flagged)) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Each image of a batch must give the output of its own run. Both images
+// make up the batch, so engines are also reused across sizes.
+bool CheckBatch(const imaging::binary::morphology::TransformPlan &plan,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  imaging::binary::morphology::BatchTransform *batch = NULL;
+  bool batch_equal = true;
+  int delta = 0;
+  double end = 0.;
+  int engine = 0;
+  imaging::ImagePositionIndex i = 0;
+  std::vector<imaging::binary::Image*> images;
+  bool ok_so_far = true;
+  std::vector<imaging::grayscale::Image*> outputs;
+  double start = 0.;
+  imaging::binary::morphology::Transform *transform = NULL;
+  // The batch only reads its images.
+  images.push_back(const_cast<imaging::binary::Image*>(&image_e));
+  images.push_back(const_cast<imaging::binary::Image*>(&image_d));
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      batch = new imaging::binary::morphology::BatchTransform(
+          ::Factory(engine, true_for_erosion));
+      ok_so_far = batch->set_threads(2);
+      if (ok_so_far) ok_so_far = batch->set_seed(seed, 0);
+      if (ok_so_far) {
+        ok_so_far = batch->Calculate(images, se, &outputs, &start, &end);
+      }
+      delete batch;
+      batch = NULL;
+      batch_equal = true;
+      for (i = 0; ok_so_far && i < images.size(); ++i) {
+        imaging::grayscale::Image plain(images.at(i)->size(), -1);
+        transform = ::NewTransform(engine, true_for_erosion, false, std::cout);
+        if (transform == NULL) ok_so_far = false;
+        if (!ok_so_far) continue;
+        ok_so_far = transform->set_seed(seed, 0);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, *images.at(i), transform, &plain);
+        }
+        delete transform;
+        transform = NULL;
+        if (ok_so_far && !plain.Equals(*outputs.at(i))) batch_equal = false;
+      }
+      for (i = 0; i < outputs.size(); ++i) delete outputs.at(i);
+      outputs.clear();
+      if (!ok_so_far) continue;
+      ::ReportCheck("batch", engine, true_for_erosion, be_verbose,
+          batch_equal);
+      if (!batch_equal) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Fused runs must give the outputs of separate runs of both engines. The
+// erosion of each engine is paired with its own dilation, which may share
+// the candidate scan, and with the dilation of the next engine.
+bool CheckFused(const imaging::binary::morphology::TransformPlan &plan,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const bool be_verbose,
+    bool *equal) {
+  if (equal == NULL) return false;
+  imaging::grayscale::Image *dilation = NULL;
+  int dilation_engine = 0;
+  double end = 0.;
+  int engine = 0;
+  imaging::grayscale::Image *erosion = NULL;
+  bool fused_equal = true;
+  imaging::binary::morphology::FusedTransform *fused = NULL;
+  int i_image = 0;
+  int pairing = 0;
+  bool ok_so_far = true;
+  double start = 0.;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (i_image = 0; ok_so_far && i_image < 2; ++i_image) {
+    const imaging::binary::Image &image = (i_image == 0) ? image_e : image_d;
+    imaging::grayscale::Image plain_dilation(image.size(), -1);
+    imaging::grayscale::Image plain_erosion(image.size(), -1);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      for (pairing = 0; ok_so_far && pairing < 2; ++pairing) {
+        dilation_engine = (engine+pairing) % ::ENGINES;
+        fused = new imaging::binary::morphology::FusedTransform(
+            ::Factory(engine, true), ::Factory(dilation_engine, false));
+        ok_so_far = fused->Calculate(image, se, &erosion, &dilation, &start,
+            &end);
+        delete fused;
+        fused = NULL;
+        transform = ::NewTransform(engine, true, false, std::cout);
+        if (ok_so_far && transform == NULL) ok_so_far = false;
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, image, transform, &plain_erosion);
+        }
+        delete transform;
+        transform = ::NewTransform(dilation_engine, false, false, std::cout);
+        if (ok_so_far && transform == NULL) ok_so_far = false;
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, image, transform, &plain_dilation);
+        }
+        delete transform;
+        transform = NULL;
+        fused_equal = (ok_so_far && plain_erosion.Equals(*erosion)
+            && plain_dilation.Equals(*dilation));
+        if (erosion != NULL) delete erosion;
+        erosion = NULL;
+        if (dilation != NULL) delete dilation;
+        dilation = NULL;
+        if (!ok_so_far) continue;
+        ::ReportCheck("fused", engine, true, be_verbose, fused_equal);
+        ::ReportCheck("fused", dilation_engine, false, be_verbose,
+            fused_equal);
+        if (!fused_equal) *equal = false;
+      }
+    }
+  }
+  return ok_so_far;
+}
+
+// Updates after flipping a small box of the image must give the output of
+// a fresh run over the flipped image.
+bool CheckUpdate(const imaging::binary::morphology::TransformPlan &plan,
+    const std::vector<imaging::binary::StructuringElement*> &se,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  int delta = 0;
+  int engine = 0;
+  char i = 0;
+  imaging::Position lower;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  bool pixel = false;
+  imaging::binary::morphology::Transform *transform = NULL;
+  imaging::Position upper;
+  long value = 0;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &image = true_for_erosion ? image_e : image_d;
+    // A box of up to 3 pixels by dimension at a third of the image.
+    for (i = 0; ok_so_far && i < n; ++i) {
+      value = image.Length(i)/3;
+      ok_so_far = lower.set_value(i, value);
+      if (!ok_so_far) continue;
+      value += 2;
+      if (value >= image.Length(i)) value = image.Length(i)-1;
+      ok_so_far = upper.set_value(i, value);
+    }
+    if (!ok_so_far) continue;
+    const imaging::BoundingBox dirty(lower, upper);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      imaging::binary::Image flipped(image);
+      imaging::grayscale::Image plain(image.size(), -1);
+      imaging::grayscale::Image updated(image.size(), -1);
+      transform = ::NewTransform(engine, true_for_erosion, false, std::cout);
+      if (transform == NULL) ok_so_far = false;
+      if (!ok_so_far) continue;
+      ok_so_far = transform->set_seed(seed, 0);
+      if (ok_so_far) {
+        ok_so_far = ::RunTransform(plan, flipped, transform, &updated);
+      }
+      imaging::PositionIterator iterator(dirty);
+      if (ok_so_far) ok_so_far = iterator.begin();
+      while (ok_so_far) {
+        ok_so_far = flipped.value(iterator.value(), &pixel);
+        if (ok_so_far) ok_so_far = flipped.set_value(iterator.value(), !pixel);
+        if (ok_so_far && !iterator.iterate()) break;
+      }
+      if (ok_so_far) ok_so_far = iterator.IsFinished();
+      if (ok_so_far) {
+        ok_so_far = transform->Update(flipped, se, dirty, &updated);
+      }
+      if (ok_so_far) {
+        ok_so_far = ::RunTransform(plan, flipped, transform, &plain);
+      }
+      delete transform;
+      transform = NULL;
+      if (!ok_so_far) continue;
+      ::ReportCheck("update", engine, true_for_erosion, be_verbose,
+          plain.Equals(updated));
+      if (!plain.Equals(updated)) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Runs capped at 'levels' iterations must give the outputs of plain runs
+// with the levels beyond the cap set as levels+1, including the pixels no
+// iteration reaches, so each operation also runs on an all background image,
+// whose run ends before the cap.
+bool CheckCap(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  int background = 0;
+  bool capped_equal = true;
+  int delta = 0;
+  int engine = 0;
+  const int levels = 2;
+  bool ok_so_far = true;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &input = true_for_erosion ? image_e : image_d;
+    const imaging::binary::Image empty(input.size(), true);
+    imaging::grayscale::Image capped(input.size(), -1);
+    imaging::grayscale::Image plain(input.size(), -1);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      capped_equal = true;
+      for (background = 0; ok_so_far && capped_equal && background < 2;
+          ++background) {
+        const imaging::binary::Image &image =
+            (background == 0) ? input : empty;
+        transform = ::NewTransform(engine, true_for_erosion, false,
+            std::cout);
+        if (transform == NULL) ok_so_far = false;
+        if (!ok_so_far) continue;
+        ok_so_far = transform->set_seed(seed, 0);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, image, transform, &plain);
+        }
+        if (ok_so_far) ok_so_far = transform->set_max_iterations(levels);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, image, transform, &capped);
+        }
+        delete transform;
+        transform = NULL;
+        if (ok_so_far) {
+          ok_so_far = ::EqualsClamped(plain, capped, true_for_erosion, levels,
+              &capped_equal);
+        }
+      }
+      if (!ok_so_far) continue;
+      ::ReportCheck("capped", engine, true_for_erosion, be_verbose,
+          capped_equal);
+      if (!capped_equal) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Runs with an already fired cancellation token must complete no iteration
+// and set every level as 1, the one beyond the completed iterations. Each
+// operation also runs on an all background and an all foreground image,
+// one of which leaves it without candidates.
+bool CheckCancelled(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  bool cancelled_equal = true;
+  int delta = 0;
+  int engine = 0;
+  const std::atomic<bool> fired(true);
+  int k = 0;
+  bool ok_so_far = true;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &input = true_for_erosion ? image_e : image_d;
+    const imaging::binary::Image empty(input.size(), true);
+    const imaging::binary::Image full(input.size(), false);
+    const imaging::binary::Image *images[] = { &input, &empty, &full };
+    imaging::grayscale::Image cancelled(input.size(), -1);
+    imaging::grayscale::Image plain(input.size(), -1);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      cancelled_equal = true;
+      for (k = 0; ok_so_far && cancelled_equal && k < 3; ++k) {
+        transform = ::NewTransform(engine, true_for_erosion, false,
+            std::cout);
+        if (transform == NULL) ok_so_far = false;
+        if (!ok_so_far) continue;
+        ok_so_far = transform->set_seed(seed, 0);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, *images[k], transform, &plain);
+        }
+        if (ok_so_far) ok_so_far = transform->set_cancellation_token(&fired);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, *images[k], transform, &cancelled);
+        }
+        if (ok_so_far) {
+          ok_so_far = ::EqualsClamped(plain, cancelled, true_for_erosion, 0,
+              &cancelled_equal);
+        }
+        if (ok_so_far && (!transform->interrupted()
+            || transform->completed_iterations() != 0)) {
+          cancelled_equal = false;
+        }
+        delete transform;
+        transform = NULL;
+      }
+      if (!ok_so_far) continue;
+      ::ReportCheck("cancelled", engine, true_for_erosion, be_verbose,
+          cancelled_equal);
+      if (!cancelled_equal) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Tiled runs of the engines which may be tiled must give the outputs of
+// plain runs, for tiles of 16 pixels and for tiles of half the image plus
+// one pixel by dimension, whose last tiles are then always shorter.
+bool CheckTiled(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  int delta = 0;
+  double end = 0.;
+  int engine = 0;
+  char i = 0;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  double start = 0.;
+  bool tiled_equal = true;
+  imaging::binary::morphology::TiledTransform *tiled = NULL;
+  int tiling = 0;
+  imaging::Position tile_size;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &image = true_for_erosion ? image_e : image_d;
+    imaging::grayscale::Image plain(image.size(), -1);
+    // Only the naive and border engines may be tiled.
+    for (engine = 0; ok_so_far && engine < 2; ++engine) {
+      transform = ::NewTransform(engine, true_for_erosion, false, std::cout);
+      if (transform == NULL) ok_so_far = false;
+      if (!ok_so_far) continue;
+      ok_so_far = transform->set_seed(seed, 0);
+      if (ok_so_far) ok_so_far = ::RunTransform(plan, image, transform, &plain);
+      delete transform;
+      transform = NULL;
+      tiled_equal = true;
+      for (tiling = 0; ok_so_far && tiling < 2; ++tiling) {
+        imaging::grayscale::Image output(image.size(), -1);
+        for (i = 0; ok_so_far && i < n; ++i) {
+          ok_so_far = tile_size.set_value(i,
+              (tiling == 0) ? 16 : image.Length(i)/2+1);
+        }
+        if (!ok_so_far) continue;
+        tiled = new imaging::binary::morphology::TiledTransform(
+            ::Factory(engine, true_for_erosion), tile_size);
+        ok_so_far = tiled->set_seed(seed, 0);
+        if (ok_so_far) ok_so_far = tiled->set_threads(2);
+        if (ok_so_far) {
+          ok_so_far = tiled->Execute(plan, image, &output, &start, &end);
+        }
+        delete tiled;
+        tiled = NULL;
+        if (ok_so_far && !plain.Equals(output)) tiled_equal = false;
+      }
+      if (!ok_so_far) continue;
+      ::ReportCheck("tiled", engine, true_for_erosion, be_verbose,
+          tiled_equal);
+      if (!tiled_equal) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Streamed runs must give the outputs of plain runs capped at the same
+// levels. Images are streamed from memory and, if 'file_path' is a PBM file,
+// from the file too.
+bool CheckStream(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const std::string &file_path,
+    const uint64_t seed, const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  int delta = 0;
+  double end = 0.;
+  int engine = 0;
+  int from_file = 0;
+  const int levels = 3;
+  bool ok_so_far = true;
+  imaging::binary::morphology::RowSource *source = NULL;
+  double start = 0.;
+  imaging::binary::morphology::StreamTransform *stream = NULL;
+  bool stream_equal = true;
+  const long strip_rows = 16;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &image = true_for_erosion ? image_e : image_d;
+    imaging::grayscale::Image capped(image.size(), -1);
+    for (engine = 0; ok_so_far && engine < ::ENGINES; ++engine) {
+      transform = ::NewTransform(engine, true_for_erosion, false, std::cout);
+      if (transform == NULL) ok_so_far = false;
+      if (!ok_so_far) continue;
+      ok_so_far = transform->set_seed(seed, 0);
+      if (ok_so_far) ok_so_far = transform->set_max_iterations(levels);
+      if (ok_so_far) {
+        ok_so_far = ::RunTransform(plan, image, transform, &capped);
+      }
+      delete transform;
+      transform = NULL;
+      stream_equal = true;
+      for (from_file = 0; ok_so_far && from_file < 2; ++from_file) {
+        bidimensional::BinaryImageRowSource file_source;
+        ::ImageRowSource image_source(image);
+        imaging::grayscale::Image streamed(image.size(), -1);
+        ::ImageRowSink sink(&streamed);
+        source = &image_source;
+        if (from_file == 1) {
+          // Files of other formats can not be streamed.
+          if (!file_source.Open(file_path, !true_for_erosion)) continue;
+          source = &file_source;
+        }
+        stream = new imaging::binary::morphology::StreamTransform(
+            ::Factory(engine, true_for_erosion), strip_rows, levels);
+        ok_so_far = stream->set_seed(seed, 0);
+        if (ok_so_far) {
+          ok_so_far = stream->Execute(plan, source, &sink, &start, &end);
+        }
+        delete stream;
+        stream = NULL;
+        if (!ok_so_far) continue;
+        ok_so_far = ::EqualsClamped(capped, streamed, true_for_erosion, levels,
+            &stream_equal);
+        if (!stream_equal) break;
+      }
+      if (!ok_so_far) continue;
+      ::ReportCheck("streamed", engine, true_for_erosion, be_verbose,
+          stream_equal);
+      if (!stream_equal) *equal = false;
+    }
+  }
+  return ok_so_far;
+}
+
+// Runs the sparse erosion or dilation 'S' over 'image', capped at 'levels'
+// iterations unless 'levels' is 0, and copies its levels to 'output'.
+template< class S >
+bool RunSparse(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image, const uint64_t seed,
+    const int levels, imaging::grayscale::Image *output) {
+  if (output == NULL) return false;
+  std::vector<imaging::ImagePositionIndex> c0, c1, c2, c3, c4, c5;
+  double end = 0.;
+  bool ok_so_far = true;
+  imaging::binary::SparseImage sparse(image.size());
+  imaging::binary::morphology::SparseLevels sparse_levels;
+  double start = 0.;
+  S transform(false, std::cout);
+  ok_so_far = sparse.CopyFrom(image);
+  if (ok_so_far) ok_so_far = transform.set_seed(seed, 0);
+  if (ok_so_far) ok_so_far = transform.set_max_iterations(levels);
+  if (ok_so_far) {
+    ok_so_far = transform.ExecuteSparse(plan, sparse, &sparse_levels, &c0,
+        &c1, &c2, &c3, &c4, &c5, &start, &end);
+  }
+  if (ok_so_far) ok_so_far = sparse_levels.CopyTo(output);
+  return ok_so_far;
+}
+
+// Sparse runs of the sparse engine, copied to dense images, must give the
+// outputs of its dense runs, plain and capped, on the image and on an all
+// background image.
+bool CheckSparse(const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const uint64_t seed,
+    const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  int background = 0;
+  int delta = 0;
+  const int engine = 5;
+  int levels = 0;
+  bool ok_so_far = true;
+  bool sparse_equal = true;
+  imaging::binary::morphology::Transform *transform = NULL;
+  for (delta = 0; ok_so_far && delta < 2; ++delta) {
+    const bool true_for_erosion = (delta == 0);
+    const imaging::binary::Image &input = true_for_erosion ? image_e : image_d;
+    const imaging::binary::Image empty(input.size(), true);
+    imaging::grayscale::Image dense(input.size(), -1);
+    imaging::grayscale::Image sparse(input.size(), -1);
+    sparse_equal = true;
+    for (background = 0; ok_so_far && sparse_equal && background < 2;
+        ++background) {
+      const imaging::binary::Image &image = (background == 0) ? input : empty;
+      for (levels = 0; ok_so_far && sparse_equal && levels <= 2;
+          levels += 2) {
+        transform = ::NewTransform(engine, true_for_erosion, false,
+            std::cout);
+        if (transform == NULL) ok_so_far = false;
+        if (!ok_so_far) continue;
+        ok_so_far = transform->set_seed(seed, 0);
+        if (ok_so_far) ok_so_far = transform->set_max_iterations(levels);
+        if (ok_so_far) {
+          ok_so_far = ::RunTransform(plan, image, transform, &dense);
+        }
+        delete transform;
+        transform = NULL;
+        if (!ok_so_far) continue;
+        if (true_for_erosion) {
+          ok_so_far = ::RunSparse<imaging::binary::morphology::SparseErosion>(
+              plan, image, seed, levels, &sparse);
+        } else {
+          ok_so_far = ::RunSparse<imaging::binary::morphology::SparseDilation>(
+              plan, image, seed, levels, &sparse);
+        }
+        if (ok_so_far && !dense.Equals(sparse)) sparse_equal = false;
+      }
+    }
+    if (!ok_so_far) continue;
+    ::ReportCheck("sparse", engine, true_for_erosion, be_verbose,
+        sparse_equal);
+    if (!sparse_equal) *equal = false;
+  }
+  return ok_so_far;
+}
+
+// Runs every mode check, clearing 'equal' if some output differs.
+bool CheckModes(const std::vector<imaging::binary::StructuringElement*> &se,
+    const imaging::binary::Image &image_e,
+    const imaging::binary::Image &image_d, const std::string &file_path,
+    const uint64_t seed, const bool be_verbose, bool *equal) {
+  if (equal == NULL) return false;
+  bool ok_so_far = true;
+  imaging::binary::morphology::TransformPlan plan;
+  *equal = true;
+  ok_so_far = plan.Initialize(se);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckFlag(plan, image_e, image_d, seed, "guard band",
+      &imaging::binary::morphology::Transform::set_guard_band, false,
+      be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  // Only erosions, whose output does not depend on the SE order, may be
+  // ordered by cost.
+  ok_so_far = ::CheckFlag(plan, image_e, image_d, seed, "ordered by cost",
+      &imaging::binary::morphology::Transform::set_ordered_by_cost, true,
+      be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckFlag(plan, image_e, image_d, seed,
+      "adaptive element order",
+      &imaging::binary::morphology::Transform::set_adaptive_element_order,
+      false, be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckTiled(plan, image_e, image_d, seed, be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckBatch(plan, se, image_e, image_d, seed, be_verbose,
+      equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckFused(plan, se, image_e, image_d, be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckUpdate(plan, se, image_e, image_d, seed, be_verbose,
+      equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckCap(plan, image_e, image_d, seed, be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckCancelled(plan, image_e, image_d, seed, be_verbose,
+      equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckStream(plan, image_e, image_d, file_path, seed,
+      be_verbose, equal);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = ::CheckSparse(plan, image_e, image_d, seed, be_verbose, equal);
+  return ok_so_far;
+}
+
 } // namespace
 
 int tester(
@@ -121,6 +958,7 @@ int tester(
     const bool be_verbose,
     const bool do_save,
     const bool image_info,
+    const bool check_modes,
     const long seed,
     const int total_algorithms,
     const bool algorithms[]) {
@@ -139,6 +977,7 @@ int tester(
   std::vector< imaging::ImagePositionIndex >
       *algorithm_remove_candidate_memory_access_counter = NULL;
   std::vector<int> background;
+  bool checks_equal = true;
   imaging::grayscale::Image *current_output = NULL;
   imaging::binary::StructuringElement *current_se = NULL;
   std::vector<std::string>::const_iterator current_string;
@@ -179,6 +1018,7 @@ int tester(
   std::vector< std::vector< imaging::ImagePositionIndex >* >
       remove_candidate_memory_access_counter;
   int result = 0;
+  uint64_t shuffle_seed = 0;
   double start = 0.;
   std::vector<double> times;
   imaging::grayscale::Image *unpadded_output = NULL;
@@ -250,26 +1090,31 @@ int tester(
     }
   }
   if (seed == -1) {
-    // After setting SEs, set a random seed for rand().
-    srand(time(NULL));
+    // After setting SEs, set a random seed for the SE sequences.
+    shuffle_seed = time(NULL);
   } else {
-    srand(seed);
+    shuffle_seed = seed;
   }
   // Obtain resulting images using selected algorithms.
   for (delta = 0; ok_so_far && delta < 2; ++delta) {
     const bool true_for_erosion = (delta == 0);
-    for (i = delta*total_algorithms/2;
-        ok_so_far && i < (delta+1)*total_algorithms/2; ++i) {
-      if (!algorithms[i]) continue;
+    for (i = 0; ok_so_far && i < total_algorithms; ++i) {
+      if (!algorithms[i] || ::IsErosion(i) != true_for_erosion) continue;
       if (debug || be_verbose) {
         debug_output << "Algorithm: ";
-        switch (i%(total_algorithms/2)) {
+        switch (::AlgorithmEngine(i)) {
           case 0:  debug_output << "Naive";
                    break;
           case 1:  debug_output << "Border";
                    break;
           case 2:  debug_output << "Matrix";
                    break;
+          case 3:  debug_output << "Bitwise";
+                   break;
+          case 4:  debug_output << "Rle";
+                   break;
+          case 5:  debug_output << "Sparse";
+                   break;
           default: debug_output << "ERROR";
                    break;
         }
@@ -312,57 +1157,19 @@ int tester(
         ok_so_far = false;
         continue;
       }
-      switch (i%(total_algorithms/2)) {
-        case 0:  if (true_for_erosion) {
-                   current_transform = new imaging::binary::morphology::NaiveErosion(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }
-                 } else {
-                   current_transform = new imaging::binary::morphology::NaiveDilation(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }                  
-                 }
-                 break;
-        case 1:  if (true_for_erosion) {
-                   current_transform = new imaging::binary::morphology::BorderErosion(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }
-                 } else {
-                   current_transform = new imaging::binary::morphology::BorderDilation(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }                  
-                 }
-                 break;
-        case 2:  if (true_for_erosion) {
-                   current_transform = new imaging::binary::morphology::MatrixErosion(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }
-                 } else {
-                   current_transform = new imaging::binary::morphology::MatrixDilation(debug, debug_output);
-                   if (current_transform == NULL) {
-                    ok_so_far = false;
-                    continue;
-                   }                  
-                 }
-                 break;
-        default:
-                 break;
+      current_transform = ::NewTransform(::AlgorithmEngine(i),
+          true_for_erosion, debug, debug_output);
+      if (current_transform == NULL) {
+        ok_so_far = false;
+        continue;
       }
       if (true_for_erosion) {
         image = image_e;
       } else {
         image = image_d;
       }
+      ok_so_far = current_transform->set_seed(shuffle_seed, 0);
+      if (!ok_so_far) continue;
       ok_so_far = current_transform->Calculate(*image, actual_se,
           &current_output, algorithm_determinate_border_comparison_counter,
           algorithm_insert_new_candidate_comparison_counter,
@@ -405,12 +1212,19 @@ int tester(
       current_transform = NULL;
     }
   }
+  // Check the modes of the engines against plain runs, if requested.
+  if (ok_so_far && check_modes) {
+    ok_so_far = ::CheckModes(actual_se, *image_e, *image_d, file_path,
+        shuffle_seed, be_verbose, &checks_equal);
+    if (!ok_so_far) result |= 1 << 1;
+    if (!checks_equal) result |= 1 << 3;
+  }
   // Iterate to save output images or to display info, if requested.
   iterate_for_save_or_info = (result == 0) && (do_save || image_info);
   for (i = 0;
       ok_so_far && i < total_algorithms && iterate_for_save_or_info;
       ++i) {
-    const bool true_for_erosion = (i < total_algorithms/2);
+    const bool true_for_erosion = ::IsErosion(i);
     if (!algorithms[i]) continue;
     if (!ok_so_far) continue;
     if (do_save) {
@@ -420,13 +1234,19 @@ int tester(
       else
         suffix += "dilation";
       suffix += "_";
-      switch (i%(total_algorithms/2)) {
+      switch (::AlgorithmEngine(i)) {
         case 0:  suffix += "naive";
                  break;
         case 1:  suffix += "border";
                  break;
         case 2:  suffix += "matrix";
                  break;
+        case 3:  suffix += "bitwise";
+                 break;
+        case 4:  suffix += "rle";
+                 break;
+        case 5:  suffix += "sparse";
+                 break;
         default: break;
       }
       ok_so_far = bidimensional::SaveGrayscaleImage(
@@ -465,11 +1285,10 @@ int tester(
   // Compair obtained images.
   for (delta = 0; ok_so_far && delta < 2; ++delta) {
     const bool true_for_erosion = (delta == 0);
-    const int last_for_comparison = (delta+1)*total_algorithms/2-1;
-    for (m = delta*(total_algorithms/2); m < last_for_comparison; ++m) {
-      if (!algorithms[m]) continue;
-      for (n = m+1; n < last_for_comparison+1; ++n) {
-        if (!algorithms[n]) continue;
+    for (m = 0; m < total_algorithms; ++m) {
+      if (!algorithms[m] || ::IsErosion(m) != true_for_erosion) continue;
+      for (n = m+1; n < total_algorithms; ++n) {
+        if (!algorithms[n] || ::IsErosion(n) != true_for_erosion) continue;
         if (!(output.at(m))->Equals(*(output.at(n)))) {
           debug_output << "error: ";
           if (true_for_erosion) {
@@ -516,15 +1335,21 @@ int tester(
     printf("%d;%d;%d;%d;",
         1+2*(::half_se_length), number_of_se, width, height);
     for (i = 0; ok_so_far && i < total_algorithms; ++i) {
-      const bool true_for_erosion = (i < total_algorithms/2);
+      const bool true_for_erosion = ::IsErosion(i);
       if (be_verbose) {
-        switch (i%(total_algorithms/2)) {
+        switch (::AlgorithmEngine(i)) {
           case 0:  printf("Naive");
                    break;
           case 1:  printf("Border");
                    break;
           case 2:  printf("Matrix");
                    break;
+          case 3:  printf("Bitwise");
+                   break;
+          case 4:  printf("Rle");
+                   break;
+          case 5:  printf("Sparse");
+                   break;
           default: break;
         }
         printf(" ");
@@ -559,7 +1384,8 @@ int tester(
     std::string suffix(".");
     const bool true_for_erosion = (delta == 0);
     // Verifies the number of iterations.
-    for (i = delta*total_algorithms/2; i < (delta+1)*total_algorithms/2; ++i) {
+    for (i = 0; i < total_algorithms; ++i) {
+      if (::IsErosion(i) != true_for_erosion) continue;
       if (determinate_border_comparison_counter.at(i) == NULL) continue;
       int current_algorithm_iterations =
           static_cast<int>(determinate_border_comparison_counter.at(i)->size());
@@ -574,8 +1400,8 @@ int tester(
         current_operation_iterations = current_algorithm_iterations;
     }
     if (current_operation_iterations == 0) continue;
-    for (i = delta*total_algorithms/2; i < (delta+1)*total_algorithms/2; ++i) {
-      if (!algorithms[i]) continue;
+    for (i = 0; i < total_algorithms; ++i) {
+      if (!algorithms[i] || ::IsErosion(i) != true_for_erosion) continue;
       // Prepare output file.
       suffix = ".";
       if (true_for_erosion)
@@ -583,13 +1409,19 @@ int tester(
       else
         suffix += "dilation";
       suffix += "_";
-      switch (i%(total_algorithms/2)) {
+      switch (::AlgorithmEngine(i)) {
         case 0:  suffix += "naive";
                  break;
         case 1:  suffix += "border";
                  break;
         case 2:  suffix += "matrix";
                  break;
+        case 3:  suffix += "bitwise";
+                 break;
+        case 4:  suffix += "rle";
+                 break;
+        case 5:  suffix += "sparse";
+                 break;
         default: break;
       }
       suffix += ".csv";
@@ -788,10 +1620,11 @@ int tester(
 int main(int argc, const char* argv[]) {
   char usage_buffer[8192];
   sprintf(usage_buffer,
-          "usage: '%s' [-i] [-r] [-s] [-v]"
+          "usage: '%s' [-c] [-i] [-r] [-s] [-v]"
           " image_file_path counter_file_prefix"
           " se_length number_of_se algorithms seed\n"
           "\tOptional:\n"
+          "\t\t-c: check engine modes against plain runs\n"
           "\t\t-i: image information\n"
           "\t\t-r: randomize SEs\n"
           "\t\t-s: save each image\n"
@@ -810,12 +1643,18 @@ int main(int argc, const char* argv[]) {
           "\t\t\t\tbit 3 : naive dilation\n"
           "\t\t\t\tbit 4 : border dilation\n"
           "\t\t\t\tbit 5 : matrix dilation\n"
+          "\t\t\t\tbit 6 : bitwise erosion\n"
+          "\t\t\t\tbit 7 : bitwise dilation\n"
+          "\t\t\t\tbit 8 : rle erosion\n"
+          "\t\t\t\tbit 9 : rle dilation\n"
+          "\t\t\t\tbit 10 : sparse erosion\n"
+          "\t\t\t\tbit 11 : sparse dilation\n"
           "\t\tseed: select seed for random ordering of arrays, "
           "-1 to use time for seed\n",
           argv[0]);
-  const int optional = 4;
+  const int optional = 5;
   const int required = 6;
-  const int total_algorithms = 6;
+  const int total_algorithms = 2*::ENGINES;
   if (optional < 0 || required < 1) return 1;
   if (argc < required+1 || argc > required+optional+1) {
     printf("%s", usage_buffer);
@@ -824,6 +1663,8 @@ int main(int argc, const char* argv[]) {
   bool algorithms[total_algorithms];
   bool be_random = false;
   bool be_verbose = false;
+  const std::string check("-c");
+  bool check_modes = false;
   bool debug = false;
   bool do_save = false;
   const std::string file_path(argv[argc-required]);
@@ -843,112 +1684,21 @@ int main(int argc, const char* argv[]) {
   debug = true;
 #endif
   for (i = 0; i < total_algorithms; ++i) algorithms[i] = false;
-  if (argc > required+1) {
-    if (info.compare(argv[1]) != 0
-        && random.compare(argv[1]) != 0
-        && save.compare(argv[1]) != 0
-        && verbose.compare(argv[1]) != 0) {
+  for (i = 1; i < argc-required; ++i) {
+    if (check.compare(argv[i]) == 0) {
+      check_modes = true;
+    } else if (info.compare(argv[i]) == 0) {
+      image_info = true;
+    } else if (random.compare(argv[i]) == 0) {
+      be_random = true;
+    } else if (save.compare(argv[i]) == 0) {
+      do_save = true;
+    } else if (verbose.compare(argv[i]) == 0) {
+      be_verbose = true;
+    } else {
       printf("%s", usage_buffer);
       return -1;
     }
-    switch (argc-required-1) {
-      case 1:         if (info.compare(argv[1]) == 0) {
-                        image_info = true;
-                        break;
-                      }
-                      if (random.compare(argv[1]) == 0) {
-                        be_random = true;
-                        break;
-                      }
-                      if (save.compare(argv[1]) == 0) {
-                        do_save = true;
-                        break;
-                      }
-                      if (verbose.compare(argv[1]) == 0) {
-                        be_verbose = true;
-                        break;
-                      }
-      case 2:         if (info.compare(argv[1]) == 0
-                          && random.compare(argv[2]) == 0) {
-                        be_random = true;
-                        image_info = true;
-                        break;
-                      }
-                      if (random.compare(argv[1]) == 0
-                          && save.compare(argv[2]) == 0) {
-                        be_random = true;
-                        do_save = true;
-                        break;
-                      }
-                      if (save.compare(argv[1]) == 0
-                          && verbose.compare(argv[2]) == 0) {
-                        do_save = true;
-                        be_verbose = true;
-                        break;
-                      }
-                      if (info.compare(argv[1]) == 0
-                          && save.compare(argv[2]) == 0) {
-                        do_save = true;
-                        image_info = true;
-                        break;
-                      }
-                      if (info.compare(argv[1]) == 0
-                          && verbose.compare(argv[2]) == 0) {
-                        image_info = true;
-                        be_verbose = true;
-                        break;
-                      }
-                      if (random.compare(argv[1]) == 0
-                          && verbose.compare(argv[2]) == 0) {
-                        be_random = true;
-                        be_verbose = true;
-                        break;
-                      }
-      case 3:         if (info.compare(argv[1]) == 0
-                          && random.compare(argv[2]) == 0
-                          && save.compare(argv[3]) == 0) {
-                        image_info = true;
-                        be_random = true;
-                        do_save = true;
-                        break;
-                      }
-                      if (random.compare(argv[1]) == 0
-                          && save.compare(argv[2]) == 0
-                          && verbose.compare(argv[3]) == 0) {
-                        be_random = true;
-                        do_save = true;
-                        be_verbose = true;
-                        break;
-                      }
-                      if (info.compare(argv[1]) == 0
-                          && random.compare(argv[2]) == 0
-                          && verbose.compare(argv[3]) == 0) {
-                        image_info = true;
-                        be_random = true;
-                        be_verbose = true;
-                        break;
-                      }
-                      if (info.compare(argv[1]) == 0
-                          && save.compare(argv[2]) == 0
-                          && verbose.compare(argv[3]) == 0) {
-                        image_info = true;
-                        do_save = true;
-                        be_verbose = true;
-                        break;
-                      }
-      case optional:  if (info.compare(argv[1]) == 0
-                          && random.compare(argv[2]) == 0
-                          && save.compare(argv[3]) == 0
-                          && verbose.compare(argv[4]) == 0) {
-                        image_info = true;
-                        be_random = true;
-                        do_save = true;
-                        be_verbose = true;
-                        break;
-                      }
-      default: printf("%s", usage_buffer);
-               return -1;
-    }
   }
   if (be_random) {
     srand(time(NULL));
@@ -990,6 +1740,7 @@ int main(int argc, const char* argv[]) {
     }
   }
   return_value = tester(debug, file_path, counter_data_prefix, number_of_se,
-        be_verbose, do_save, image_info, seed, total_algorithms, algorithms);
+        be_verbose, do_save, image_info, check_modes, seed, total_algorithms,
+        algorithms);
   return return_value;
 }
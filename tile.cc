@@ -0,0 +1,528 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+
+// This file contains the implementation of the tiled transform.
+
+#include <algorithm>
+
+#include <sys/time.h>
+
+#include "tile.h"
+#include "img-inl.h"
+#include "shuffle-inl.h"
+
+namespace {
+
+// Number of counters of each engine.
+const unsigned COUNTERS = 6;
+
+} // namespace
+
+// imaging::binary::morphology::TiledTransform
+
+imaging::binary::morphology::TiledTransform::~TiledTransform() {
+  unsigned tile = 0;
+  clear();
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  for (tile = 0; tile < engines_.size(); ++tile) {
+    delete engines_.at(tile);
+    delete tile_images_.at(tile);
+    delete tile_outputs_.at(tile);
+  }
+}
+
+bool imaging::binary::morphology::TiledTransform::Execute(
+    const imaging::binary::morphology::TransformPlan &plan,
+    const imaging::binary::Image &image,
+    imaging::grayscale::Image *output,
+    double *start,
+    double *end) {
+  if (output == NULL || start == NULL || end == NULL) return false;
+  if (factory_ == NULL || !plan.initialized()) return false;
+  if (!output->size().Equals(image.size())) return false;
+  bool any_candidates = false;
+  imaging::ImagePositionIndex border = 0;
+  imaging::SEIndex current_se = 0;
+  imaging::ImagePositionIndex current_se_index = 0;
+  imaging::ImagePositionIndex i = 0;
+  imaging::SEIndex not_done = 0;
+  const imaging::SEIndex number_of_se = plan.se_elements().size();
+  bool ok_so_far = true;
+  std::vector< imaging::SEIndex > se_index;
+  std::vector< std::vector<imaging::ImagePositionIndex> > shuffled_indexes;
+  imaging::Position target;
+  unsigned tile = 0;
+  struct timeval timer;
+  int value = 0;
+  this->clear();
+  plan_ = &plan;
+  // Start!
+  gettimeofday(&timer, NULL);
+  *start = timer.tv_sec*1000000.+timer.tv_usec;
+  ok_so_far = InitializeTiles(image);
+  if (!ok_so_far) return ok_so_far;
+  for (tile = 0; ok_so_far && tile < engines_.size(); ++tile) {
+    ok_so_far = PrepareTile(tile);
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Map the halo of each tile and fill it from the neighboring tiles.
+  scheduled_.clear();
+  for (tile = 0; tile < engines_.size(); ++tile) scheduled_.push_back(tile);
+  ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+      InitializeHalo);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+      GatherHalo);
+  if (!ok_so_far) return ok_so_far;
+  ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+      ApplyHalo);
+  if (!ok_so_far) return ok_so_far;
+  // Setting up SE element index shuffler's data, as a single engine does.
+  for (current_se = 0; current_se < number_of_se; ++current_se) {
+    std::vector<imaging::ImagePositionIndex> current_se_indexes;
+    const imaging::ImagePositionIndex current_cardinality =
+        plan.se_cardinality().at(current_se);
+    for (current_se_index = 0; current_se_index < current_cardinality;
+        ++current_se_index) {
+      current_se_indexes.push_back(current_se_index);
+    }
+    shuffled_indexes.push_back(current_se_indexes);
+    se_index.push_back(current_se);
+  }
+  // Transform itself, every tile running the same SE sequence.
+  random_ = random_seed_;
+  for (tile = 0; tile < engines_.size(); ++tile) {
+    if (engines_.at(tile)->HasCandidates()) any_candidates = true;
+  }
+  not_done = 0;
+  while (ok_so_far && any_candidates && not_done < number_of_se) {
+    for (tile = 0; ok_so_far && tile < engines_.size(); ++tile) {
+      ok_so_far = engines_.at(tile)->BeginIteration();
+    }
+    if (!ok_so_far) continue;
+    ok_so_far = shuffle(&se_index, &random_); // shuffle SE sequence
+    not_done = 0;
+    for (current_se = 0;
+        ok_so_far && any_candidates && current_se < number_of_se;
+        ++current_se) {
+      current_se_index_ = se_index.at(current_se);
+      ok_so_far = shuffle(&(shuffled_indexes.at(current_se_index_)),
+          &random_);
+      if (!ok_so_far) continue;
+      current_se_indexes_ = &(shuffled_indexes.at(current_se_index_));
+      // Step the tiles which still have candidates.
+      scheduled_.clear();
+      tile_border_.assign(engines_.size(), 0);
+      for (tile = 0; tile < engines_.size(); ++tile) {
+        if (engines_.at(tile)->HasCandidates()) scheduled_.push_back(tile);
+      }
+      ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+          StepTile);
+      if (!ok_so_far) continue;
+      // Verifies if operation was possible for the original SE.
+      border = 0;
+      for (tile = 0; tile < engines_.size(); ++tile) {
+        border += tile_border_.at(tile);
+      }
+      if (border == 0) {
+        ++not_done;
+        continue;
+      }
+      not_done = 0;
+      // Exchange the halo of the tiles next to a changed tile.
+      scheduled_.clear();
+      for (tile = 0; tile < engines_.size(); ++tile) {
+        const std::vector<unsigned> &neighbors = tile_neighbors_.at(tile);
+        for (i = 0; i < neighbors.size(); ++i) {
+          if (tile_border_.at(neighbors.at(i)) == 0) continue;
+          scheduled_.push_back(tile);
+          break;
+        }
+      }
+      ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+          GatherHalo);
+      if (!ok_so_far) continue;
+      ok_so_far = RunPhase(&imaging::binary::morphology::TiledTransform::
+          ApplyHalo);
+      if (!ok_so_far) continue;
+      any_candidates = false;
+      for (tile = 0; tile < engines_.size(); ++tile) {
+        if (engines_.at(tile)->HasCandidates()) any_candidates = true;
+      }
+    }
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Finally!
+  gettimeofday(&timer, NULL);
+  *end = timer.tv_sec*1000000.+timer.tv_usec;
+  // Write each tile output at its place of the output image.
+  for (tile = 0; ok_so_far && tile < engines_.size(); ++tile) {
+    const imaging::grayscale::Image &tile_output = *tile_outputs_.at(tile);
+    ok_so_far = engines_.at(tile)->Finish(tile_outputs_.at(tile));
+    if (!ok_so_far) continue;
+    imaging::PositionIterator iterator(tile_output.size());
+    ok_so_far = iterator.begin();
+    if (!ok_so_far) continue;
+    do {
+      const imaging::Position &current = iterator.value();
+      ok_so_far = tile_output.value(current, &value);
+      if (!ok_so_far) continue;
+      ok_so_far = current.Sum(tile_lower_.at(tile), &target);
+      if (!ok_so_far) continue;
+      ok_so_far = output->set_value(target, value);
+    } while (ok_so_far && iterator.iterate());
+    if (!iterator.IsFinished()) ok_so_far = false;
+  }
+  this->clear();
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::set_seed(
+    const uint64_t seed, const uint64_t stream) {
+  return random_seed_.Seed(seed, stream);
+}
+
+bool imaging::binary::morphology::TiledTransform::set_threads(
+    const unsigned threads) {
+  if (threads == 0) return false;
+  if (pool_ != NULL) {
+    delete pool_;
+    pool_ = NULL;
+  }
+  if (threads == 1) return true;
+  pool_ = new imaging::WorkStealingPool(threads);
+  return pool_ != NULL;
+}
+
+unsigned imaging::binary::morphology::TiledTransform::threads() const {
+  if (pool_ == NULL) return 1;
+  return pool_->threads();
+}
+
+bool imaging::binary::morphology::TiledTransform::ApplyHalo(
+    const unsigned tile) {
+  imaging::binary::morphology::Transform &engine = *engines_.at(tile);
+  const std::vector<imaging::ImagePositionIndex> &halo_index =
+      halo_index_.at(tile);
+  const std::vector<char> &incoming = halo_incoming_.at(tile);
+  imaging::ImagePositionIndex index = 0;
+  imaging::SEIndex j = 0;
+  imaging::ImagePositionIndex k = 0;
+  int marked_value = 0;
+  imaging::ImagePositionIndex node = 0;
+  bool ok_so_far = true;
+  bool position_value = false;
+  // Value of the pixels processed by the engine at Y_ and output.
+  const bool processed = !engine.true_for_erosion_;
+  imaging::Position target;
+  const int unprocessed_mark = engine.true_for_erosion_ ? 0 : -1;
+  for (k = 0; ok_so_far && k < halo_index.size(); ++k) {
+    const bool value = incoming.at(k);
+    ok_so_far = engine.Y_->value(halo_index.at(k), &position_value);
+    if (!ok_so_far) continue;
+    if (position_value == value) continue;
+    ok_so_far = engine.Y_->set_value(halo_index.at(k), value);
+    if (!ok_so_far) continue;
+    // Engines without a candidate matrix enqueue every candidate at first.
+    if (value != processed || !engine.use_candidate_matrix_) continue;
+    // The halo pixel was processed by its tile: enqueue the unprocessed
+    // pixels of this tile which have it as a neighbor.
+    const imaging::Position &p = halo_position_.at(tile).at(k);
+    for (j = 0; ok_so_far && j < engine.u_cardinality(); ++j) {
+      engine.algorithm_insert_new_candidate_comparison_counter_->at(
+          engine.se_iteration_) += 1;
+      if (engine.true_for_erosion_) {
+        ok_so_far = p.Subtract(engine.u_elements_.at(j), &target);
+      } else {
+        ok_so_far = p.Sum(engine.u_elements_.at(j), &target);
+      }
+      if (!ok_so_far) continue;
+      if (!engine.candidate_region_.IsValid(target)) continue;
+      ok_so_far = engine.Y_->LinearIndex(target, &index);
+      if (!ok_so_far) continue;
+      ok_so_far = engine.Y_->value(index, &position_value);
+      if (!ok_so_far) continue;
+      if (position_value == processed) continue;
+      ok_so_far = engine.guard_band_output_->value(index, &marked_value);
+      if (!ok_so_far) continue;
+      if (marked_value != unprocessed_mark) continue;
+      ok_so_far = engine.linear_position(index, &node);
+      if (!ok_so_far) continue;
+      if (node == imaging::HEADER) continue;
+      ok_so_far = engine.EnqueueCandidateNode(node);
+    }
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::clear() {
+  current_se_index_ = 0;
+  current_se_indexes_ = NULL;
+  plan_ = NULL;
+  scheduled_.clear();
+  return true;
+}
+
+bool imaging::binary::morphology::TiledTransform::GatherHalo(
+    const unsigned tile) {
+  std::vector<char> &incoming = halo_incoming_.at(tile);
+  imaging::ImagePositionIndex k = 0;
+  bool ok_so_far = true;
+  bool position_value = false;
+  const std::vector<unsigned> &source = halo_source_.at(tile);
+  const std::vector<imaging::ImagePositionIndex> &source_index =
+      halo_source_index_.at(tile);
+  incoming.resize(source_index.size());
+  for (k = 0; ok_so_far && k < source_index.size(); ++k) {
+    ok_so_far = engines_.at(source.at(k))->Y_->value(source_index.at(k),
+        &position_value);
+    incoming.at(k) = position_value;
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::InitializeHalo(
+    const unsigned tile) {
+  const imaging::binary::morphology::Transform &engine = *engines_.at(tile);
+  imaging::Position global;
+  char i = 0;
+  imaging::ImagePositionIndex index = 0;
+  bool inside = true;
+  const imaging::Position &lower = tile_lower_.at(tile);
+  const char n = imaging::Dimension::number();
+  std::vector<unsigned> &neighbors = tile_neighbors_.at(tile);
+  bool ok_so_far = true;
+  const imaging::Position &reach = engine.u_reach_;
+  unsigned source = 0;
+  imaging::ImagePositionIndex source_index = 0;
+  imaging::Position source_position;
+  long value = 0;
+  halo_index_.at(tile).clear();
+  halo_position_.at(tile).clear();
+  halo_source_.at(tile).clear();
+  halo_source_index_.at(tile).clear();
+  neighbors.clear();
+  imaging::PositionIterator iterator(engine.Y_->size());
+  ok_so_far = iterator.begin();
+  if (!ok_so_far) return ok_so_far;
+  do {
+    const imaging::Position &current = iterator.value();
+    if (engine.candidate_region_.IsValid(current)) continue;
+    // Halo pixels outside the image stay as background.
+    inside = true;
+    for (i = 0; ok_so_far && inside && i < n; ++i) {
+      value = current.coordinate(i)-reach.coordinate(i)+lower.coordinate(i);
+      if (value < 0 || value >= image_lengths_.coordinate(i)) inside = false;
+      ok_so_far = global.set_value(i, value);
+    }
+    if (!ok_so_far || !inside) continue;
+    ok_so_far = TileOf(global, &source);
+    if (!ok_so_far) continue;
+    for (i = 0; ok_so_far && i < n; ++i) {
+      ok_so_far = source_position.set_value(i, global.coordinate(i)
+          -tile_lower_.at(source).coordinate(i)+reach.coordinate(i));
+    }
+    if (!ok_so_far) continue;
+    ok_so_far = engines_.at(source)->Y_->LinearIndex(source_position,
+        &source_index);
+    if (!ok_so_far) continue;
+    ok_so_far = engine.Y_->LinearIndex(current, &index);
+    if (!ok_so_far) continue;
+    halo_index_.at(tile).push_back(index);
+    halo_position_.at(tile).push_back(current);
+    halo_source_.at(tile).push_back(source);
+    halo_source_index_.at(tile).push_back(source_index);
+    if (std::find(neighbors.begin(), neighbors.end(), source)
+        == neighbors.end()) neighbors.push_back(source);
+  } while (ok_so_far && iterator.iterate());
+  if (!iterator.IsFinished()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::InitializeTiles(
+    const imaging::binary::Image &image) {
+  imaging::Position global;
+  char i = 0;
+  long count = 0;
+  long length = 0;
+  imaging::Position lengths;
+  const char n = imaging::Dimension::number();
+  bool ok_so_far = true;
+  bool position_value = false;
+  long rest = 0;
+  long size = 0;
+  unsigned tile = 0;
+  unsigned tiles = 1;
+  long value = 0;
+  // Tiles by dimension; the last one takes the remaining pixels.
+  for (i = 0; ok_so_far && i < n; ++i) {
+    length = image.Length(i);
+    size = tile_size_.coordinate(i);
+    if (size < 1) return false;
+    count = length/size;
+    if (count < 1) count = 1;
+    ok_so_far = tile_counts_.set_value(i, count);
+    if (!ok_so_far) continue;
+    ok_so_far = image_lengths_.set_value(i, length);
+    tiles *= count;
+  }
+  if (!ok_so_far) return ok_so_far;
+  // Engines and buffers are kept while the number of tiles does not change.
+  if (tiles != engines_.size()) {
+    for (tile = 0; tile < engines_.size(); ++tile) {
+      delete engines_.at(tile);
+      delete tile_images_.at(tile);
+      delete tile_outputs_.at(tile);
+    }
+    engines_.assign(tiles, NULL);
+    tile_images_.assign(tiles, NULL);
+    tile_outputs_.assign(tiles, NULL);
+    for (tile = 0; tile < tiles; ++tile) {
+      engines_.at(tile) = factory_();
+      if (engines_.at(tile) == NULL) return false;
+    }
+  }
+  counters_.resize(tiles*COUNTERS);
+  halo_index_.resize(tiles);
+  halo_incoming_.resize(tiles);
+  halo_position_.resize(tiles);
+  halo_source_.resize(tiles);
+  halo_source_index_.resize(tiles);
+  tile_border_.assign(tiles, 0);
+  tile_lower_.resize(tiles);
+  tile_neighbors_.resize(tiles);
+  for (tile = 0; ok_so_far && tile < tiles; ++tile) {
+    imaging::binary::morphology::Transform &engine = *engines_.at(tile);
+    // Only engines removing the border from the candidate list may be tiled.
+    if (!engine.regular_removal_) return false;
+    ok_so_far = engine.set_guard_band(true);
+    if (!ok_so_far) continue;
+    rest = tile;
+    for (i = 0; ok_so_far && i < n; ++i) {
+      count = tile_counts_.coordinate(i);
+      size = tile_size_.coordinate(i);
+      value = (rest%count)*size;
+      length = (rest%count == count-1) ? image.Length(i)-value : size;
+      rest /= count;
+      ok_so_far = tile_lower_.at(tile).set_value(i, value);
+      if (!ok_so_far) continue;
+      ok_so_far = lengths.set_value(i, length);
+    }
+    if (!ok_so_far) continue;
+    ok_so_far = imaging::binary::morphology::Transform::ReserveBuffer(
+        imaging::Size(lengths), true, &tile_images_.at(tile));
+    if (!ok_so_far) continue;
+    ok_so_far = imaging::binary::morphology::Transform::ReserveBuffer(
+        imaging::Size(lengths), -1, &tile_outputs_.at(tile));
+    if (!ok_so_far) continue;
+    // Copy the tile from the input image.
+    imaging::PositionIterator iterator(tile_images_.at(tile)->size());
+    ok_so_far = iterator.begin();
+    if (!ok_so_far) continue;
+    do {
+      const imaging::Position &current = iterator.value();
+      ok_so_far = current.Sum(tile_lower_.at(tile), &global);
+      if (!ok_so_far) continue;
+      ok_so_far = image.value(global, &position_value);
+      if (!ok_so_far) continue;
+      ok_so_far = tile_images_.at(tile)->set_value(current, position_value);
+    } while (ok_so_far && iterator.iterate());
+    if (!iterator.IsFinished()) ok_so_far = false;
+  }
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::PrepareTile(
+    const unsigned tile) {
+  std::vector< std::vector<imaging::ImagePositionIndex> >::iterator
+      counters = counters_.begin()+tile*COUNTERS;
+  imaging::binary::morphology::Transform &engine = *engines_.at(tile);
+  unsigned k = 0;
+  bool ok_so_far = true;
+  double start = 0;
+  for (k = 0; k < COUNTERS; ++k) counters[k].clear();
+  ok_so_far = engine.Prepare(*plan_, *tile_images_.at(tile),
+      tile_outputs_.at(tile), &counters[0], &counters[1], &counters[2],
+      &counters[3], &counters[4], &counters[5], &start);
+  if (!ok_so_far) return ok_so_far;
+  return engine.PrepareCandidates();
+}
+
+bool imaging::binary::morphology::TiledTransform::RunPhase(
+    bool (imaging::binary::morphology::TiledTransform::*phase)(
+        const unsigned tile)) {
+  imaging::ImagePositionIndex i = 0;
+  bool ok_so_far = true;
+  if (pool_ == NULL) {
+    for (i = 0; ok_so_far && i < scheduled_.size(); ++i) {
+      ok_so_far = (this->*phase)(scheduled_.at(i));
+    }
+    return ok_so_far;
+  }
+  for (i = 0; i < scheduled_.size(); ++i) {
+    const unsigned tile = scheduled_.at(i);
+    if (!pool_->Submit([this, phase, tile]() {
+          return (this->*phase)(tile);
+        })) ok_so_far = false;
+  }
+  // Every phase ends at this barrier, as the next one reads its results.
+  if (!pool_->Wait()) ok_so_far = false;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::StepTile(
+    const unsigned tile) {
+  imaging::binary::morphology::Transform &engine = *engines_.at(tile);
+  bool ok_so_far = true;
+  engine.border_counter_ = 0;
+  ok_so_far = engine.DetectStepBorder(current_se_index_,
+      *current_se_indexes_);
+  if (!ok_so_far) return ok_so_far;
+  // Remove border pixels.
+  ok_so_far = engine.RemoveBorder(&engine.guard_band_output_);
+  if (!ok_so_far) return ok_so_far;
+  // Insert new candidate pixels into candidate queue.
+  ok_so_far = engine.InsertNewCandidateFromBorder(&engine.guard_band_output_);
+  if (!ok_so_far) return ok_so_far;
+  engine.algorithm_number_of_elements_in_border_->at(engine.se_iteration_)
+      += engine.border_counter_;
+  tile_border_.at(tile) = engine.border_counter_;
+  engine.border_counter_ = 0;
+  return ok_so_far;
+}
+
+bool imaging::binary::morphology::TiledTransform::TileOf(
+    const imaging::Position &position, unsigned *tile) const {
+  if (tile == NULL) return false;
+  long count = 0;
+  char i = 0;
+  long index = 0;
+  const char n = imaging::Dimension::number();
+  long stride = 1;
+  *tile = 0;
+  for (i = 0; i < n; ++i) {
+    count = tile_counts_.coordinate(i);
+    index = position.coordinate(i)/tile_size_.coordinate(i);
+    if (index >= count) index = count-1;
+    *tile += index*stride;
+    stride *= count;
+  }
+  return true;
+}
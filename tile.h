@@ -0,0 +1,121 @@
+// Copyright 2012 Alexandre Yukio Harano
+//
+// Licensed under the ImageMagick License (the "License"); you may not use
+// this file except in compliance with the License.  You may obtain a copy
+// of the License at
+//
+//   http://www.imagemagick.org/script/license.php
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS, WITHOUT
+// WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.  See the
+// License for the specific language governing permissions and limitations
+// under the License.
+//
+// Author: Alexandre Yukio Harano <ayharano AT ime DOT usp DOT br>
+
+
+// This file contains the declaration of the tiled transform, which splits
+// the image in tiles, each one run by its own engine in lockstep.
+
+#ifndef TILE_H_
+#define TILE_H_
+
+#include "img.h"
+#include "pool.h"
+
+namespace imaging {
+
+
+namespace binary {
+
+
+namespace morphology {
+
+
+// Runs a transform over tiles of the image. Each tile is run by its own
+// engine, whose Y_ is the tile padded by the reach of the SEs as in the
+// guard band mode; the pad is the halo, which holds a copy of the pixels of
+// the neighboring tiles. All engines run each SE step in lockstep and, after
+// every step, the halo of each tile is exchanged with its neighbors and the
+// tile candidates next to changed halo pixels are enqueued. Tiles without
+// candidates are left out of the step, and tiles whose neighbors did not
+// change are left out of the exchange.
+//
+// Only engines removing the border from the candidate list on the run, that
+// is, the naive and border ones, may be tiled. Their max_iterations cap is
+// not applied, as the iterations are driven here.
+class TiledTransform {
+ public:
+  // Tiles have 'tile_size' lengths, except the last tile of each dimension,
+  // which takes the remaining pixels.
+  TiledTransform(TransformFactory factory, const imaging::Position &tile_size)
+      : current_se_index_(0), current_se_indexes_(NULL), factory_(factory),
+        plan_(NULL), pool_(NULL), tile_size_(tile_size) {}
+  ~TiledTransform();
+  // Same as Transform::Execute, without per iteration counters.
+  bool Execute(const TransformPlan &plan, const imaging::binary::Image &image,
+      imaging::grayscale::Image *output, double *start, double *end);
+  // Same as Transform::set_seed, for the SE sequences shared by the tiles.
+  bool set_seed(const uint64_t seed, const uint64_t stream);
+  // Number of threads of the work-stealing pool running the tiles of a
+  // step. Defaults to 1, which runs them on the calling thread.
+  bool set_threads(const unsigned threads);
+  unsigned threads() const;
+ private:
+  TiledTransform()
+      : current_se_index_(0), current_se_indexes_(NULL), factory_(NULL),
+        plan_(NULL), pool_(NULL) {}
+  bool ApplyHalo(const unsigned tile);
+  bool clear();
+  bool GatherHalo(const unsigned tile);
+  bool InitializeHalo(const unsigned tile);
+  bool InitializeTiles(const imaging::binary::Image &image);
+  bool PrepareTile(const unsigned tile);
+  // Runs 'phase' on each tile of scheduled_, as jobs of pool_ if any.
+  bool RunPhase(bool (TiledTransform::*phase)(const unsigned tile));
+  bool StepTile(const unsigned tile);
+  // Tile holding 'position' of the image.
+  bool TileOf(const imaging::Position &position, unsigned *tile) const;
+
+  // Counters of the engines, in the order taken by Transform::Execute.
+  std::vector< std::vector<imaging::ImagePositionIndex> > counters_;
+  imaging::SEIndex current_se_index_;
+  const std::vector<imaging::ImagePositionIndex> *current_se_indexes_;
+  std::vector<imaging::binary::morphology::Transform*> engines_;
+  TransformFactory factory_;
+  // Halo data of each tile: halo pixels inside the image, as linear indexes
+  // and positions at the tile Y_, their source tile and linear index at its
+  // Y_, and the values gathered from the source tiles.
+  std::vector< std::vector<imaging::ImagePositionIndex> > halo_index_;
+  std::vector< std::vector<char> > halo_incoming_;
+  std::vector< std::vector<imaging::Position> > halo_position_;
+  std::vector< std::vector<unsigned> > halo_source_;
+  std::vector< std::vector<imaging::ImagePositionIndex> > halo_source_index_;
+  imaging::Position image_lengths_;
+  const TransformPlan *plan_;
+  imaging::WorkStealingPool* pool_;
+  imaging::RandomEngine random_;
+  imaging::RandomEngine random_seed_; // random_ at the start of a run
+  std::vector<unsigned> scheduled_;
+  std::vector<imaging::ImagePositionIndex> tile_border_; // of the last step
+  imaging::Position tile_counts_;
+  std::vector<imaging::binary::Image*> tile_images_;
+  std::vector<imaging::Position> tile_lower_;
+  std::vector< std::vector<unsigned> > tile_neighbors_;
+  std::vector<imaging::grayscale::Image*> tile_outputs_;
+  imaging::Position tile_size_;
+
+  DISALLOW_COPY_AND_ASSIGN(TiledTransform);
+}; // imaging:::binary::morphology::TiledTransform
+
+
+} // namespace imaging::binary::morphology
+
+
+} // namespace imaging::binary
+
+
+} // namespace imaging
+
+#endif // TILE_H_